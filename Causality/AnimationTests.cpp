@@ -0,0 +1,421 @@
+#include "pch_bcl.h"
+#include "Animations.h"
+#include <cmath>
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <iterator>
+#include <random>
+#include "Tests.h"
+
+using namespace DirectX;
+using namespace std;
+
+namespace Causality
+{
+	namespace
+	{
+		const float Pi = 3.14159265f;
+
+		// every fourth bone is constant, the others animate rotation, then translation, then scaling over one period of the clip
+		vector<ArmatureFrame> make_cyclic_clip(size_t boneCount, size_t frameCount, mt19937& rng)
+		{
+			uniform_real_distribution<float> unit(-1.0f, 1.0f);
+			vector<ArmatureFrame> frames(frameCount, ArmatureFrame(boneCount));
+			for (size_t b = 0; b < boneCount; b++)
+			{
+				XMVECTOR axis = XMVector3Normalize(XMVectorSet(unit(rng), unit(rng), unit(rng) + 2.0f, .0f));
+				XMVECTOR base = XMQuaternionRotationRollPitchYaw(unit(rng), unit(rng), unit(rng));
+				Vector3 offset(unit(rng), 1.0f + unit(rng), unit(rng));
+				float amplitude = 0.5f + 0.25f * unit(rng), phase = Pi * unit(rng);
+				int animated = b % 4;
+
+				for (size_t f = 0; f < frameCount; f++)
+				{
+					float s = sinf(2.0f * Pi * f / frameCount + phase);
+					auto& bone = frames[f][b];
+					bone.LclRotation = animated >= 1 ? XMQuaternionMultiply(base, XMQuaternionRotationAxis(axis, amplitude * s)) : base;
+					bone.LclTranslation = animated >= 2 ? Vector3(offset.x + 0.3f * s, offset.y, offset.z - 0.2f * s) : offset;
+					bone.LclScaling = animated >= 3 ? Vector3(1.0f + 0.2f * s, 1.0f, 1.0f - 0.1f * s) : Vector3(1.0f);
+				}
+			}
+			return frames;
+		}
+
+		// rotation angle between two unit quaternions, sign insensitive
+		float rotation_error(const Quaternion& a, const Quaternion& b)
+		{
+			XMVECTOR qa = XMLoadA(a), qb = XMLoadA(b);
+			if (XMVectorGetX(XMQuaternionDot(qa, qb)) < 0)
+				qb = -qb;
+			return 4.0f * asinf(min(XMVectorGetX(XMVector4Length(qa - qb)) * 0.5f, 1.0f));
+		}
+
+		float linear_error(const Vector3& a, const Vector3& b)
+		{
+			return max(max(fabsf(a.x - b.x), fabsf(a.y - b.y)), fabsf(a.z - b.z));
+		}
+
+		// source local data at a fractional frame position, frame n - 1 interpolates back to frame 0
+		void source_at(ArmatureFrame& out, const vector<ArmatureFrame>& frames, double position)
+		{
+			size_t n = frames.size();
+			size_t f0 = static_cast<size_t>(floor(position)) % n, f1 = (f0 + 1) % n;
+			float t = static_cast<float>(position - floor(position));
+			for (size_t b = 0; b < out.size(); b++)
+			{
+				auto& a = frames[f0][b];
+				auto& c = frames[f1][b];
+				XMVECTOR qa = XMLoadA(a.LclRotation), qc = XMLoadA(c.LclRotation);
+				if (XMVectorGetX(XMQuaternionDot(qa, qc)) < 0)
+					qc = -qc;
+				out[b].LclRotation = XMQuaternionNormalize(XMVectorLerp(qa, qc, t));
+				out[b].LclTranslation = XMVectorLerp(XMLoadA(a.LclTranslation), XMLoadA(c.LclTranslation), t);
+				out[b].LclScaling = XMVectorLerp(XMLoadA(a.LclScaling), XMLoadA(c.LclScaling), t);
+			}
+		}
+
+		// piecewise linear track through (times[i], values[i]), t is clamped to [times.front(), times.back()]
+		double track_at(const vector<double>& times, const vector<double>& values, double t)
+		{
+			size_t i = upper_bound(times.begin(), times.end(), t) - times.begin();
+			if (i == 0)
+				return values.front();
+			if (i == times.size())
+				return values.back();
+			double s = (t - times[i - 1]) / (times[i] - times[i - 1]);
+			return values[i - 1] + (values[i] - values[i - 1]) * s;
+		}
+
+		// the track sampled the way GetFrameAt samples frames at a cursor
+		double cursor_value(const AnimationCursor& cursor, const vector<double>& values)
+		{
+			double v0 = values[cursor.Key0()], v1 = values[cursor.Key1()];
+			return v0 + (v1 - v0) * cursor.Fraction();
+		}
+
+		// advance the cursor by every delta and compare it with stateless playback of the total time
+		// times and values describe the played track from clip time 0, Loop wraps with fmod, PingPong folds fmod of twice the length
+		// a clamped cursor moves back from its end on a negative delta, so Clamp follows the clamped sum of the deltas
+		int check_playback(AnimationCursor cursor, const vector<double>& times, const vector<double>& values, const vector<double>& deltas, double& maxError)
+		{
+			double length = times.back(), total = .0, clamped = .0;
+			int failures = 0;
+			for (double delta : deltas)
+			{
+				cursor.Advance(time_seconds(delta));
+				total += delta;
+				clamped = min(max(clamped + delta, .0), length);
+
+				double t = clamped;
+				if (cursor.Mode() == PlaybackMode::Loop)
+				{
+					t = fmod(total, length);
+					if (t < 0)
+						t += length;
+				}
+				else if (cursor.Mode() == PlaybackMode::PingPong)
+				{
+					t = fmod(total, 2 * length);
+					if (t < 0)
+						t += 2 * length;
+					if (t > length)
+						t = 2 * length - t;
+				}
+
+				double error = fabs(cursor_value(cursor, values) - track_at(times, values, t));
+				maxError = max(maxError, error);
+				if (error > 1e-5 || fabs(cursor.Length().count() - length) > 1e-12)
+					++failures;
+			}
+			return failures;
+		}
+	}
+
+	// CompressedArmatureClip against its source clip, with and without keyframe reduction
+	// Sample must stay within the tolerances at integer and fractional positions, the wrap from the last frame to frame 0 included,
+	// constant bones must round trip exactly and the lane decoder of this build must match the scalar one
+	bool CompressedClipTest()
+	{
+		mt19937 rng(45);
+		const size_t boneCount = 13, frameCount = 241;
+		auto frames = make_cyclic_clip(boneCount, frameCount, rng);
+
+		// a chain, the compressed data does not depend on the hierarchy
+		vector<int> parents(boneCount);
+		for (size_t b = 0; b < boneCount; b++)
+			parents[b] = (int)b - 1;
+		StaticArmature armature(boneCount, parents.data(), vector<const char*>(boneCount, "bone").data());
+		// slack for the float rounding of the decoder
+		const float slack = 2e-5f;
+
+		int failures = 0;
+		for (bool reduce : { false, true })
+		{
+			AnimationCompressionOptions options;
+			options.ReduceKeyframes = reduce;
+			CompressedArmatureClip clip;
+			clip.Compress(frames, options);
+
+			if (clip.frames() != frameCount || clip.bones() != boneCount
+				|| clip.animated_rotations() != boneCount - (boneCount + 3) / 4
+				|| (reduce ? clip.keys() >= frameCount : clip.keys() != frameCount))
+				++failures;
+
+			ArmatureFrame out(boneCount), scalar(boneCount), source(boneCount);
+			float rotationError = .0f, linearError = .0f, laneError = .0f;
+			for (int step = 0; step < 4 * (int)frameCount; step++)
+			{
+				// integer, fractional and last frame to frame 0 positions
+				double position = step * 0.25;
+				clip.Sample(out, position);
+				clip.SampleScalar(scalar, position);
+				source_at(source, frames, position);
+
+				for (size_t b = 0; b < boneCount; b++)
+				{
+					if (b % 4 == 0)
+					{
+						if (memcmp(&out[b].LocalTransform(), &frames[0][b].LocalTransform(), sizeof(IsometricTransform)) != 0)
+							++failures;
+						continue;
+					}
+
+					rotationError = max(rotationError, rotation_error(out[b].LclRotation, source[b].LclRotation));
+					linearError = max(linearError, linear_error(out[b].LclTranslation, source[b].LclTranslation));
+					linearError = max(linearError, linear_error(out[b].LclScaling, source[b].LclScaling));
+
+					laneError = max(laneError, rotation_error(out[b].LclRotation, scalar[b].LclRotation));
+					laneError = max(laneError, linear_error(out[b].LclTranslation, scalar[b].LclTranslation));
+					laneError = max(laneError, linear_error(out[b].LclScaling, scalar[b].LclScaling));
+				}
+			}
+
+			if (rotationError > options.RotationTolerance + slack
+				|| linearError > max(options.TranslationTolerance, options.ScalingTolerance) + slack
+				|| laneError > slack)
+				++failures;
+
+			// the animation samples the compressed clip by time
+			ArmatureFrameAnimation animation("compressed");
+			animation.SetArmature(armature);
+			animation.FrameInterval = time_seconds(1.0 / 30.0);
+			animation.Duration = time_seconds(frameCount / 30.0);
+			animation.IsCyclic = true;
+			animation.GetFrameBuffer() = frames;
+			animation.Compress(options);
+			if (!animation.IsCompressed() || animation.FrameCount() != frameCount)
+				++failures;
+
+			for (double position : { 0.0, 7.5, 30.0, frameCount - 0.5, frameCount + 2.25 })
+			{
+				animation.GetFrameAt(out, time_seconds(position / 30.0), false);
+				animation.GetCompressedClip().Sample(scalar, position);
+				for (size_t b = 0; b < boneCount; b++)
+				{
+					if (rotation_error(out[b].LclRotation, scalar[b].LclRotation) > slack
+						|| linear_error(out[b].LclTranslation, scalar[b].LclTranslation) > slack)
+						++failures;
+				}
+			}
+
+			cout << "compressed clip test (" << (reduce ? "reduced" : "all frames") << ") : " << clip.keys() << " keys, "
+				<< clip.byte_size() << " bytes, rotation error = " << rotationError << ", linear error = " << linearError
+				<< ", lane error = " << laneError << endl;
+		}
+
+		cout << "compressed clip test : failures = " << failures << endl;
+		return failures == 0;
+	}
+
+	REGISTER_TEST_METHOD(CompressedClipTest, CompressedClipTest);
+
+	// Save -> Map and Save -> Deserialize keep every frame byte for byte
+	// a flipped payload byte, a bone count of another armature, a truncated file and an overflowing frame block size are rejected by both
+	bool ClipFileTest()
+	{
+		const char* fileName = "causality_clip_file_test.cclp";
+		const wstring path = L"causality_clip_file_test.cclp";
+		mt19937 rng(46);
+		const size_t boneCount = 13, frameCount = 37;
+
+		vector<int> parents(boneCount);
+		for (size_t b = 0; b < boneCount; b++)
+			parents[b] = (int)b - 1;
+		StaticArmature armature(boneCount, parents.data(), vector<const char*>(boneCount, "bone").data());
+
+		ArmatureFrameAnimation animation("clip file");
+		animation.SetArmature(armature);
+		animation.FrameInterval = time_seconds(1.0 / 30.0);
+		animation.Duration = time_seconds(frameCount / 30.0);
+		animation.GetFrameBuffer() = make_cyclic_clip(boneCount, frameCount, rng);
+		for (auto& frame : animation.GetFrameBuffer())
+			FrameRebuildGlobal(armature, frame);
+		auto& frames = animation.GetFrameBuffer();
+
+		if (!animation.Save(path))
+		{
+			cout << "clip file test : can not write " << fileName << endl;
+			return false;
+		}
+
+		int failures = 0;
+		auto same_frames = [&](const ArmatureFrameAnimation& copy)
+		{
+			if (copy.FrameCount() != frameCount || copy.FrameInterval != animation.FrameInterval || copy.Duration != animation.Duration)
+				return false;
+			for (size_t i = 0; i < frameCount; i++)
+			{
+				auto frame = copy.GetFrame(i);
+				if (frame.size() != boneCount || memcmp(frame.data(), frames[i].data(), boneCount * sizeof(Bone)) != 0)
+					return false;
+			}
+			return true;
+		};
+
+		{
+			ArmatureFrameAnimation mapped("mapped");
+			mapped.SetArmature(armature);
+			if (!mapped.Map(path) || !mapped.IsMapped() || !same_frames(mapped))
+				++failures;
+		}
+		{
+			ArmatureFrameAnimation loaded("loaded");
+			loaded.SetArmature(armature);
+			ifstream file(path, ios::binary);
+			if (!loaded.Deserialize(file) || loaded.IsMapped() || !same_frames(loaded))
+				++failures;
+		}
+
+		vector<char> bytes;
+		{
+			ifstream file(path, ios::binary);
+			bytes.assign(istreambuf_iterator<char>(file), istreambuf_iterator<char>());
+		}
+
+		// write a corrupted copy of the saved file over it, true if both Map and Deserialize reject it
+		auto rejects = [&](const function<void(vector<char>&)>& corrupt)
+		{
+			auto corrupted = bytes;
+			corrupt(corrupted);
+			{
+				ofstream file(path, ios::binary | ios::trunc);
+				if (!file.write(corrupted.data(), corrupted.size()))
+					return false;
+			}
+			ArmatureFrameAnimation mapped("mapped"), loaded("loaded");
+			mapped.SetArmature(armature);
+			loaded.SetArmature(armature);
+			ifstream file(path, ios::binary);
+			return !mapped.Map(path) && !loaded.Deserialize(file);
+		};
+		auto header = [](vector<char>& data) { return reinterpret_cast<ClipFile::Header*>(data.data()); };
+
+		// the unmodified copy is still accepted
+		if (rejects([](vector<char>&) {}))
+			++failures;
+		if (!rejects([&](vector<char>& data) { data[header(data)->framesOffset + 5 * sizeof(Bone) + 3] ^= 0x10; }))
+			++failures;
+		// still a valid clip, of a smaller armature
+		if (!rejects([&](vector<char>& data) { header(data)->boneCount -= 1; }))
+			++failures;
+		if (!rejects([&](vector<char>& data) { data.resize(data.size() - ClipFile::BlockAlignment); }))
+			++failures;
+		// frameCount * frameStride wraps around to the saved file size
+		if (!rejects([&](vector<char>& data) {
+			auto h = header(data);
+			uint64_t wrap = 1;
+			while ((h->frameStride * wrap) != 0)
+				wrap <<= 1;
+			h->frameCount += wrap; }))
+			++failures;
+
+		remove(fileName);
+		cout << "clip file test : failures = " << failures << endl;
+		return failures == 0;
+	}
+
+	REGISTER_TEST_METHOD(ClipFileTest, ClipFileTest);
+
+	// AnimationCursor over uniform frames and over non-uniform keys against fmod playback, in every mode
+	// with steps across the end, steps longer than the clip and negative steps
+	bool AnimationCursorTest()
+	{
+		mt19937 rng(47);
+		uniform_real_distribution<double> unit(.0, 1.0);
+
+		const size_t frames = 11;
+		const double interval = 1.0 / 30.0;
+		vector<double> frameValues(frames);
+		for (auto& v : frameValues)
+			v = unit(rng);
+
+		// keys from 0.25 s, the last key repeats the first value so the looped track is continuous
+		vector<TimeScalarType> keyTimes;
+		for (double t : { 0.25, 0.3, 0.55, 0.6, 1.1, 1.15, 1.8 })
+			keyTimes.push_back(time_seconds(t));
+		vector<double> keyValues(keyTimes.size());
+		for (auto& v : keyValues)
+			v = unit(rng);
+		keyValues.back() = keyValues.front();
+
+		auto make_deltas = [&](double length)
+		{
+			vector<double> deltas;
+			for (int i = 0; i < 400; i++)
+			{
+				if (i % 23 == 22)
+					deltas.push_back((i % 2 ? -2.6 : 3.3) * length);
+				else if (i % 40 < 12)
+					deltas.push_back(-0.09 * length * unit(rng));
+				else
+					deltas.push_back(0.07 * length * unit(rng));
+			}
+			return deltas;
+		};
+
+		int failures = 0;
+		double maxError = .0;
+		for (auto mode : { PlaybackMode::Loop, PlaybackMode::Clamp, PlaybackMode::PingPong })
+		{
+			// only Loop plays the segment from the last frame back to the first
+			size_t segments = mode == PlaybackMode::Loop ? frames : frames - 1;
+			vector<double> times, values;
+			for (size_t i = 0; i <= segments; i++)
+			{
+				times.push_back(i * interval);
+				values.push_back(frameValues[i % frames]);
+			}
+			failures += check_playback(AnimationCursor(frames, time_seconds(interval), mode), times, values, make_deltas(times.back()), maxError);
+
+			times.clear();
+			for (auto& key : keyTimes)
+				times.push_back(key.count() - keyTimes.front().count());
+			AnimationCursor keyCursor(keyTimes.data(), keyTimes.size(), sizeof(TimeScalarType), mode);
+			failures += check_playback(keyCursor, times, keyValues, make_deltas(times.back()), maxError);
+		}
+
+		// a clamped uniform clip ends on its last frame
+		AnimationCursor clamped(frames, time_seconds(interval), PlaybackMode::Clamp);
+		clamped.Advance(time_seconds(2 * frames * interval));
+		if (!clamped.Finished() || clamped.Key1() != frames - 1 || fabs(cursor_value(clamped, frameValues) - frameValues.back()) > 1e-6)
+			++failures;
+
+		// switching to Loop adds the segment back to the first frame, switching back removes it
+		clamped.SetMode(PlaybackMode::Loop);
+		clamped.Advance(time_seconds(0.5 * interval));
+		if (fabs(clamped.Length().count() - frames * interval) > 1e-12 || clamped.Key0() != frames - 1 || clamped.Key1() != 0)
+			++failures;
+		clamped.SetMode(PlaybackMode::Clamp);
+		if (fabs(clamped.Length().count() - (frames - 1) * interval) > 1e-12 || !clamped.Finished() || clamped.Key1() != frames - 1)
+			++failures;
+
+		cout << "animation cursor test : max error = " << maxError << ", failures = " << failures << endl;
+		return failures == 0;
+	}
+
+	REGISTER_TEST_METHOD(AnimationCursorTest, AnimationCursorTest);
+}
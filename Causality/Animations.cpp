@@ -1,5 +1,7 @@
 #include "pch_bcl.h"
 #include "Animations.h"
+#include <fstream>
+#include <limits>
 
 using namespace Causality;
 using namespace DirectX;
@@ -7,6 +9,174 @@ using namespace std;
 
 size_t Causality::CLIP_FRAME_COUNT = 90U;
 
+AnimationCursor::AnimationCursor()
+	: m_keyTimes(nullptr), m_keyStride(0), m_keys(0), m_interval(0),
+	m_begin(0), m_length(0), m_position(0), m_segment(0), m_direction(1), m_mode(PlaybackMode::Loop)
+{
+}
+
+AnimationCursor::AnimationCursor(size_t frames, TimeScalarType frameInterval, PlaybackMode mode)
+	: m_keyTimes(nullptr), m_keyStride(0), m_keys(frames), m_interval(frameInterval.count()),
+	m_begin(0), m_length(0), m_position(0), m_segment(0), m_direction(1), m_mode(mode)
+{
+	m_length = segments() * m_interval;
+}
+
+AnimationCursor::AnimationCursor(const TimeScalarType * keyTimes, size_t count, size_t stride, PlaybackMode mode)
+	: m_keyTimes(reinterpret_cast<const char*>(keyTimes)), m_keyStride(stride), m_keys(count), m_interval(0),
+	m_begin(0), m_length(0), m_position(0), m_segment(0), m_direction(1), m_mode(mode)
+{
+	if (count > 0)
+	{
+		m_begin = m_position = key_time(0);
+		m_length = key_time(count - 1) - m_begin;
+	}
+}
+
+void AnimationCursor::SetMode(PlaybackMode mode)
+{
+	m_mode = mode;
+	if (m_keyTimes)
+		return;
+
+	// the uniform clip gains or loses the segment from the last frame back to the first
+	m_length = segments() * m_interval;
+	m_position = std::min(m_position, m_begin + m_length);
+	locate();
+}
+
+void AnimationCursor::Seek(TimeScalarType time)
+{
+	m_position = m_begin;
+	m_segment = 0;
+	m_direction = 1;
+	Advance(time);
+}
+
+void AnimationCursor::Advance(TimeScalarType delta)
+{
+	if (m_length <= 0)
+	{
+		m_position = m_begin;
+		m_segment = 0;
+		return;
+	}
+
+	double end = m_begin + m_length;
+	double step = delta.count();
+	switch (m_mode)
+	{
+	case PlaybackMode::Clamp:
+		m_position = std::min(std::max(m_position + m_direction * step, m_begin), end);
+		break;
+	case PlaybackMode::Loop:
+		m_position += m_direction * step;
+		if (m_position >= end)
+		{
+			m_position -= m_length;
+			m_segment = 0;
+		}
+		else if (m_position < m_begin)
+		{
+			m_position += m_length;
+			m_segment = segments() - 1;
+		}
+		// only steps longer than the clip get here
+		if (m_position >= end || m_position < m_begin)
+		{
+			double offset = m_position - m_begin;
+			m_position = m_begin + offset - std::floor(offset / m_length) * m_length;
+			if (m_position >= end)
+				m_position = m_begin;
+		}
+		break;
+	case PlaybackMode::PingPong:
+	{
+		// phase along one forward and backward pass, [0, length] forward, (length, 2 length) backward
+		double period = 2 * m_length;
+		double phase = m_position - m_begin;
+		if (m_direction < 0)
+			phase = period - phase;
+		phase += step;
+		if (phase >= period)
+			phase -= period;
+		else if (phase < 0)
+			phase += period;
+		if (phase >= period || phase < 0)
+			phase -= std::floor(phase / period) * period;
+
+		if (phase <= m_length)
+		{
+			m_position = m_begin + phase;
+			m_direction = 1;
+		}
+		else
+		{
+			m_position = m_begin + period - phase;
+			m_direction = -1;
+		}
+		break;
+	}
+	}
+
+	locate();
+}
+
+bool AnimationCursor::Finished() const
+{
+	return m_mode == PlaybackMode::Clamp &&
+		(m_direction > 0 ? m_position >= m_begin + m_length : m_position <= m_begin);
+}
+
+size_t AnimationCursor::Key1() const
+{
+	if (m_keys == 0)
+		return 0;
+	return m_keyTimes ? std::min(m_segment + 1, m_keys - 1) : (m_segment + 1) % m_keys;
+}
+
+float AnimationCursor::Fraction() const
+{
+	if (segments() == 0 || m_length <= 0)
+		return .0f;
+
+	double t0, t1;
+	if (m_keyTimes)
+	{
+		t0 = key_time(m_segment);
+		t1 = key_time(m_segment + 1);
+	}
+	else
+	{
+		t0 = m_begin + m_segment * m_interval;
+		t1 = t0 + m_interval;
+	}
+	return t1 > t0 ? std::min(std::max(static_cast<float>((m_position - t0) / (t1 - t0)), .0f), 1.0f) : .0f;
+}
+
+void AnimationCursor::locate()
+{
+	size_t n = segments();
+	if (n == 0 || m_length <= 0)
+	{
+		m_segment = 0;
+		return;
+	}
+
+	if (!m_keyTimes)
+	{
+		m_segment = std::min(static_cast<size_t>((m_position - m_begin) / m_interval), n - 1);
+		return;
+	}
+
+	// sequential playback moves at most a few keys per step
+	m_segment = std::min(m_segment, n - 1);
+	while (m_segment + 1 < n && m_position >= key_time(m_segment + 1))
+		++m_segment;
+	while (m_segment > 0 && m_position < key_time(m_segment))
+		--m_segment;
+}
+
 ArmatureFrameAnimation::ArmatureFrameAnimation(std::istream & file)
 {
 	using namespace std;
@@ -49,7 +219,7 @@ bool ArmatureFrameAnimation::InterpolateFrames(double frameRate)
 	float t = 0;
 
 	auto itrKey = KeyFrames.begin();
-	auto itrKeyAdv = ++KeyFrames.begin();
+	auto itrKeyAdv = std::next(KeyFrames.begin());
 
 	for (size_t i = 1; i < KeyFrames.size(); i++)
 	{
@@ -67,15 +237,72 @@ bool ArmatureFrameAnimation::InterpolateFrames(double frameRate)
 	return true;
 }
 
+size_t ArmatureFrameAnimation::Compress(const AnimationCompressionOptions & options)
+{
+	if (mapped)
+	{
+		frames.resize(mapped->frames());
+		for (size_t i = 0; i < frames.size(); i++)
+			frames[i] = mapped->frame(i);
+		mapped.reset();
+	}
+
+	if (frames.empty())
+		return compressed.byte_size();
+	compressed.Compress(frames, options);
+	frames.clear();
+	frames.shrink_to_fit();
+	return compressed.byte_size();
+}
+
+bool ArmatureFrameAnimation::Map(const std::wstring & path, bool verifyChecksum)
+{
+	auto clip = std::make_shared<MappedArmatureClip>();
+	if (!clip->open(path, verifyChecksum))
+		return false;
+	// frames are read as views of Armature().size() bones
+	if (!pArmature || clip->bones() != pArmature->size())
+		return false;
+
+	Duration = time_seconds(clip->duration());
+	FrameInterval = time_seconds(clip->frame_interval());
+	frames.clear();
+	frames.shrink_to_fit();
+	compressed.Clear();
+	mapped = std::move(clip);
+	return true;
+}
+
+bool ArmatureFrameAnimation::Save(const std::wstring & path) const
+{
+	std::ofstream file(path, std::ios::binary | std::ios::trunc);
+	if (!file)
+		return false;
+	Serialize(file);
+	return file.good();
+}
+
 bool ArmatureFrameAnimation::GetFrameAt(frame_view outFrame, TimeScalarType time, bool rebuild) const
 {
 
 	double t = fmod(time.count(), Duration.count());
 	if (t < 0) t += Duration.count();
+
+	if (!compressed.empty())
+	{
+		compressed.Sample(outFrame, t / FrameInterval.count());
+		if (rebuild)
+			FrameRebuildGlobal(Armature(), outFrame);
+		return true;
+	}
+
+	size_t frameCount = FrameCount();
+	if (frameCount == 0)
+		return false;
 	int frameIdx = (int)floorf(t / FrameInterval.count());
-	frameIdx = frameIdx % frames.size(); // ensure the index is none negative
-	auto& sframe = frames[frameIdx];
-	auto& tframe = frames[(frameIdx + 1) % frames.size()];
+	frameIdx = frameIdx % frameCount; // ensure the index is none negative
+	auto sframe = GetFrame(frameIdx);
+	auto tframe = GetFrame((frameIdx + 1) % frameCount);
 	t -= frameIdx * FrameInterval.count();
 	t /= FrameInterval.count();
 
@@ -83,39 +310,107 @@ bool ArmatureFrameAnimation::GetFrameAt(frame_view outFrame, TimeScalarType time
 	return true;
 }
 
-void ArmatureFrameAnimation::Serialize(std::ostream & binary) const
+void ArmatureFrameAnimation::GetFrame(size_t index, frame_view outFrame, bool rebuild) const
 {
-	binary << (uint32_t)bonesCount << (uint32_t)frames.size() << (uint32_t)sizeof(Bone);
-	binary << (double)Duration.count() << (double)FrameInterval.count();
-	for (auto& frame : frames)
+	assert(index < FrameCount() && outFrame.size() >= Armature().size());
+	if (!compressed.empty())
 	{
-		binary.write(reinterpret_cast<const char*>(frame.data()),
-			sizeof(Bone)*bonesCount);
+		compressed.Sample(outFrame, (double)index);
+		if (rebuild)
+			FrameRebuildGlobal(Armature(), outFrame);
+		return;
 	}
+
+	auto frame = GetFrame(index);
+	std::copy(frame.begin(), frame.end(), outFrame.begin());
 }
 
-void ArmatureFrameAnimation::Deserialize(std::istream & binary)
+AnimationCursor ArmatureFrameAnimation::CreateCursor(PlaybackMode mode) const
 {
-	uint32_t bC, fC, sB;
-	double dur, itv;
-	binary >> bC >> fC >> sB >> dur >> itv;
+	return AnimationCursor(FrameCount(), FrameInterval, mode);
+}
+
+bool ArmatureFrameAnimation::GetFrameAt(frame_view outFrame, const AnimationCursor & cursor, bool rebuild) const
+{
+	if (!compressed.empty())
+	{
+		compressed.Sample(outFrame, cursor.Key0() + cursor.Fraction());
+		if (rebuild)
+			FrameRebuildGlobal(Armature(), outFrame);
+		return true;
+	}
 
-	Duration = time_seconds(dur);
-	FrameInterval = time_seconds(itv);
+	if (FrameCount() == 0)
+		return false;
+	FrameLerpEst(outFrame, GetFrame(cursor.Key0()), GetFrame(cursor.Key1()), cursor.Fraction(), Armature(), rebuild);
+	return true;
+}
 
-	assert((int)(dur / itv) == fC);
-	assert(sB == sizeof(Bone));
+bool ArmatureFrameAnimation::GetKeyFrameAt(frame_view outFrame, const AnimationCursor & cursor, bool rebuild) const
+{
+	if (KeyFrames.empty())
+		return false;
+	FrameLerp(outFrame, KeyFrames[cursor.Key0()].Frame, KeyFrames[cursor.Key1()].Frame, cursor.Fraction(), Armature(), rebuild);
+	return true;
+}
 
-	time_seconds time(0);
-	frames.resize(fC);
-	for (auto& frame : frames)
+void ArmatureFrameAnimation::Serialize(std::ostream & binary) const
+{
+	if (!mapped && compressed.empty())
 	{
-		time += FrameInterval;
+		ClipFile::write(binary, frames, Duration.count(), FrameInterval.count());
+		return;
+	}
+
+	// mapped frames are copied, compressed ones decoded with their global data
+	std::vector<frame_type> copy(FrameCount(), frame_type(Armature().size()));
+	for (size_t i = 0; i < copy.size(); i++)
+		GetFrame(i, copy[i]);
+	ClipFile::write(binary, copy, Duration.count(), FrameInterval.count());
+}
 
-		frame.resize(bC);
-		binary.read(reinterpret_cast<char*>(frame.data()),
-			sizeof(Bone)*bonesCount);
+bool ArmatureFrameAnimation::Deserialize(std::istream & binary)
+{
+	using namespace ClipFile;
+	Header header;
+	if (!binary.read(reinterpret_cast<char*>(&header), sizeof(Header))
+		|| !validate(header, header.fileSize)
+		|| !pArmature || header.boneCount != pArmature->size()
+		|| !binary.ignore(header.framesOffset - sizeof(Header)))
+		return false;
+
+	// the block buffer is sized from the header, check it against the stream before allocating
+	uint64_t blockSize = header.fileSize - header.framesOffset;
+	if (blockSize > std::numeric_limits<size_t>::max())
+		return false;
+	auto position = binary.tellg();
+	if (position != std::istream::pos_type(-1) && binary.seekg(0, std::ios::end))
+	{
+		auto end = binary.tellg();
+		binary.seekg(position);
+		if (end != std::istream::pos_type(-1) && uint64_t(end - position) < blockSize)
+			return false;
 	}
+	binary.clear();
+
+	std::vector<uint8_t> blocks(static_cast<size_t>(blockSize));
+	if (!binary.read(reinterpret_cast<char*>(blocks.data()), blocks.size())
+		|| checksum(blocks.data(), blocks.size()) != header.checksum)
+		return false;
+
+	Duration = time_seconds(header.duration);
+	FrameInterval = time_seconds(header.frameInterval);
+	mapped.reset();
+	compressed.Clear();
+
+	frames.resize(static_cast<size_t>(header.frameCount));
+	for (size_t i = 0; i < frames.size(); i++)
+	{
+		// the read buffer has no Bone alignment, copy bytes
+		frames[i].resize(header.boneCount);
+		memcpy(frames[i].data(), blocks.data() + i * header.frameStride, header.boneCount * sizeof(Bone));
+	}
+	return true;
 }
 
 ArmatureTransform::ArmatureTransform() {
@@ -1,6 +1,9 @@
 #pragma once
 #include "Armature.h"
+#include "CompressedAnimation.h"
+#include "ArmatureClipFile.h"
 #include <vector>
+#include <memory>
 #include <chrono>
 
 namespace Causality
@@ -28,6 +31,72 @@ namespace Causality
 		//concept frame_type& operator[]
 	};
 
+	enum class PlaybackMode
+	{
+		Clamp,		// stop at the end (or the begin when playing backward)
+		Loop,		// jump back to the begin
+		PingPong,	// reverse the direction at both ends
+	};
+
+	// Stateful playback position of a clip, advanced by delta time
+	// The current segment is remembered, so sequential playback finds its segment in O(1) amortized, without fmod or searching
+	// Segments are either uniform (a frame buffer, the last frame interpolates back to the first one)
+	// or bounded by ascending non-uniform key times (the last key ends the clip)
+	class AnimationCursor
+	{
+	public:
+		AnimationCursor();
+		// uniform segments of frameInterval, segment i interpolates frame i to frame (i + 1) % frames
+		// only Loop has the segment from the last frame back to the first, Clamp and PingPong end on the last frame
+		AnimationCursor(size_t frames, TimeScalarType frameInterval, PlaybackMode mode = PlaybackMode::Loop);
+		// segments between the Time of consecutive keys, the keys are not copied and must outlive the cursor
+		template <typename Ty>
+		explicit AnimationCursor(const std::vector<KeyFrame<Ty>>& keys, PlaybackMode mode = PlaybackMode::Loop)
+			: AnimationCursor(keys.empty() ? nullptr : &keys[0].Time, keys.size(), sizeof(KeyFrame<Ty>), mode)
+		{}
+		// segments between count key times, stride bytes apart
+		AnimationCursor(const TimeScalarType* keyTimes, size_t count, size_t stride, PlaybackMode mode = PlaybackMode::Loop);
+
+		// jump to a clip time, wrapped or clamped by the mode, this searches the segment once
+		void Seek(TimeScalarType time);
+		// move by delta time along the current direction
+		void Advance(TimeScalarType delta);
+
+		// clip time in [0, Length()]
+		TimeScalarType	Time() const { return TimeScalarType(m_position - m_begin); }
+		TimeScalarType	Length() const { return TimeScalarType(m_length); }
+		PlaybackMode	Mode() const { return m_mode; }
+		void			SetMode(PlaybackMode mode);
+		// -1 while playing backward
+		int				Direction() const { return m_direction; }
+		// a clamped cursor that reached its end
+		bool			Finished() const;
+
+		// the current segment interpolates Key0() to Key1() by Fraction()
+		size_t			Key0() const { return m_segment; }
+		size_t			Key1() const;
+		float			Fraction() const;
+
+	private:
+		double	key_time(size_t key) const { return reinterpret_cast<const TimeScalarType*>(m_keyTimes + key * m_keyStride)->count(); }
+		size_t	segments() const { return m_keyTimes ? m_keys - 1 : m_mode == PlaybackMode::Loop || m_keys == 0 ? m_keys : m_keys - 1; }
+		void	locate();
+
+		// uniform segments when null
+		const char*		m_keyTimes;
+		size_t			m_keyStride;
+		// key times or frames
+		size_t			m_keys;
+		double			m_interval;
+
+		double			m_begin;
+		double			m_length;
+		double			m_position;
+		size_t			m_segment;
+		int				m_direction;
+		PlaybackMode	m_mode;
+	};
+
 	class LinearFrame
 	{};
 	class SpineFrame
@@ -62,7 +131,8 @@ namespace Causality
 
 		string								Name;
 		FrameType							DefaultFrame;
-		std::list<KeyFrame<FrameType>>		KeyFrames;
+		// contiguous and sorted by Time, so AnimationCursor can walk the key times directly
+		std::vector<KeyFrame<FrameType>>	KeyFrames;
 		TimeScalarType						Duration;
 		TimeScalarType						FrameInterval;
 		bool								IsCyclic;
@@ -121,6 +191,8 @@ namespace Causality
 
 		void resize(size_t joints, size_t frames)
 		{
+			m_bones = joints;
+			m_frames = frames;
 			m_buffer.resize(joints*frames);
 		}
 	
@@ -137,6 +209,7 @@ namespace Causality
 		{
 			assert(frame.size() == m_bones);
 			m_buffer.insert(m_buffer.end(), frame.begin(), frame.end());
+			++m_frames;
 		}
 
 		Bone& bone(size_t frame, size_t bid) { return m_buffer[frame*m_bones + bid]; }
@@ -151,11 +224,21 @@ namespace Causality
 		inline ArmatureFrameView operator[](size_t frame) { return at(frame); }
 		inline ArmatureFrameConstView operator[](size_t frame) const { return at(frame); }
 
+		// all frames as one contiguous view, frame f is [f * bones(), (f + 1) * bones())
+		ArmatureFrameView buffer() { return m_buffer; }
+		ArmatureFrameConstView buffer() const { return m_buffer; }
+
 	private:
 		size_t m_bones, m_frames;
 		std::vector<Bone, DirectX::XMAllocator> m_buffer;
 	};
 
+	// Rebuild the global data of every frame in the buffer
+	inline void FrameRebuildGlobal(const IArmature& armature, ArmatureFrameBuffer& frames)
+	{
+		FrameRebuildGlobal(armature, frames.buffer(), frames.frames());
+	}
+
 	class ArmatureFrameAnimation : public KeyframeAnimation<ArmatureFrame, ArmatureFrameView>
 	{
 	public:
@@ -179,12 +262,40 @@ namespace Causality
 		const IArmature& Armature() const { return *pArmature; }
 		void SetArmature(const IArmature& armature);
 		// get the pre-computed frame buffer which contains interpolated frame
+		// the buffer is empty once the clip is compressed or mapped, read frames through FrameCount / GetFrame instead
 		const std::vector<frame_type>& GetFrameBuffer() const { return frames; }
 		std::vector<frame_type>& GetFrameBuffer() { return frames; }
 
+		// Replace the frame buffer by a compressed clip of its local data, GetFrameAt samples the compressed clip afterwards
+		// return the compressed size in bytes
+		size_t Compress(const AnimationCompressionOptions& options = AnimationCompressionOptions());
+		bool IsCompressed() const { return !compressed.empty(); }
+		const CompressedArmatureClip& GetCompressedClip() const { return compressed; }
+
+		// Replace the frame buffer by a memory mapped clip file, frames are read straight from the mapping
+		// Copies of this animation share the mapping, the clip must have as many bones as Armature()
+		bool Map(const std::wstring& path, bool verifyChecksum = true);
+		bool IsMapped() const { return mapped != nullptr; }
+		// Write the frame buffer (or the mapped frames) as a clip file, see ClipFile
+		bool Save(const std::wstring& path) const;
+
+		// frames of the frame buffer, the mapped or the compressed clip
+		size_t FrameCount() const { return mapped ? mapped->frames() : !compressed.empty() ? compressed.frames() : frames.size(); }
+		// view of a frame of the frame buffer or the mapped clip, not available for a compressed clip
+		ArmatureFrameConstView GetFrame(size_t index) const { assert(compressed.empty()); return mapped ? mapped->frame(index) : ArmatureFrameConstView(frames[index]); }
+		// copy frame index of any clip into outFrame, the global data of a compressed frame is only rebuilt if rebuild is set
+		void GetFrame(size_t index, frame_view outFrame, bool rebuild = true) const;
+
 		bool InterpolateFrames(double frameRate);
 		bool GetFrameAt(frame_view outFrame, TimeScalarType time, bool rebuild = true) const override;
 
+		// cursor over the frames of this animation (frame buffer, mapped or compressed clip)
+		AnimationCursor CreateCursor(PlaybackMode mode = PlaybackMode::Loop) const;
+		// sample the frames at a cursor from CreateCursor
+		bool GetFrameAt(frame_view outFrame, const AnimationCursor& cursor, bool rebuild = true) const;
+		// sample the key frames at a cursor over KeyFrames
+		bool GetKeyFrameAt(frame_view outFrame, const AnimationCursor& cursor, bool rebuild = true) const;
+
 		enum DataType
 		{
 			LocalRotation = 0,
@@ -199,13 +310,16 @@ namespace Causality
 		//	return Eigen::Map<Eigen::Matrix3Xf, Eigen::Aligned, Eigen::Stride<sizeof(float), sizeof(Bone)>>(&frames[0][0]);
 		//}
 
+		// clip file format, see ClipFile
 		void Serialize(std::ostream& binary) const;
-		void Deserialize(std::istream& binary);
+		// copy a clip file into the frame buffer, returns false if the stream does not hold a valid clip of Armature()
+		bool Deserialize(std::istream& binary);
 
 	private:
 		const IArmature*			pArmature;
-		size_t						bonesCount;
 		std::vector<frame_type>		frames;
+		CompressedArmatureClip		compressed;
+		std::shared_ptr<const MappedArmatureClip>	mapped;
 	//public:
 	//	Eigen::MatrixXf		animMatrix; // 20N x F matrix
 	//	Eigen::RowVectorXf  Ecj;	// Jointwise Energy
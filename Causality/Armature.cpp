@@ -1,7 +1,10 @@
 ﻿#include "pch_bcl.h"
 #include "Armature.h"
 #include "Animations.h"
+#include "FrameLanes.h"
 #include <regex>
+#include <climits>
+#include <ppl.h>
 //#include <boost\assign.hpp>
 #include <iostream>
 
@@ -174,19 +177,237 @@ ArmatureFrame& ArmatureFrame::operator=(const ArmatureFrameConstView &frameView)
 }
 
 
+namespace
+{
+	// Bone layout in floats, the lane kernels gather bones straight from AoS frames
+	const int BoneStride = sizeof(Bone) / sizeof(float);
+	const int LclRotationOffset = offsetof(Bone, LclRotation) / sizeof(float);
+	const int LclTranslationOffset = offsetof(Bone, LclTranslation) / sizeof(float);
+	const int LclScalingOffset = offsetof(Bone, LclScaling) / sizeof(float);
+	const int LclLengthOffset = offsetof(Bone, LclLength) / sizeof(float);
+	const int GblRotationOffset = offsetof(Bone, GblRotation) / sizeof(float);
+	const int GblTranslationOffset = offsetof(Bone, GblTranslation) / sizeof(float);
+	const int GblScalingOffset = offsetof(Bone, GblScaling) / sizeof(float);
+	const int GblLengthOffset = offsetof(Bone, GblLength) / sizeof(float);
+	const SkinningBoneLayout SkinningLayout = { BoneStride, GblRotationOffset, GblTranslationOffset, GblScalingOffset };
+
+	inline size_t SkinningPaletteSize(ArmatureFrameConstView from, ArmatureFrameConstView to, size_t numOut)
+	{
+		size_t n = std::min(from.size(), to.size());
+		return numOut > 0 ? std::min(n, numOut) : n;
+	}
+
+	// frames per task of the batch FK
+	const size_t RebuildGrainSize = 64;
+
+	inline void RebuildRootGlobal(Bone& bone)
+	{
+		bone.GblRotation = bone.LclRotation;
+		bone.GblScaling = bone.LclScaling;
+		bone.GblTranslation = bone.LclTranslation;
+		bone.LclLength = bone.GblLength = 1.0f; // Length of root doesnot have any meaning
+	}
+
+	inline void RebuildRootLocal(Bone& bone)
+	{
+		bone.LclRotation = bone.GblRotation;
+		bone.LclScaling = bone.GblScaling;
+		bone.LclTranslation = bone.GblTranslation;
+		bone.LclLength = bone.GblLength = 1.0f; // Length of root doesnot have any meaning
+	}
+
+	// Bone::UpdateGlobalData of L::width bones, lane k updates the bone at base + bones[k] from the one at base + parents[k] (offsets in floats)
+	template <class L>
+	inline void UpdateGlobalDataLanes(float* base, const int* bones, const int* parents)
+	{
+		typedef typename L::type V;
+		auto local = [=](int offset) { return L::gather(base + offset, bones); };
+		auto parent = [=](int offset) { return L::gather(base + offset, parents); };
+
+		V qx = local(LclRotationOffset), qy = local(LclRotationOffset + 1), qz = local(LclRotationOffset + 2), qw = local(LclRotationOffset + 3);
+		V px = parent(GblRotationOffset), py = parent(GblRotationOffset + 1), pz = parent(GblRotationOffset + 2), pw = parent(GblRotationOffset + 3);
+
+		// XMQuaternionMultiply(LclRotation, ParQ)
+		L::scatter(base + GblRotationOffset, bones, L::nmadd(pz, qy, L::madd(py, qz, L::madd(px, qw, L::mul(pw, qx)))));
+		L::scatter(base + GblRotationOffset + 1, bones, L::madd(pz, qx, L::madd(py, qw, L::nmadd(px, qz, L::mul(pw, qy)))));
+		L::scatter(base + GblRotationOffset + 2, bones, L::madd(pz, qw, L::nmadd(py, qx, L::madd(px, qy, L::mul(pw, qz)))));
+		L::scatter(base + GblRotationOffset + 3, bones, L::nmadd(pz, qz, L::nmadd(py, qy, L::nmadd(px, qx, L::mul(pw, qw)))));
+
+		V sx = parent(GblScalingOffset), sy = parent(GblScalingOffset + 1), sz = parent(GblScalingOffset + 2);
+		L::scatter(base + GblScalingOffset, bones, L::mul(sx, local(LclScalingOffset)));
+		L::scatter(base + GblScalingOffset + 1, bones, L::mul(sy, local(LclScalingOffset + 1)));
+		L::scatter(base + GblScalingOffset + 2, bones, L::mul(sz, local(LclScalingOffset + 2)));
+
+		V vx = local(LclTranslationOffset), vy = local(LclTranslationOffset + 1), vz = local(LclTranslationOffset + 2);
+		L::scatter(base + LclLengthOffset, bones, L::sqrt(L::madd(vz, vz, L::madd(vy, vy, L::mul(vx, vx)))));
+
+		vx = L::mul(vx, sx);
+		vy = L::mul(vy, sy);
+		vz = L::mul(vz, sz);
+		L::scatter(base + GblLengthOffset, bones, L::sqrt(L::madd(vz, vz, L::madd(vy, vy, L::mul(vx, vx)))));
+
+		// XMVector3Rotate(V, ParQ) = V + w * t + u x t, with t = 2 * (u x V)
+		V two = L::set1(2.0f);
+		V tx = L::mul(two, L::nmadd(pz, vy, L::mul(py, vz)));
+		V ty = L::mul(two, L::nmadd(px, vz, L::mul(pz, vx)));
+		V tz = L::mul(two, L::nmadd(py, vx, L::mul(px, vy)));
+		vx = L::add(L::madd(pw, tx, vx), L::nmadd(pz, ty, L::mul(py, tz)));
+		vy = L::add(L::madd(pw, ty, vy), L::nmadd(px, tz, L::mul(pz, tx)));
+		vz = L::add(L::madd(pw, tz, vz), L::nmadd(py, tx, L::mul(px, ty)));
+
+		L::scatter(base + GblTranslationOffset, bones, L::add(vx, parent(GblTranslationOffset)));
+		L::scatter(base + GblTranslationOffset + 1, bones, L::add(vy, parent(GblTranslationOffset + 1)));
+		L::scatter(base + GblTranslationOffset + 2, bones, L::add(vz, parent(GblTranslationOffset + 2)));
+	}
+
+	// FK of one frame level by level, levels at least half a lane wide run in lanes, the narrow ones bone by bone
+	// With a dirty mask only the dirty bones and their descendants are updated, and the mask is expanded to them
+	// returns the number of updated bones
+	size_t RebuildGlobalFlat(const ArmatureTopology& topology, Bone* frame, BoneDirtyMask* dirty)
+	{
+		typedef Internal::FrameLanes L;
+		float* base = reinterpret_cast<float*>(frame);
+		std::vector<int> level;
+		level.reserve(topology.order.size());
+		size_t count = 0;
+
+		for (size_t d = 0; d < topology.depth(); d++)
+		{
+			level.clear();
+			for (int k = topology.levels[d]; k < topology.levels[d + 1]; k++)
+			{
+				if (dirty)
+				{
+					int id = topology.order[k], parent = topology.parents[k];
+					if (!dirty->test(id) && (parent < 0 || !dirty->test(parent)))
+						continue;
+					dirty->set(id);
+				}
+				level.push_back(k);
+			}
+
+			int n = static_cast<int>(level.size());
+			count += n;
+			if (d > 0 && L::width > 1 && n >= int(L::width / 2))
+			{
+				for (int k = 0; k < n; k += L::width)
+				{
+					// the last chunk repeats the last bone of the level
+					int bones[L::width], parents[L::width];
+					for (int j = 0; j < int(L::width); j++)
+					{
+						int i = level[std::min(k + j, n - 1)];
+						bones[j] = topology.order[i] * BoneStride;
+						parents[j] = topology.parents[i] * BoneStride;
+					}
+					UpdateGlobalDataLanes<L>(base, bones, parents);
+				}
+				continue;
+			}
+
+			for (int k : level)
+			{
+				int parent = topology.parents[k];
+				if (parent < 0)
+					RebuildRootGlobal(frame[topology.order[k]]);
+				else
+					frame[topology.order[k]].UpdateGlobalData(frame[parent]);
+			}
+		}
+		return count;
+	}
+
+	// FK of frames [first, last) of a contiguous buffer, lane k works on its own frame
+	void RebuildGlobalFrames(const ArmatureTopology& topology, Bone* buffer, size_t boneCount, size_t first, size_t last)
+	{
+		typedef Internal::FrameLanes L;
+		float* base = reinterpret_cast<float*>(buffer);
+		for (size_t f = first; f < last; f += L::width)
+		{
+			int frameOffsets[L::width];
+			for (size_t j = 0; j < L::width; j++)
+				frameOffsets[j] = static_cast<int>(std::min(f + j, last - 1) * boneCount * BoneStride);
+
+			for (size_t k = 0; k < topology.order.size(); k++)
+			{
+				int id = topology.order[k], parent = topology.parents[k];
+				if (parent < 0)
+				{
+					for (size_t g = f; g < std::min(f + L::width, last); g++)
+						RebuildRootGlobal(buffer[g * boneCount + id]);
+					continue;
+				}
+
+				int bones[L::width], parents[L::width];
+				for (size_t j = 0; j < L::width; j++)
+				{
+					bones[j] = frameOffsets[j] + id * BoneStride;
+					parents[j] = frameOffsets[j] + parent * BoneStride;
+				}
+				UpdateGlobalDataLanes<L>(base, bones, parents);
+			}
+		}
+	}
+}
+
+void ArmatureTopology::build(const IArmature & armature)
+{
+	order.clear();
+	parents.clear();
+	levels.clear();
+	if (armature.root() == nullptr)
+		return;
+
+	std::vector<int> dfs, depth(armature.size(), 0), parentOf(armature.size(), -1);
+	int maxDepth = 0;
+	for (auto& joint : armature.joints())
+	{
+		auto parent = joint.parent();
+		if (parent)
+		{
+			parentOf[joint.ID] = parent->ID;
+			depth[joint.ID] = depth[parent->ID] + 1;
+			maxDepth = std::max(maxDepth, depth[joint.ID]);
+		}
+		dfs.push_back(joint.ID);
+	}
+
+	// stable counting sort of the DFS order by depth
+	levels.assign(maxDepth + 2, 0);
+	for (int id : dfs)
+		++levels[depth[id] + 1];
+	for (size_t d = 1; d < levels.size(); d++)
+		levels[d] += levels[d - 1];
+
+	order.resize(dfs.size());
+	parents.resize(dfs.size());
+	std::vector<int> cursor(levels.begin(), levels.end() - 1);
+	for (int id : dfs)
+	{
+		int k = cursor[depth[id]]++;
+		order[k] = id;
+		parents[k] = parentOf[id];
+	}
+}
+
 namespace Causality
 {
 	void FrameRebuildGlobal(const IArmature& armature, ArmatureFrameView frame)
 	{
+		auto topology = armature.topology();
+		if (topology)
+		{
+			assert(frame.size() >= topology->order.size());
+			RebuildGlobalFlat(*topology, frame.data(), nullptr);
+			return;
+		}
+
 		for (auto& joint : armature.joints())
 		{
 			auto& bone = frame[joint.ID];
 			if (joint.is_root())
 			{
-				bone.GblRotation = bone.LclRotation;
-				bone.GblScaling = bone.LclScaling;
-				bone.GblTranslation = bone.LclTranslation;
-				bone.LclLength = bone.GblLength = 1.0f; // Length of root doesnot have any meaning
+				RebuildRootGlobal(bone);
 			}
 			else
 			{
@@ -197,17 +418,77 @@ namespace Causality
 		}
 	}
 
+	size_t FrameRebuildGlobal(const IArmature& armature, ArmatureFrameView frame, BoneDirtyMask& dirty)
+	{
+		assert(dirty.size() >= armature.size());
+		auto topology = armature.topology();
+		if (topology)
+			return RebuildGlobalFlat(*topology, frame.data(), &dirty);
+
+		size_t count = 0;
+		for (auto& joint : armature.joints())
+		{
+			bool root = joint.is_root();
+			if (!dirty.test(joint.ID) && (root || !dirty.test(joint.ParentID)))
+				continue;
+			dirty.set(joint.ID);
+			++count;
+
+			auto& bone = frame[joint.ID];
+			if (root)
+				RebuildRootGlobal(bone);
+			else
+				bone.UpdateGlobalData(frame[joint.ParentID]);
+		}
+		return count;
+	}
+
+	void FrameRebuildGlobal(const IArmature& armature, ArmatureFrameView buffer, size_t frameCount)
+	{
+		ArmatureTopology temporary;
+		auto topology = armature.topology();
+		if (!topology)
+		{
+			temporary.build(armature);
+			topology = &temporary;
+		}
+
+		size_t boneCount = armature.size();
+		assert(buffer.size() >= boneCount * frameCount);
+		assert(boneCount * frameCount * BoneStride <= size_t(INT_MAX));
+
+		size_t tasks = (frameCount + RebuildGrainSize - 1) / RebuildGrainSize;
+		concurrency::parallel_for(size_t(0), tasks, [&](size_t task)
+		{
+			size_t first = task * RebuildGrainSize;
+			RebuildGlobalFrames(*topology, buffer.data(), boneCount, first, std::min(first + RebuildGrainSize, frameCount));
+		});
+	}
+
 	void FrameRebuildLocal(const IArmature& armature, ArmatureFrameView frame)
 	{
+		auto topology = armature.topology();
+		if (topology)
+		{
+			// local data only reads the global data of the parent, any order works
+			for (size_t k = 0; k < topology->order.size(); k++)
+			{
+				auto& bone = frame[topology->order[k]];
+				int parent = topology->parents[k];
+				if (parent < 0)
+					RebuildRootLocal(bone);
+				else
+					bone.UpdateLocalData(frame[parent]);
+			}
+			return;
+		}
+
 		for (auto& joint : armature.joints())
 		{
 			auto& bone = frame[joint.ID];
 			if (joint.is_root())
 			{
-				bone.LclRotation = bone.GblRotation;
-				bone.LclScaling = bone.GblScaling;
-				bone.LclTranslation = bone.GblTranslation;
-				bone.LclLength = bone.GblLength = 1.0f; // Length of root doesnot have any meaning
+				RebuildRootLocal(bone);
 			}
 			else
 			{
@@ -216,6 +497,21 @@ namespace Causality
 		}
 	}
 
+	void FrameMarkChanged(BoneDirtyMask& dirty, ArmatureFrameConstView before, ArmatureFrameConstView after)
+	{
+		auto n = std::min(before.size(), after.size());
+		assert(dirty.size() >= n);
+		for (size_t i = 0; i < n; i++)
+		{
+			auto& b0 = before[i];
+			auto& b1 = after[i];
+			if (!XMVector4Equal(XMLoadA(b0.LclRotation), XMLoadA(b1.LclRotation))
+				|| !XMVector3Equal(XMLoadA(b0.LclTranslation), XMLoadA(b1.LclTranslation))
+				|| !XMVector3Equal(XMLoadA(b0.LclScaling), XMLoadA(b1.LclScaling)))
+				dirty.set(i);
+		}
+	}
+
 	void FrameLerpEst(ArmatureFrameView out, ArmatureFrameConstView lhs, ArmatureFrameConstView rhs, float t, const IArmature& armature, bool rebuild)
 	{
 		//assert((Armature == lhs.pArmature) && (lhs.pArmature == rhs.pArmature));
@@ -305,7 +601,12 @@ namespace Causality
 
 	void FrameBlend(ArmatureFrameView out, ArmatureFrameConstView lhs, ArmatureFrameConstView rhs, float* blend_weights, const IArmature& armature)
 	{
-
+		for (size_t i = 0; i < armature.size(); i++)
+		{
+			XMVECTOR vt = XMVectorReplicate(blend_weights[i]);
+			IsometricTransform::LerpV(out[i].LocalTransform(), lhs[i].LocalTransform(), rhs[i].LocalTransform(), vt);
+		}
+		FrameRebuildGlobal(armature, out);
 	}
 
 	void FrameTransformMatrix(XMFLOAT3X4* pOut, ArmatureFrameConstView from, ArmatureFrameConstView to, size_t numOut)
@@ -335,6 +636,56 @@ namespace Causality
 			XMStoreFloat4x4(pOut + i, mat);
 		}
 	}
+
+	size_t FrameTransformMatrix(XMFLOAT3X4* pOut, ArmatureFrameConstView from, ArmatureFrameConstView to, const BoneDirtyMask& dirty, size_t numOut)
+	{
+		using namespace std;
+		size_t n = min(from.size(), to.size());
+		if (numOut > 0)
+			n = min(n, numOut);
+		n = min(n, dirty.size());
+		size_t count = 0;
+		for (size_t i = 0; i < n; ++i)
+		{
+			if (!dirty.test(i))
+				continue;
+			XMMATRIX mat = Bone::TransformMatrix(from[i], to[i]);
+			mat = XMMatrixTranspose(mat);
+			XMStoreFloat3x4(pOut + i, mat);
+			++count;
+		}
+		return count;
+	}
+
+	size_t FrameTransformMatrix(XMFLOAT4X4* pOut, ArmatureFrameConstView from, ArmatureFrameConstView to, const BoneDirtyMask& dirty, size_t numOut)
+	{
+		using namespace std;
+		size_t n = min(from.size(), to.size());
+		if (numOut > 0)
+			n = min(n, numOut);
+		n = min(n, dirty.size());
+		size_t count = 0;
+		for (size_t i = 0; i < n; ++i)
+		{
+			if (!dirty.test(i))
+				continue;
+			XMStoreFloat4x4(pOut + i, Bone::TransformMatrix(from[i], to[i]));
+			++count;
+		}
+		return count;
+	}
+
+	void FrameSkinningPalette(XMFLOAT3X4* pOut, ArmatureFrameConstView from, ArmatureFrameConstView to, size_t numOut)
+	{
+		BuildSkinningPalette(reinterpret_cast<SkinningMatrix*>(pOut), reinterpret_cast<const float*>(from.data()), reinterpret_cast<const float*>(to.data()),
+			SkinningPaletteSize(from, to, numOut), SkinningLayout);
+	}
+
+	void FrameSkinningPalette(BoneDualQuaternion* pOut, ArmatureFrameConstView from, ArmatureFrameConstView to, size_t numOut)
+	{
+		BuildSkinningPalette(reinterpret_cast<SkinningDualQuaternion*>(pOut), reinterpret_cast<const float*>(from.data()), reinterpret_cast<const float*>(to.data()),
+			SkinningPaletteSize(from, to, numOut), SkinningLayout);
+	}
 	Joint::Joint()
 	{
 		JointBasicData::ID = nullid;
@@ -494,6 +845,7 @@ StaticArmature::self_type & StaticArmature::operator=(self_type && rhs)
 	m_rootIdx = rhs.m_rootIdx;
 	m_joints = move(rhs.m_joints);
 	m_order = move(rhs.m_order);
+	m_topology = move(rhs.m_topology);
 	m_defaultFrame = move(rhs.m_defaultFrame);
 	return *this;
 }
@@ -540,6 +892,8 @@ void StaticArmature::clone_from(const IArmature & rhs)
 			m_joints[m_joints[i].ParentID].append_children_back(&m_joints[i]);
 		}
 	}
+
+	m_topology.build(*this);
 }
 
 //void GetBlendMatrices(_Out_ XMFLOAT4X4* pOut);
@@ -568,9 +922,11 @@ void StaticArmature::set_default_frame(frame_type && frame) { m_defaultFrame = s
 
 void StaticArmature::CaculateTopologyOrder()
 {
+	m_order.clear();
 	m_order.reserve(size());
 	for (auto& j : root()->nodes())
 		m_order.push_back(j.ID);
+	m_topology.build(*this);
 }
 
 // Lerp the local-rotation and scaling, "interpolate in Time"
@@ -1,6 +1,8 @@
 #pragma once
 #include <unordered_map>
+#include <algorithm>
 #include "Math3D.h"
+#include "SkinningPalette.h"
 #include "Common\tree.h"
 #include "String.h"
 #include <iosfwd>
@@ -161,8 +163,51 @@ namespace Causality
 
 	};
 
+	// One bit per bone, marks the bones whose local data changed since the last global rebuild
+	class BoneDirtyMask
+	{
+	public:
+		BoneDirtyMask() : m_size(0) {}
+		explicit BoneDirtyMask(size_t size) { resize(size); }
+
+		// resize and clear all bits
+		void resize(size_t size) { m_size = size; m_words.assign((size + 63) / 64, 0); }
+		size_t size() const { return m_size; }
+
+		bool test(size_t bone) const { return ((m_words[bone >> 6] >> (bone & 63)) & 1) != 0; }
+		void set(size_t bone) { m_words[bone >> 6] |= uint64_t(1) << (bone & 63); }
+		void set_all()
+		{
+			std::fill(m_words.begin(), m_words.end(), ~uint64_t(0));
+			if (m_size & 63)
+				m_words.back() = (uint64_t(1) << (m_size & 63)) - 1;
+		}
+		void reset() { std::fill(m_words.begin(), m_words.end(), uint64_t(0)); }
+		bool any() const { return std::any_of(m_words.begin(), m_words.end(), [](uint64_t w) { return w != 0; }); }
+
+		BoneDirtyMask& operator|=(const BoneDirtyMask& rhs)
+		{
+			assert(rhs.m_size == m_size);
+			for (size_t i = 0; i < m_words.size(); i++)
+				m_words[i] |= rhs.m_words[i];
+			return *this;
+		}
+
+	private:
+		std::vector<uint64_t>	m_words;
+		size_t					m_size;
+	};
+
 	void FrameRebuildGlobal(const IArmature& armature, ArmatureFrameView frame);
+	// Rebuild only the subtrees of the dirty bones, dirty is expanded to every bone that was recomputed
+	// returns the number of recomputed bones
+	size_t FrameRebuildGlobal(const IArmature& armature, ArmatureFrameView frame, BoneDirtyMask& dirty);
+	// Batch FK, buffer holds frameCount consecutive frames of armature.size() bones (e.g. an ArmatureFrameBuffer)
+	// Frames are rebuilt in parallel, 8 frames per step with AVX2
+	void FrameRebuildGlobal(const IArmature& armature, ArmatureFrameView buffer, size_t frameCount);
 	void FrameRebuildLocal(const IArmature& armature, ArmatureFrameView frame);
+	// Mark the bones whose local rotation, translation or scaling differ between the two frames
+	void FrameMarkChanged(BoneDirtyMask& dirty, ArmatureFrameConstView before, ArmatureFrameConstView after);
 
 	// Lerp the local-rotation and scaling, "interpolate in Time"
 	void FrameLerp(ArmatureFrameView out, ArmatureFrameConstView lhs, ArmatureFrameConstView rhs, float t, const IArmature& armature, bool rebuild = true);
@@ -178,6 +223,31 @@ namespace Causality
 
 	void FrameTransformMatrix(DirectX::XMFLOAT3X4* pOut, ArmatureFrameConstView from, ArmatureFrameConstView to, size_t numOut = 0);
 	void FrameTransformMatrix(DirectX::XMFLOAT4X4* pOut, ArmatureFrameConstView from, ArmatureFrameConstView to, size_t numOut = 0);
+	// Update only the matrices of the dirty bones, returns the number of updated matrices
+	size_t FrameTransformMatrix(DirectX::XMFLOAT3X4* pOut, ArmatureFrameConstView from, ArmatureFrameConstView to, const BoneDirtyMask& dirty, size_t numOut = 0);
+	size_t FrameTransformMatrix(DirectX::XMFLOAT4X4* pOut, ArmatureFrameConstView from, ArmatureFrameConstView to, const BoneDirtyMask& dirty, size_t numOut = 0);
+
+	// Dual quaternion skinning transform, the same as Bone::RigidTransformDualQuaternion, 32 bytes per bone in the palette
+	struct XM_ALIGNATTR BoneDualQuaternion
+	{
+		DirectX::XMFLOAT4A	Qr; // rotation
+		DirectX::XMFLOAT4A	Qe; // 0.5 * translation * Qr
+	};
+
+	// Skinning palette of all bones in one vectorized pass, 8 bones per step with AVX2
+	// The matrices equal FrameTransformMatrix, the dual quaternions Bone::RigidTransformDualQuaternion
+	// Entries are written with streaming stores when pOut is 16-byte aligned, so pOut may point straight into a mapped upload buffer
+	void FrameSkinningPalette(DirectX::XMFLOAT3X4* pOut, ArmatureFrameConstView from, ArmatureFrameConstView to, size_t numOut = 0);
+	void FrameSkinningPalette(BoneDualQuaternion* pOut, ArmatureFrameConstView from, ArmatureFrameConstView to, size_t numOut = 0);
+
+	// The portable palette types of SkinningPalette.h alias the renderer ones
+	static_assert(sizeof(SkinningMatrix) == sizeof(DirectX::XMFLOAT3X4), "SkinningMatrix must match XMFLOAT3X4");
+	static_assert(sizeof(SkinningDualQuaternion) == sizeof(BoneDualQuaternion) && alignof(SkinningDualQuaternion) <= alignof(BoneDualQuaternion), "SkinningDualQuaternion must match BoneDualQuaternion");
+	static_assert(sizeof(SkinningFloat4) == sizeof(DirectX::XMFLOAT4A), "SkinningFloat4 must match XMFLOAT4A");
+	static_assert(sizeof(SkinningBox) == sizeof(DirectX::BoundingBox), "SkinningBox must match BoundingBox");
+
+	inline const SkinningMatrix* AsSkinningPalette(const DirectX::XMFLOAT3X4* palette) { return reinterpret_cast<const SkinningMatrix*>(palette); }
+	inline const SkinningDualQuaternion* AsSkinningPalette(const BoneDualQuaternion* palette) { return reinterpret_cast<const SkinningDualQuaternion*>(palette); }
 
 	class BoneVelocityFrame : public std::vector<BoneVelocity, DirectX::XMAllocator>
 	{
@@ -274,6 +344,18 @@ namespace Causality
 		//void SetRotationConstraint(const RotationConstriant&);
 	};
 
+	// Flat joint hierarchy for forward kinematics
+	// Joints are sorted by depth, so joints of the same depth are independent and can be updated together
+	struct ArmatureTopology
+	{
+		std::vector<int> order;		// joint ids sorted by depth, in DFS order within a depth
+		std::vector<int> parents;	// parents[k] is the parent id of order[k], -1 for the root
+		std::vector<int> levels;	// joints of depth d are order[levels[d], levels[d + 1])
+
+		void build(const IArmature& armature);
+		size_t depth() const { return levels.empty() ? 0 : levels.size() - 1; }
+	};
+
 	// Represent a model "segmentation" and it's hireachy
 	class IArmature
 	{
@@ -294,6 +376,8 @@ namespace Causality
 		}
 		virtual size_t size() const = 0;
 		virtual frame_const_view bind_frame() const = 0;
+		// Cached flat hierarchy, nullptr if the armature does not keep one
+		virtual const ArmatureTopology* topology() const { return nullptr; }
 
 		bool empty() { return root() == nullptr; }
 		auto joints() const 
@@ -354,6 +438,7 @@ namespace Causality
 		int							m_rootIdx;
 		vector<joint_type>			m_joints;
 		vector<int>					m_order; //Topological order of joints
+		ArmatureTopology			m_topology;
 		frame_type					m_defaultFrame;
 
 	public:
@@ -378,6 +463,7 @@ namespace Causality
 		virtual joint_type* root() override;
 		virtual size_t size() const override;
 		virtual frame_const_view bind_frame() const override;
+		virtual const ArmatureTopology* topology() const override { return &m_topology; }
 		frame_type& bind_frame() { return m_defaultFrame; }
 		void set_default_frame(frame_type &&pFrame);
 		// A topolical ordered joint index sequence
@@ -0,0 +1,142 @@
+#include "pch_bcl.h"
+#include "ArmatureClipFile.h"
+#include <fstream>
+#include <cstring>
+#include <limits>
+
+using namespace Causality;
+
+namespace Causality
+{
+	namespace ClipFile
+	{
+		uint64_t checksum(const void* data, size_t size)
+		{
+			assert(size % sizeof(uint64_t) == 0);
+			const uint64_t prime = 0x100000001b3ULL;
+			uint64_t hash = 0xcbf29ce484222325ULL;
+			auto words = static_cast<const uint8_t*>(data);
+			for (size_t i = 0; i < size; i += sizeof(uint64_t))
+			{
+				uint64_t word;
+				memcpy(&word, words + i, sizeof(uint64_t));
+				hash = (hash ^ word) * prime;
+			}
+			return hash;
+		}
+
+		bool validate(const Header& header, uint64_t size)
+		{
+			const uint64_t maxSize = std::numeric_limits<uint64_t>::max();
+			bool valid = header.magic == Magic
+				&& header.version == Version
+				&& header.boneStride == sizeof(Bone)
+				&& header.boneCount > 0
+				&& header.frameCount > 0
+				// also false for NaN
+				&& header.frameInterval > .0
+				&& header.duration >= .0
+				&& header.fileSize <= size
+				&& header.framesOffset >= sizeof(Header)
+				&& header.framesOffset <= header.fileSize
+				&& header.framesOffset % BlockAlignment == 0
+				&& header.frameStride % BlockAlignment == 0
+				&& header.frameStride >= uint64_t(header.boneCount) * sizeof(Bone);
+			if (!valid)
+				return false;
+
+			// framesOffset + frameCount * frameStride, without wrapping around
+			if (header.frameCount > (maxSize - header.framesOffset) / header.frameStride)
+				return false;
+			return header.framesOffset + header.frameCount * header.frameStride == header.fileSize;
+		}
+
+		bool write(std::ostream& file, const std::vector<ArmatureFrame>& frames, double duration, double frameInterval)
+		{
+			// validate rejects empty clips, do not write one
+			if (frames.empty() || frames[0].empty())
+				return false;
+
+			Header header = {};
+			header.magic = Magic;
+			header.version = Version;
+			header.boneStride = sizeof(Bone);
+			header.boneCount = frames.empty() ? 0 : static_cast<uint32_t>(frames[0].size());
+			header.frameCount = frames.size();
+			header.framesOffset = align(sizeof(Header));
+			header.frameStride = align(header.boneCount * sizeof(Bone));
+			header.fileSize = header.framesOffset + header.frameCount * header.frameStride;
+			header.duration = duration;
+			header.frameInterval = frameInterval;
+
+			// frame blocks with their zero padding, so the checksum covers exactly the bytes on disk
+			std::vector<uint8_t> blocks(static_cast<size_t>(header.frameCount * header.frameStride), 0);
+			for (size_t i = 0; i < frames.size(); i++)
+			{
+				assert(frames[i].size() == header.boneCount);
+				memcpy(blocks.data() + i * header.frameStride, frames[i].data(), header.boneCount * sizeof(Bone));
+			}
+			header.checksum = checksum(blocks.data(), blocks.size());
+
+			static const char padding[BlockAlignment] = {};
+			file.write(reinterpret_cast<const char*>(&header), sizeof(Header));
+			file.write(padding, header.framesOffset - sizeof(Header));
+			file.write(reinterpret_cast<const char*>(blocks.data()), blocks.size());
+			return file.good();
+		}
+
+		bool save(const std::wstring& path, const std::vector<ArmatureFrame>& frames, double duration, double frameInterval)
+		{
+			std::ofstream file(path, std::ios::binary | std::ios::trunc);
+			if (!file)
+				return false;
+			return write(file, frames, duration, frameInterval);
+		}
+	}
+}
+
+MappedArmatureClip::MappedArmatureClip()
+	: m_header(nullptr)
+{
+}
+
+MappedArmatureClip::MappedArmatureClip(const std::wstring & path, bool verifyChecksum)
+	: m_header(nullptr)
+{
+	open(path, verifyChecksum);
+}
+
+bool MappedArmatureClip::open(const std::wstring & path, bool verifyChecksum)
+{
+	using namespace ClipFile;
+	m_header = nullptr;
+	if (!m_file.open(path) || m_file.size() < sizeof(Header))
+		return false;
+
+	auto header = reinterpret_cast<const Header*>(m_file.data());
+	bool valid = validate(*header, m_file.size());
+	if (valid && verifyChecksum)
+		valid = checksum(m_file.data() + header->framesOffset, static_cast<size_t>(header->fileSize - header->framesOffset)) == header->checksum;
+
+	if (!valid)
+	{
+		m_file.close();
+		return false;
+	}
+
+	m_header = header;
+	return true;
+}
+
+void MappedArmatureClip::close()
+{
+	m_header = nullptr;
+	m_file.close();
+}
+
+ArmatureFrameConstView MappedArmatureClip::frame(size_t index) const
+{
+	assert(m_header && index < m_header->frameCount);
+	auto bones = reinterpret_cast<const Bone*>(m_file.data() + m_header->framesOffset + index * m_header->frameStride);
+	return ArmatureFrameConstView(bones, m_header->boneCount);
+}
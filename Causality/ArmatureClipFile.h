@@ -0,0 +1,82 @@
+#pragma once
+#include "Armature.h"
+#include <Geometrics\MappedFile.h>
+#include <cstdint>
+#include <iosfwd>
+#include <string>
+#include <vector>
+
+namespace Causality
+{
+	namespace ClipFile
+	{
+		// 'CCLP'
+		static constexpr uint32_t Magic = 0x504C4343;
+		static constexpr uint32_t Version = 1;
+		// every frame block starts at a multiple of this, bones inside the mapping keep their XMVECTOR alignment
+		static constexpr uint64_t BlockAlignment = 64;
+
+		struct Header
+		{
+			uint32_t	magic;
+			uint32_t	version;
+			uint32_t	boneStride;
+			uint32_t	boneCount;
+			uint64_t	frameCount;
+			// offset of the first frame block and bytes between two frame blocks
+			uint64_t	framesOffset;
+			uint64_t	frameStride;
+			uint64_t	fileSize;
+			double		duration;
+			double		frameInterval;
+			// checksum of the bytes [framesOffset, fileSize)
+			uint64_t	checksum;
+		};
+
+		inline uint64_t align(uint64_t offset) { return (offset + BlockAlignment - 1) & ~(BlockAlignment - 1); }
+
+		// 64-bit FNV-1a over 8 byte words, size must be a multiple of 8
+		uint64_t checksum(const void* data, size_t size);
+
+		// check the header against this build's Bone layout and the given file size
+		// rejects empty clips, non positive or NaN frame intervals and block sizes overflowing 64 bits
+		bool validate(const Header& header, uint64_t size);
+
+		/// <summary>
+		/// Write frames as a binary clip, all frames must have the same size.
+		/// </summary>
+		/// <returns>false if there are no frames or the stream fails</returns>
+		bool write(std::ostream& file, const std::vector<ArmatureFrame>& frames, double duration, double frameInterval);
+		bool save(const std::wstring& path, const std::vector<ArmatureFrame>& frames, double duration, double frameInterval);
+	}
+
+	/// <summary>
+	/// Read-only armature clip backed by a memory mapped clip file.
+	/// Frames are zero-copy views into the mapping, valid as long as this object lives.
+	/// </summary>
+	class MappedArmatureClip
+	{
+	public:
+		MappedArmatureClip();
+		explicit MappedArmatureClip(const std::wstring& path, bool verifyChecksum = true);
+
+		/// <summary>
+		/// Map the file and validate the header, the checksum pass touches every page once and can be skipped for trusted files.
+		/// </summary>
+		/// <returns>false if the file is missing, truncated, corrupted, of another version or Bone layout</returns>
+		bool open(const std::wstring& path, bool verifyChecksum = true);
+		void close();
+		bool is_open() const { return m_header != nullptr; }
+
+		size_t bones() const { return m_header ? m_header->boneCount : 0; }
+		size_t frames() const { return m_header ? static_cast<size_t>(m_header->frameCount) : 0; }
+		double duration() const { return m_header ? m_header->duration : .0; }
+		double frame_interval() const { return m_header ? m_header->frameInterval : .0; }
+
+		ArmatureFrameConstView frame(size_t index) const;
+
+	private:
+		Geometrics::MappedFile		m_file;
+		const ClipFile::Header*		m_header;
+	};
+}
@@ -0,0 +1,245 @@
+#include "pch_bcl.h"
+#include "ArmatureFrameSoA.h"
+#include "FrameLanes.h"
+
+using namespace DirectX;
+using namespace Causality;
+
+namespace
+{
+	typedef ArmatureFrameSoA::TransformArrays TransformArrays;
+	typedef ArmatureFrameSoA::lane_array lane_array;
+
+	struct ComponentArray
+	{
+		lane_array TransformArrays::* member;
+		float identity;
+	};
+
+	const ComponentArray TransformComponents[] = {
+		{ &TransformArrays::rx, .0f },{ &TransformArrays::ry, .0f },{ &TransformArrays::rz, .0f },{ &TransformArrays::rw, 1.0f },
+		{ &TransformArrays::tx, .0f },{ &TransformArrays::ty, .0f },{ &TransformArrays::tz, .0f },
+		{ &TransformArrays::sx, 1.0f },{ &TransformArrays::sy, 1.0f },{ &TransformArrays::sz, 1.0f },
+	};
+
+	// translation and scaling, interpolated component wise
+	lane_array TransformArrays::* const LinearComponents[] = {
+		&TransformArrays::tx, &TransformArrays::ty, &TransformArrays::tz,
+		&TransformArrays::sx, &TransformArrays::sy, &TransformArrays::sz,
+	};
+
+	void ResizeArrays(TransformArrays& arrays, size_t size, size_t padded)
+	{
+		for (auto& component : TransformComponents)
+		{
+			auto& a = arrays.*component.member;
+			a.resize(padded, component.identity);
+			std::fill(a.begin() + size, a.end(), component.identity);
+		}
+	}
+
+	typedef Internal::FrameLanes FrameLanes;
+
+	static_assert(ArmatureFrameSoA::LaneWidth % FrameLanes::width == 0, "padding must cover whole lanes");
+
+	enum RotationInterpolation
+	{
+		Nlerp,
+		Slerp,
+	};
+
+	// sin(t * theta) / sin(theta) as a polynomial of t and x = cos(theta) - 1, with no trigonometric call and no division,
+	// D. Eberly, "A Fast and Accurate Algorithm for Computing SLERP", 8 terms, max error about 2e-5 for theta in [0, pi/2]
+	template <class L>
+	inline typename L::type SlerpWeight(typename L::type x, typename L::type t)
+	{
+		static const float Mu = 1.85298109240830f;
+		static const float u[8] = {
+			1.f / (1 * 3), 1.f / (2 * 5), 1.f / (3 * 7), 1.f / (4 * 9),
+			1.f / (5 * 11), 1.f / (6 * 13), 1.f / (7 * 15), Mu / (8 * 17) };
+		static const float v[8] = {
+			1.f / 3, 2.f / 5, 3.f / 7, 4.f / 9,
+			5.f / 11, 6.f / 13, 7.f / 15, Mu * 8 / 17 };
+
+		auto one = L::set1(1.0f);
+		auto t2 = L::mul(t, t);
+		auto f = one;
+		for (int i = 7; i >= 0; i--)
+		{
+			// f = 1 + (u[i] * t^2 - v[i]) * x * f
+			auto b = L::mul(L::sub(L::mul(L::set1(u[i]), t2), L::set1(v[i])), x);
+			f = L::madd(b, f, one);
+		}
+		return L::mul(t, f);
+	}
+
+	// bones [i, i + L::width) of out = lerp(a, b, t), rotations take the shortest path
+	template <class L, RotationInterpolation Mode>
+	inline void InterpolateBones(TransformArrays& out, const TransformArrays& a, const TransformArrays& b, size_t i, typename L::type t)
+	{
+		typedef typename L::type V;
+		V one = L::set1(1.0f);
+		V s = L::sub(one, t);
+
+		for (auto component : LinearComponents)
+		{
+			V va = L::load(&(a.*component)[i]);
+			V vb = L::load(&(b.*component)[i]);
+			L::store(&(out.*component)[i], L::madd(L::sub(vb, va), t, va));
+		}
+
+		V ax = L::load(&a.rx[i]), ay = L::load(&a.ry[i]), az = L::load(&a.rz[i]), aw = L::load(&a.rw[i]);
+		V bx = L::load(&b.rx[i]), by = L::load(&b.ry[i]), bz = L::load(&b.rz[i]), bw = L::load(&b.rw[i]);
+
+		V d = L::madd(aw, bw, L::madd(az, bz, L::madd(ay, by, L::mul(ax, bx))));
+		V sign = L::sign(d);
+
+		V w0, w1;
+		if (Mode == Slerp)
+		{
+			V x = L::sub(L::mul(d, sign), one);
+			w0 = SlerpWeight<L>(x, s);
+			w1 = L::mul(SlerpWeight<L>(x, t), sign);
+		}
+		else
+		{
+			w0 = s;
+			w1 = L::mul(t, sign);
+		}
+
+		V qx = L::madd(bx, w1, L::mul(ax, w0));
+		V qy = L::madd(by, w1, L::mul(ay, w0));
+		V qz = L::madd(bz, w1, L::mul(az, w0));
+		V qw = L::madd(bw, w1, L::mul(aw, w0));
+
+		if (Mode == Nlerp)
+		{
+			V l = L::div(one, L::sqrt(L::madd(qw, qw, L::madd(qz, qz, L::madd(qy, qy, L::mul(qx, qx))))));
+			qx = L::mul(qx, l);
+			qy = L::mul(qy, l);
+			qz = L::mul(qz, l);
+			qw = L::mul(qw, l);
+		}
+
+		L::store(&out.rx[i], qx);
+		L::store(&out.ry[i], qy);
+		L::store(&out.rz[i], qz);
+		L::store(&out.rw[i], qw);
+	}
+
+	void PrepareOutput(ArmatureFrameSoA& out, const ArmatureFrameSoA& lhs, const ArmatureFrameSoA& rhs)
+	{
+		assert(lhs.size() == rhs.size());
+		if (out.size() != lhs.size())
+			out.resize(lhs.size());
+	}
+
+	template <RotationInterpolation Mode>
+	void InterpolateFrame(ArmatureFrameSoA& out, const ArmatureFrameSoA& lhs, const ArmatureFrameSoA& rhs, float t)
+	{
+		typedef FrameLanes L;
+		PrepareOutput(out, lhs, rhs);
+		auto vt = L::set1(t);
+		for (size_t i = 0; i < lhs.padded_size(); i += L::width)
+			InterpolateBones<L, Mode>(out.Local, lhs.Local, rhs.Local, i, vt);
+	}
+}
+
+ArmatureFrameSoA::ArmatureFrameSoA()
+	: m_size(0)
+{
+}
+
+ArmatureFrameSoA::ArmatureFrameSoA(size_t size)
+	: m_size(0)
+{
+	resize(size);
+}
+
+ArmatureFrameSoA::ArmatureFrameSoA(ArmatureFrameConstView frame)
+	: m_size(0)
+{
+	assign(frame);
+}
+
+void ArmatureFrameSoA::resize(size_t size)
+{
+	size_t padded = (size + LaneWidth - 1) / LaneWidth * LaneWidth;
+	ResizeArrays(Local, size, padded);
+	ResizeArrays(Global, size, padded);
+	m_size = size;
+}
+
+void ArmatureFrameSoA::assign(ArmatureFrameConstView frame)
+{
+	resize(frame.size());
+	for (size_t i = 0; i < m_size; i++)
+	{
+		auto& bone = frame[i];
+		Local.rx[i] = bone.LclRotation.x; Local.ry[i] = bone.LclRotation.y; Local.rz[i] = bone.LclRotation.z; Local.rw[i] = bone.LclRotation.w;
+		Local.tx[i] = bone.LclTranslation.x; Local.ty[i] = bone.LclTranslation.y; Local.tz[i] = bone.LclTranslation.z;
+		Local.sx[i] = bone.LclScaling.x; Local.sy[i] = bone.LclScaling.y; Local.sz[i] = bone.LclScaling.z;
+
+		Global.rx[i] = bone.GblRotation.x; Global.ry[i] = bone.GblRotation.y; Global.rz[i] = bone.GblRotation.z; Global.rw[i] = bone.GblRotation.w;
+		Global.tx[i] = bone.GblTranslation.x; Global.ty[i] = bone.GblTranslation.y; Global.tz[i] = bone.GblTranslation.z;
+		Global.sx[i] = bone.GblScaling.x; Global.sy[i] = bone.GblScaling.y; Global.sz[i] = bone.GblScaling.z;
+	}
+}
+
+void ArmatureFrameSoA::store(ArmatureFrameView frame) const
+{
+	assert(frame.size() >= m_size);
+	for (size_t i = 0; i < m_size; i++)
+	{
+		auto& bone = frame[i];
+		bone.LclRotation.x = Local.rx[i]; bone.LclRotation.y = Local.ry[i]; bone.LclRotation.z = Local.rz[i]; bone.LclRotation.w = Local.rw[i];
+		bone.LclTranslation.x = Local.tx[i]; bone.LclTranslation.y = Local.ty[i]; bone.LclTranslation.z = Local.tz[i];
+		bone.LclScaling.x = Local.sx[i]; bone.LclScaling.y = Local.sy[i]; bone.LclScaling.z = Local.sz[i];
+
+		bone.GblRotation.x = Global.rx[i]; bone.GblRotation.y = Global.ry[i]; bone.GblRotation.z = Global.rz[i]; bone.GblRotation.w = Global.rw[i];
+		bone.GblTranslation.x = Global.tx[i]; bone.GblTranslation.y = Global.ty[i]; bone.GblTranslation.z = Global.tz[i];
+		bone.GblScaling.x = Global.sx[i]; bone.GblScaling.y = Global.sy[i]; bone.GblScaling.z = Global.sz[i];
+	}
+}
+
+namespace Causality
+{
+	void FrameLerp(ArmatureFrameSoA& out, const ArmatureFrameSoA& lhs, const ArmatureFrameSoA& rhs, float t)
+	{
+		InterpolateFrame<Slerp>(out, lhs, rhs, t);
+	}
+
+	void FrameLerpEst(ArmatureFrameSoA& out, const ArmatureFrameSoA& lhs, const ArmatureFrameSoA& rhs, float t)
+	{
+		InterpolateFrame<Nlerp>(out, lhs, rhs, t);
+	}
+
+	void FrameBlend(ArmatureFrameSoA& out, const ArmatureFrameSoA& lhs, const ArmatureFrameSoA& rhs, const float* blend_weights)
+	{
+		typedef FrameLanes L;
+		PrepareOutput(out, lhs, rhs);
+		size_t n = lhs.size();
+		for (size_t i = 0; i < lhs.padded_size(); i += L::width)
+		{
+			// the weights are not padded, the last lanes read from a zero filled copy
+			XM_ALIGNATTR float tail[ArmatureFrameSoA::LaneWidth] = {};
+			const float* w = blend_weights + i;
+			if (i + L::width > n)
+			{
+				std::copy(w, w + (i < n ? n - i : 0), tail);
+				w = tail;
+			}
+			InterpolateBones<L, Slerp>(out.Local, lhs.Local, rhs.Local, i, L::loadu(w));
+		}
+	}
+
+	void FrameScale(ArmatureFrameSoA& frame, const ArmatureFrameSoA& ref, float scale)
+	{
+		InterpolateFrame<Slerp>(frame, ref, frame, scale);
+	}
+
+	void FrameScaleEst(ArmatureFrameSoA& frame, const ArmatureFrameSoA& ref, float scale)
+	{
+		InterpolateFrame<Nlerp>(frame, ref, frame, scale);
+	}
+}
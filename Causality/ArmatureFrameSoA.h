@@ -0,0 +1,62 @@
+#pragma once
+#include "Armature.h"
+#include <vector>
+
+namespace Causality
+{
+	// Armature frame in structure of arrays layout, one 32-byte aligned float array per bone component
+	// Arrays are padded to a multiple of LaneWidth bones with identity bones, so the kernels always run full AVX2 lanes
+	// Only rotation, translation and scaling are kept, LclLength / LclTw / GblTw / GblLength stay in the AoS frame
+	class ArmatureFrameSoA
+	{
+	public:
+		// number of bones processed per step by the frame kernels
+		static const size_t LaneWidth = 8;
+
+		typedef std::vector<float, DirectX::AlignedAllocator<float, 32>> lane_array;
+
+		struct TransformArrays
+		{
+			lane_array rx, ry, rz, rw; // Rotation
+			lane_array tx, ty, tz;     // Translation
+			lane_array sx, sy, sz;     // Scaling
+		};
+
+		TransformArrays Local;
+		TransformArrays Global;
+
+		ArmatureFrameSoA();
+		explicit ArmatureFrameSoA(size_t size);
+		explicit ArmatureFrameSoA(ArmatureFrameConstView frame);
+
+		size_t size() const { return m_size; }
+		size_t padded_size() const { return Local.rw.size(); }
+		bool empty() const { return m_size == 0; }
+
+		// resize to size bones, new bones are identity
+		void resize(size_t size);
+
+		// convert from ArmatureFrame
+		void assign(ArmatureFrameConstView frame);
+		// convert back to ArmatureFrame, frame.size() must be >= size(), the length and padding fields are left untouched
+		void store(ArmatureFrameView frame) const;
+
+	private:
+		size_t m_size;
+	};
+
+	// SoA frame kernels, they read and write the Local arrays only, Global arrays of the output are left untouched
+	// store() the result and call FrameRebuildGlobal to get the global data
+	// All frames must have the same size, blend_weights must hold size() weights
+
+	// Slerp the rotations, lerp translation and scaling, same as FrameLerp
+	void FrameLerp(ArmatureFrameSoA& out, const ArmatureFrameSoA& lhs, const ArmatureFrameSoA& rhs, float t);
+	// Nlerp the rotations, lerp translation and scaling, same as FrameLerpEst
+	void FrameLerpEst(ArmatureFrameSoA& out, const ArmatureFrameSoA& lhs, const ArmatureFrameSoA& rhs, float t);
+	// Per bone slerp factor, bone i = lerp(lhs[i], rhs[i], blend_weights[i])
+	void FrameBlend(ArmatureFrameSoA& out, const ArmatureFrameSoA& lhs, const ArmatureFrameSoA& rhs, const float* blend_weights);
+	// frame = lerp(ref, frame, scale) with slerp rotations, same as FrameScale
+	void FrameScale(ArmatureFrameSoA& frame, const ArmatureFrameSoA& ref, float scale);
+	// frame = lerp(ref, frame, scale) with nlerp rotations, same as FrameScaleEst
+	void FrameScaleEst(ArmatureFrameSoA& frame, const ArmatureFrameSoA& ref, float scale);
+}
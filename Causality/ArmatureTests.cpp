@@ -0,0 +1,206 @@
+#include "pch_bcl.h"
+#include "Animations.h"
+#include "FrameLanes.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+#include <random>
+#include "Tests.h"
+
+using namespace DirectX;
+using namespace std;
+
+namespace Causality
+{
+	namespace
+	{
+		// a root with a level of 9 bones (a whole lane and a partial one with AVX2), a level of 3 and a level of 1 (narrower than half a lane),
+		// the remaining bones hang randomly below the single bone
+		vector<int> make_random_parents(size_t count, mt19937& rng)
+		{
+			assert(count > 14);
+			vector<int> parents(count);
+			parents[0] = -1;
+			for (size_t b = 1; b < 10; b++)
+				parents[b] = 0;
+			for (size_t b = 10; b < 13; b++)
+				parents[b] = uniform_int_distribution<int>(1, 9)(rng);
+			parents[13] = 10;
+			for (size_t b = 14; b < count; b++)
+				parents[b] = uniform_int_distribution<int>(13, (int)b - 1)(rng);
+			return parents;
+		}
+
+		void randomize_local(ArmatureFrameView frame, mt19937& rng)
+		{
+			uniform_real_distribution<float> unit(-1.0f, 1.0f);
+			for (auto& bone : frame)
+			{
+				bone.LclRotation = XMQuaternionRotationRollPitchYaw(unit(rng), unit(rng), unit(rng));
+				bone.LclTranslation = Vector3(0.3f * unit(rng), 0.5f + 0.3f * unit(rng), 0.3f * unit(rng));
+				bone.LclScaling = Vector3(1.0f + 0.2f * unit(rng), 1.0f + 0.2f * unit(rng), 1.0f + 0.2f * unit(rng));
+			}
+		}
+
+		// the joint walk FK, Bone::UpdateGlobalData of every joint after its parent
+		void joint_walk_rebuild(const IArmature& armature, ArmatureFrameView frame)
+		{
+			for (auto& joint : armature.joints())
+			{
+				auto& bone = frame[joint.ID];
+				if (joint.is_root())
+				{
+					bone.GblRotation = bone.LclRotation;
+					bone.GblScaling = bone.LclScaling;
+					bone.GblTranslation = bone.LclTranslation;
+					bone.LclLength = bone.GblLength = 1.0f;
+				}
+				else
+					bone.UpdateGlobalData(frame[joint.ParentID]);
+			}
+		}
+
+		// max component difference of the global rotation, translation, scaling and the lengths
+		float global_error(const Bone& a, const Bone& b)
+		{
+			// GblRotation, GblTranslation, GblTw, GblScaling, GblLength, the FK does not write GblTw
+			const float* ga = &a.GblRotation.x;
+			const float* gb = &b.GblRotation.x;
+			float error = fabsf(a.LclLength - b.LclLength);
+			for (int i = 0; i < 12; i++)
+				if (i != 7)
+					error = max(error, fabsf(ga[i] - gb[i]));
+			return error;
+		}
+
+		// is bone in the subtree of ancestor (ancestor included)
+		bool in_subtree(const vector<int>& parents, int bone, int ancestor)
+		{
+			for (; bone >= 0; bone = parents[bone])
+				if (bone == ancestor)
+					return true;
+			return false;
+		}
+	}
+
+	// the level by level FK of one frame and the batch FK of a frame buffer against the joint walk
+	// the frame count is not a multiple of the lane width and spans a whole and a partial task
+	bool GlobalRebuildTest()
+	{
+		mt19937 rng(42);
+		auto parents = make_random_parents(40, rng);
+		StaticArmature armature(parents.size(), parents.data(), vector<const char*>(parents.size(), "bone").data());
+		const size_t frameCount = 67;
+
+		ArmatureFrameBuffer buffer(armature, frameCount);
+		for (size_t f = 0; f < frameCount; f++)
+			randomize_local(buffer[f], rng);
+
+		vector<ArmatureFrame> reference, flat;
+		for (size_t f = 0; f < frameCount; f++)
+		{
+			reference.emplace_back(ArmatureFrameConstView(buffer[f]));
+			flat.emplace_back(ArmatureFrameConstView(buffer[f]));
+			joint_walk_rebuild(armature, reference[f]);
+			FrameRebuildGlobal(armature, flat[f]);
+		}
+		FrameRebuildGlobal(armature, buffer);
+
+		float flatError = .0f, batchError = .0f;
+		for (size_t f = 0; f < frameCount; f++)
+		{
+			for (size_t b = 0; b < armature.size(); b++)
+			{
+				flatError = max(flatError, global_error(flat[f][b], reference[f][b]));
+				batchError = max(batchError, global_error(buffer.bone(f, b), reference[f][b]));
+			}
+		}
+
+		const float tolerance = 1e-4f;
+		int failures = 0;
+		if (flatError > tolerance)
+			++failures;
+		if (batchError > tolerance)
+			++failures;
+
+		cout << "global rebuild test : " << Internal::FrameLanes::width << " bones per step, flat error = " << flatError << ", batch error = " << batchError << endl;
+		cout << "global rebuild test : failures = " << failures << endl;
+		return failures == 0;
+	}
+
+	REGISTER_TEST_METHOD(GlobalRebuildTest, GlobalRebuildTest);
+
+	// dirty subtree update as CharacterObject::Update runs it : change one mid-chain bone, rebuild and re-skin only its subtree
+	// the mask must expand to exactly the descendants, the counters must equal the subtree size and the result a full rebuild
+	bool DirtySubtreeTest()
+	{
+		mt19937 rng(43);
+		auto parents = make_random_parents(40, rng);
+		StaticArmature armature(parents.size(), parents.data(), vector<const char*>(parents.size(), "bone").data());
+		size_t n = armature.size();
+
+		ArmatureFrame bind(n), frame(n);
+		randomize_local(bind, rng);
+		randomize_local(frame, rng);
+		FrameRebuildGlobal(armature, bind);
+		FrameRebuildGlobal(armature, frame);
+
+		vector<XMFLOAT3X4> matrices(n), expectedMatrices(n);
+		FrameTransformMatrix(matrices.data(), bind, frame);
+
+		// bone 10 is on the third level, with bone 13 and the random bones below it
+		const int changed = 10;
+		size_t subtree = 0;
+		for (size_t b = 0; b < n; b++)
+			subtree += in_subtree(parents, (int)b, changed);
+
+		ArmatureFrame before = frame;
+		frame[changed].LclRotation = XMQuaternionMultiply(XMLoadA(frame[changed].LclRotation), XMQuaternionRotationRollPitchYaw(0.3f, -0.2f, 0.1f));
+
+		int failures = 0;
+		BoneDirtyMask dirtyBones(n), dirtyMatrices(n);
+		FrameMarkChanged(dirtyBones, before, frame);
+		for (size_t b = 0; b < n; b++)
+			if (dirtyBones.test(b) != ((int)b == changed))
+				++failures;
+
+		size_t globalBones = FrameRebuildGlobal(armature, frame, dirtyBones);
+		dirtyMatrices |= dirtyBones;
+		size_t skinningMatrices = FrameTransformMatrix(matrices.data(), bind, frame, dirtyMatrices);
+
+		size_t maskErrors = 0;
+		for (size_t b = 0; b < n; b++)
+			if (dirtyBones.test(b) != in_subtree(parents, (int)b, changed))
+				++maskErrors;
+		if (maskErrors > 0 || globalBones != subtree || skinningMatrices != subtree)
+			++failures;
+
+		ArmatureFrame expected = frame;
+		FrameRebuildGlobal(armature, expected);
+		FrameTransformMatrix(expectedMatrices.data(), bind, expected);
+
+		const float tolerance = 1e-4f;
+		float globalError = .0f, matrixError = .0f;
+		for (size_t b = 0; b < n; b++)
+		{
+			globalError = max(globalError, global_error(frame[b], expected[b]));
+			// the bones outside the subtree are not touched
+			if (!in_subtree(parents, (int)b, changed) && memcmp(&frame[b], &before[b], sizeof(Bone)) != 0)
+				++failures;
+			const float* m = &matrices[b]._11;
+			const float* e = &expectedMatrices[b]._11;
+			for (int i = 0; i < 12; i++)
+				matrixError = max(matrixError, fabsf(m[i] - e[i]));
+		}
+		if (globalError > tolerance || matrixError > tolerance)
+			++failures;
+
+		cout << "dirty subtree test : subtree = " << subtree << " of " << n << " bones, global bones = " << globalBones << ", skinning matrices = " << skinningMatrices
+			<< ", global error = " << globalError << ", matrix error = " << matrixError << endl;
+		cout << "dirty subtree test : failures = " << failures << endl;
+		return failures == 0;
+	}
+
+	REGISTER_TEST_METHOD(DirtySubtreeTest, DirtySubtreeTest);
+}
@@ -0,0 +1,414 @@
+#include "pch_bcl.h"
+#include <Geometrics\MetaBallModel.h>
+#include <Geometrics\BezierClipBatch.h>
+#include "Armature.h"
+#include "SkinningEngine.h"
+#include <Models.h>
+#include <MeshData.h>
+#include <chrono>
+#include <random>
+#include <unordered_set>
+#include "Tests.h"
+
+using namespace DirectX;
+using namespace Geometrics;
+using namespace std;
+
+namespace Causality
+{
+	namespace
+	{
+		template <class _Func>
+		double measure_ms(_Func&& func)
+		{
+			auto begin = chrono::high_resolution_clock::now();
+			func();
+			return chrono::duration<double, milli>(chrono::high_resolution_clock::now() - begin).count();
+		}
+
+		// compound clippings of 2 to 4 metaballs over random ray intervals, the way MetaBallModel::RayIntersection builds them
+		vector<Metaball::ClipType> make_metaball_clippings(size_t count, mt19937& rng)
+		{
+			uniform_real_distribution<float> uniform(0.0f, 1.0f);
+			vector<Metaball::ClipType> clippings(count);
+			for (size_t i = 0; i < count; i++)
+			{
+				auto& clipping = clippings[i];
+				clipping.fill(0.0f);
+				for (size_t ball = 0; ball < 2 + i % 3; ball++)
+				{
+					Metaball sphere(Vector3::Zero, 1.0f);
+					float d = 0.4f + 1.6f * uniform(rng);
+					auto single = sphere.GetBezierFunctionInLine(d * d * 0.25f);
+					float s = 0.6f * uniform(rng);
+					float t = s + 0.05f + (0.95f - s) * uniform(rng);
+					single.crop(s, t);
+					clipping.compound(single);
+				}
+			}
+			return clippings;
+		}
+
+		// random global rotation, translation and scaling, as FrameRebuildGlobal would leave them
+		void make_random_globals(ArmatureFrame& frame, mt19937& rng)
+		{
+			normal_distribution<float> normal;
+			uniform_real_distribution<float> scaling(0.5f, 1.5f);
+			for (auto& bone : frame)
+			{
+				bone.GblRotation = XMQuaternionNormalize(XMVectorSet(normal(rng), normal(rng), normal(rng), normal(rng)));
+				bone.GblTranslation = Vector3(normal(rng), normal(rng), normal(rng));
+				bone.GblScaling = Vector3(scaling(rng), scaling(rng), scaling(rng));
+			}
+		}
+
+		float max_abs_difference(const float* lhs, const float* rhs, size_t count)
+		{
+			float diff = 0;
+			for (size_t i = 0; i < count; i++)
+				diff = max(diff, abs(lhs[i] - rhs[i]));
+			return diff;
+		}
+
+		typedef Scene::DefaultSkinningModel::VertexType SkinnedVertex;
+
+		// a limb along a chain of bones, bone b spans y in [b, b + 1), each vertex is weighted to 1 - 4 bones around its height
+		vector<SkinnedVertex> make_skinned_vertices(size_t count, size_t bones, mt19937& rng)
+		{
+			uniform_real_distribution<float> height(0.0f, static_cast<float>(bones)), angle(0.0f, XM_2PI), radius(0.2f, 0.3f);
+			uniform_int_distribution<int> influences(1, 4);
+			vector<SkinnedVertex> vertices(count);
+			for (auto& v : vertices)
+			{
+				float y = height(rng), a = angle(rng);
+				v.position = XMFLOAT3(radius(rng) * cos(a), y, radius(rng) * sin(a));
+				v.normal = XMFLOAT3(cos(a), 0.0f, sin(a));
+				v.tangent = XMFLOAT4(-sin(a), 0.0f, cos(a), (rng() & 1) ? 1.0f : -1.0f);
+				v.SetColor(Colors::White.v);
+
+				int bone = min(static_cast<int>(y), static_cast<int>(bones) - 1);
+				const int neighbours[4] = { 0, 1, -1, 2 };
+				uint32_t ids[4] = {};
+				float weights[4] = {}, sum = 0;
+				int k = influences(rng);
+				for (int j = 0; j < k; j++)
+				{
+					int id = max(0, min(bone + neighbours[j], static_cast<int>(bones) - 1));
+					ids[j] = static_cast<uint32_t>(id);
+					weights[j] = max(0.05f, 1.0f - abs(y - (id + 0.5f)));
+					sum += weights[j];
+				}
+				v.SetBlendIndices(XMUINT4(ids[0], ids[1], ids[2], ids[3]));
+				v.SetBlendWeights(XMFLOAT4(weights[0] / sum, weights[1] / sum, weights[2] / sum, weights[3] / sum));
+			}
+			return vertices;
+		}
+
+		// the former CaculateBoneBoxes end to end, every bone scans all triangles through a hash set, then fits its box in bind space
+		vector<BoundingOrientedBox> per_bone_triangle_scan(const vector<SkinnedVertex>& vertices, const vector<uint16_t>& indices, const vector<Matrix4x4>& bindTransforms)
+		{
+			size_t bones = bindTransforms.size();
+			vector<BoundingOrientedBox> boxes(bones);
+			vector<XMFLOAT4A, XMAllocator> points;
+			points.reserve(indices.size());
+			unordered_set<uint16_t> pointset(indices.size());
+			BoundingBox box;
+			for (size_t bone = 0; bone < bones; bone++)
+			{
+				points.clear();
+				pointset.clear();
+				for (size_t i = 0; i + 2 < indices.size(); i += 3)
+				{
+					bool touched = false;
+					for (int k = 0; k < 3; k++)
+						touched |= (vertices[indices[i + k]].indices & 0xff) == bone;
+					if (!touched)
+						continue;
+					for (int k = 0; k < 3; k++)
+					{
+						if (pointset.insert(indices[i + k]).second)
+						{
+							auto& p = vertices[indices[i + k]].position;
+							points.emplace_back(p.x, p.y, p.z, 1.0f);
+						}
+					}
+				}
+
+				if (points.empty())
+				{
+					boxes[bone].Extents = { 0,0,0 };
+					continue;
+				}
+
+				XMMATRIX trans = XMLoad(bindTransforms[bone]);
+				XMVECTOR determinate;
+				XMMATRIX invTrans = XMMatrixInverse(&determinate, trans);
+				XMVector4TransformStream(points.data(), sizeof(XMFLOAT4A), points.data(), sizeof(XMFLOAT4A), points.size(), invTrans);
+				CreateBoundingBoxesFromPoints(box, boxes[bone], points.size(), reinterpret_cast<XMFLOAT3A*>(points.data()), sizeof(XMFLOAT4A));
+				boxes[bone].Transform(boxes[bone], trans);
+			}
+			return boxes;
+		}
+	}
+
+	bool BezierClippingBenchmark()
+	{
+		const size_t count = 1 << 16;
+		const float iso = 0.3f, precision = 1e-3f;
+
+		mt19937 rng(7);
+		auto clippings = make_metaball_clippings(count, rng);
+		vector<float> precisions(count, precision);
+		vector<float> scalarRoots(count), batchRoots(count);
+
+		double scalarTime = measure_ms([&]() {
+			for (size_t i = 0; i < count; i++)
+				scalarRoots[i] = Bezier::solove_first_root(clippings[i], iso, precision);
+		});
+
+		double batchTime = measure_ms([&]() {
+			Bezier::solove_first_roots<6>(clippings, iso, precisions, batchRoots);
+		});
+
+		size_t roots = 0, mismatches = 0;
+		for (size_t i = 0; i < count; i++)
+		{
+			bool scalar = scalarRoots[i] >= 0.0f && scalarRoots[i] <= 1.0f;
+			bool batch = batchRoots[i] >= 0.0f;
+			roots += batch;
+			// a root found by only one of the solvers is a mismatch too
+			if (scalar != batch || (batch && abs(scalarRoots[i] - batchRoots[i]) > 4 * precision))
+				++mismatches;
+		}
+
+		cout << "[Benchmark] Bezier clipping, " << count << " order 6 clippings (" << roots << " with root) : scalar = "
+			<< scalarTime << " ms ; batch = " << batchTime << " ms ; mismatches = " << mismatches << endl;
+
+		return mismatches == 0;
+	}
+
+	REGISTER_BENCHMARK_METHOD(BezierClippingBenchmark, BezierClippingBenchmark);
+
+	bool MetaballRayCastBenchmark()
+	{
+		const size_t ballCount = 64, rayCount = 1 << 12;
+
+		mt19937 rng(11);
+		uniform_real_distribution<float> uniform(-1.0f, 1.0f);
+
+		MetaBallModel model;
+		for (size_t i = 0; i < ballCount; i++)
+			model.push_back(Metaball(Vector3(uniform(rng), uniform(rng), uniform(rng)), 0.3f + 0.1f * uniform(rng)));
+		model.Update();
+
+		vector<Vector3> origins(rayCount), directions(rayCount);
+		for (size_t i = 0; i < rayCount; i++)
+		{
+			Vector3 target(0.5f * uniform(rng), 0.5f * uniform(rng), 0.5f * uniform(rng));
+			origins[i] = XMVector3Normalize(XMVectorSet(uniform(rng), uniform(rng), uniform(rng), 0.0f)) * 4.0f;
+			directions[i] = target - origins[i];
+		}
+
+		size_t hits = 0;
+		Vector3 hit;
+		double time = measure_ms([&]() {
+			for (size_t i = 0; i < rayCount; i++)
+				hits += model.RayIntersection(hit, origins[i], directions[i]);
+		});
+
+		cout << "[Benchmark] Metaball ray cast, " << ballCount << " metaballs, " << rayCount << " rays (" << hits << " hits) : "
+			<< time << " ms ; " << time * 1000.0 / rayCount << " us per ray" << endl;
+
+		return true;
+	}
+
+	REGISTER_BENCHMARK_METHOD(MetaballRayCastBenchmark, MetaballRayCastBenchmark);
+
+	bool SkinningPaletteBenchmark()
+	{
+		const size_t boneCounts[] = { 20, 50, 100, 200 };
+		const size_t characterCounts[] = { 1, 10, 100, 500 };
+		const size_t maxCharacters = 500;
+
+		mt19937 rng(13);
+		float maxError = 0;
+		for (auto bones : boneCounts)
+		{
+			ArmatureFrame bind(bones);
+			make_random_globals(bind, rng);
+			vector<ArmatureFrame> poses(maxCharacters, ArmatureFrame(bones));
+			for (auto& pose : poses)
+				make_random_globals(pose, rng);
+
+			// one upload buffer for all characters, the way a palette structured buffer is filled
+			vector<XMFLOAT3X4, AlignedAllocator<XMFLOAT3X4, 16>> matrices(bones * maxCharacters), batchMatrices(bones * maxCharacters);
+			vector<BoneDualQuaternion, AlignedAllocator<BoneDualQuaternion, 16>> dualQuaternions(bones * maxCharacters), batchDualQuaternions(bones * maxCharacters);
+
+			for (auto characters : characterCounts)
+			{
+				double matrixTime = measure_ms([&]() {
+					for (size_t c = 0; c < characters; c++)
+						FrameTransformMatrix(matrices.data() + c * bones, bind, poses[c]);
+				});
+
+				double batchMatrixTime = measure_ms([&]() {
+					for (size_t c = 0; c < characters; c++)
+						FrameSkinningPalette(batchMatrices.data() + c * bones, bind, poses[c]);
+				});
+
+				double dualQuaternionTime = measure_ms([&]() {
+					for (size_t c = 0; c < characters; c++)
+					{
+						for (size_t i = 0; i < bones; i++)
+						{
+							XMDUALVECTOR dq = Bone::RigidTransformDualQuaternion(bind[i], poses[c][i]);
+							XMStoreFloat4A(&dualQuaternions[c * bones + i].Qr, dq.r[0]);
+							XMStoreFloat4A(&dualQuaternions[c * bones + i].Qe, dq.r[1]);
+						}
+					}
+				});
+
+				double batchDualQuaternionTime = measure_ms([&]() {
+					for (size_t c = 0; c < characters; c++)
+						FrameSkinningPalette(batchDualQuaternions.data() + c * bones, bind, poses[c]);
+				});
+
+				size_t count = characters * bones;
+				maxError = max(maxError, max_abs_difference(&matrices[0]._11, &batchMatrices[0]._11, count * 12));
+				maxError = max(maxError, max_abs_difference(&dualQuaternions[0].Qr.x, &batchDualQuaternions[0].Qr.x, count * 8));
+
+				cout << "[Benchmark] Skinning palette, " << bones << " bones x " << characters << " characters : matrix per-bone = "
+					<< matrixTime << " ms ; batch = " << batchMatrixTime << " ms ; dual quaternion per-bone = "
+					<< dualQuaternionTime << " ms ; batch = " << batchDualQuaternionTime << " ms" << endl;
+			}
+		}
+
+		cout << "[Benchmark] Skinning palette, max difference to the per-bone path = " << maxError << endl;
+		return maxError < 1e-4f;
+	}
+
+	REGISTER_BENCHMARK_METHOD(SkinningPaletteBenchmark, SkinningPaletteBenchmark);
+
+	bool SkinningEngineBenchmark()
+	{
+		const size_t bones = 120;
+		const size_t vertexCounts[] = { 10000, 100000, 500000 };
+
+		mt19937 rng(17);
+		ArmatureFrame bind(bones), pose(bones);
+		make_random_globals(bind, rng);
+		make_random_globals(pose, rng);
+		vector<XMFLOAT3X4, AlignedAllocator<XMFLOAT3X4, 16>> matrices(bones);
+		vector<BoneDualQuaternion, AlignedAllocator<BoneDualQuaternion, 16>> dualQuaternions(bones);
+		FrameSkinningPalette(matrices.data(), bind, pose);
+		FrameSkinningPalette(dualQuaternions.data(), bind, pose);
+
+		SkinningEngine serial(1), pooled;
+		float maxError = 0;
+		for (auto count : vertexCounts)
+		{
+			auto vertices = make_skinned_vertices(count, bones, rng);
+			auto streams = SkinnedVertexStreams::FromVertices(vertices.data(), vertices.size());
+			if (!serial.SetMesh(streams, bones) || !pooled.SetMesh(streams, bones))
+				return false;
+
+			// per-vertex blended matrix, the way the skinning vertex shader does it
+			vector<XMFLOAT4A, XMAllocator> reference(count);
+			double referenceTime = measure_ms([&]() {
+				for (size_t i = 0; i < count; i++)
+				{
+					XMUINT4 ids = vertices[i].GetBlendIndices();
+					XMVECTOR weights = vertices[i].GetBlendWeights();
+					weights /= XMVector4Dot(weights, XMVectorSplatOne());
+					const uint32_t* id = &ids.x;
+					XMVECTOR rows[3] = {};
+					for (int j = 0; j < 4; j++)
+					{
+						XMVECTOR w = XMVectorSplatX(XMVectorRotateLeft(weights, j));
+						for (int r = 0; r < 3; r++)
+							rows[r] += w * XMLoadFloat4(&matrices[id[j]]._11 + r * 4);
+					}
+					XMVECTOR p = XMVectorSetW(XMLoadFloat3(&vertices[i].position), 1.0f);
+					XMStoreFloat4A(&reference[i], XMVectorSet(XMVectorGetX(XMVector4Dot(rows[0], p)), XMVectorGetX(XMVector4Dot(rows[1], p)), XMVectorGetX(XMVector4Dot(rows[2], p)), 1.0f));
+				}
+			});
+
+			double serialTime = measure_ms([&]() { serial.Skin(AsSkinningPalette(matrices.data())); });
+			double pooledTime = measure_ms([&]() { pooled.Skin(AsSkinningPalette(matrices.data())); });
+			maxError = max(maxError, max_abs_difference(&reference[0].x, &serial.Positions()[0].x, count * 4));
+			maxError = max(maxError, max_abs_difference(&reference[0].x, &pooled.Positions()[0].x, count * 4));
+
+			double boxesTime = measure_ms([&]() { pooled.Skin(AsSkinningPalette(matrices.data()), true); });
+			double dualQuaternionTime = measure_ms([&]() { pooled.Skin(AsSkinningPalette(dualQuaternions.data())); });
+
+			cout << "[Benchmark] CPU skinning, " << count << " vertices x " << bones << " bones : per-vertex = " << referenceTime
+				<< " ms ; linear blend 1 thread = " << serialTime << " ms ; " << pooled.WorkersCount() << " threads = " << pooledTime
+				<< " ms ; with bone boxes = " << boxesTime << " ms ; dual quaternion = " << dualQuaternionTime << " ms" << endl;
+		}
+
+		cout << "[Benchmark] CPU skinning, max difference to the per-vertex path = " << maxError << endl;
+		return maxError < 1e-3f;
+	}
+
+	REGISTER_BENCHMARK_METHOD(SkinningEngineBenchmark, SkinningEngineBenchmark);
+
+	bool BoneBoxesBenchmark()
+	{
+		const size_t bones = 120, vertexCount = 60000, facetCount = 100000;
+
+		mt19937 rng(19);
+		auto vertices = make_skinned_vertices(vertexCount, bones, rng);
+		vector<uint16_t> indices(facetCount * 3);
+		uniform_int_distribution<int> vertex(0, static_cast<int>(vertexCount) - 1);
+		for (auto& index : indices)
+			index = static_cast<uint16_t>(vertex(rng));
+
+		vector<Matrix4x4> bindTransforms(bones);
+		for (size_t bone = 0; bone < bones; bone++)
+			bindTransforms[bone] = XMMatrixTranslation(0.0f, static_cast<float>(bone), 0.0f);
+
+		vector<BoundingOrientedBox> scannedBoxes;
+		double scanTime = measure_ms([&]() { scannedBoxes = per_bone_triangle_scan(vertices, indices, bindTransforms); });
+
+		// the model takes the buffers over, the load already fits the boxes once
+		Scene::SkinMeshData data;
+		data.Name = "limb";
+		data.VertexCount = static_cast<uint32_t>(vertexCount);
+		data.IndexCount = static_cast<uint32_t>(indices.size());
+		data.BonesCount = static_cast<uint32_t>(bones);
+		data.Vertices = new Scene::SkinMeshData::VertexType[vertexCount];
+		data.Indices = new Scene::SkinMeshData::IndexType[indices.size()];
+		data.DefaultBoneTransforms = new Matrix4x4[bones];
+		copy(bindTransforms.begin(), bindTransforms.end(), data.DefaultBoneTransforms);
+		copy(vertices.begin(), vertices.end(), data.Vertices);
+		copy(indices.begin(), indices.end(), data.Indices);
+
+		unique_ptr<Scene::DefaultSkinningModel> model(Scene::DefaultSkinningModel::CreateFromData(&data));
+		double bucketTime = measure_ms([&]() { model->CaculateBoneBoxes(bindTransforms.data()); });
+
+		// every weighted vertex lies in the box of each of its bones
+		size_t outside = 0;
+		auto boxes = model->GetBoneBoundingBoxes();
+		for (auto& v : vertices)
+		{
+			XMUINT4 ids = v.GetBlendIndices();
+			XMFLOAT4 weights;
+			XMStoreFloat4(&weights, v.GetBlendWeights());
+			for (int j = 0; j < 4; j++)
+			{
+				if ((&weights.x)[j] <= 0)
+					continue;
+				BoundingOrientedBox box = boxes[(&ids.x)[j]];
+				box.Extents = XMFLOAT3(box.Extents.x * 1.001f + 1e-4f, box.Extents.y * 1.001f + 1e-4f, box.Extents.z * 1.001f + 1e-4f);
+				outside += box.Contains(XMLoadFloat3(&v.position)) == DISJOINT;
+			}
+		}
+
+		cout << "[Benchmark] Bone boxes, " << vertexCount << " vertices, " << facetCount << " facets x " << bones << " bones : per-bone triangle scan = "
+			<< scanTime << " ms ; counting sort buckets = " << bucketTime << " ms ; speedup = " << scanTime / bucketTime << "x ; vertices outside their boxes = " << outside << endl;
+
+		return outside == 0;
+	}
+
+	REGISTER_BENCHMARK_METHOD(BoneBoxesBenchmark, BoneBoxesBenchmark);
+}
@@ -109,6 +109,14 @@ bool App::OnStartup(const std::vector<std::string>& args)
 		return false;
 	}
 
+	bool runBenchmark = false;
+	GetParam(appSettings, "run_benchmark", runBenchmark);
+	if (runBenchmark && !TestManager::RunBenchmark())
+	{
+		std::cout << "[Error] Benchmark Failed! Press any key to exit" << std::endl;
+		return false;
+	}
+
 	if (windowSettings)
 	{
 		GetParam(windowSettings, "width", width);
@@ -85,8 +85,11 @@ void BehavierSpace::UniformQuaternionsBetweenClips()
 	{
 		using namespace DirectX;
 		aligned_vector_of_vector4 pivots(armature.size());
-		for (auto& frame : anim.GetFrameBuffer())
+		// through GetFrame, the frame buffer of a compressed or mapped clip is empty
+		ArmatureFrame frame(armature.size());
+		for (size_t f = 0; f < anim.FrameCount(); f++)
 		{
+			anim.GetFrame(f, frame, false);
 			for (size_t i = 0; i < armature.size(); i++)
 			{
 				pivots[i] += XMLoadA(frame[i].LclRotation);
@@ -127,7 +127,6 @@ const CharacterObject::frame_type & CharacterObject::GetCurrentFrame() const
 CharacterObject::frame_type & CharacterObject::MapCurrentFrameForUpdate()
 {
 	m_UpdateLock = true;
-	m_FrameDirty = true;
 	m_LastFrame = m_CurrentFrame;
 	m_LastWorld = this->GlobalTransformMatrix();
 	return m_CurrentFrame;
@@ -135,9 +134,15 @@ CharacterObject::frame_type & CharacterObject::MapCurrentFrameForUpdate()
 
 void CharacterObject::ReleaseCurrentFrameFrorUpdate()
 {
+	FrameMarkChanged(m_DirtyBones, m_LastFrame, m_CurrentFrame);
 	m_UpdateLock = false;
 }
 
+const CharacterObject::UpdateCounters & CharacterObject::GetUpdateCounters() const
+{
+	return m_UpdateCounters;
+}
+
 IArmature & CharacterObject::Armature() { return *m_pArmature; }
 
 const IArmature & CharacterObject::Armature() const { return *m_pArmature; }
@@ -150,6 +155,10 @@ void CharacterObject::SetBehavier(BehavierSpace & behaver) {
 	m_pBehavier = &behaver;
 	m_pArmature = &m_pBehavier->Armature();
 	m_CurrentFrame = m_pBehavier->RestFrame();
+	m_DirtyBones.resize(m_pArmature->size());
+	m_DirtyBones.set_all();
+	m_DirtyMatrices.resize(m_pArmature->size());
+	m_DirtyMatrices.set_all();
 }
 
 const ArmatureFrameAnimation * CharacterObject::CurrentAction() const { return m_pCurrentAction; }
@@ -163,7 +172,9 @@ bool CharacterObject::StartAction(const string & key, time_seconds begin_time, b
 	auto& anim = (*m_pBehavier)[key];
 	std::lock_guard<std::mutex> guard(m_ActionMutex);
 	m_pCurrentAction = &anim;
-	m_CurrentActionTime = begin_time;
+	// clips keep cycling, as the time based GetFrameAt did
+	m_ActionCursor = anim.CreateCursor(PlaybackMode::Loop);
+	m_ActionCursor.Seek(begin_time);
 	m_LoopCurrentAction = loop;
 	return true;
 }
@@ -197,8 +208,9 @@ void CharacterObject::SetRenderModel(DirectX::Scene::IModelNode * pMesh, int LoD
 		throw std::exception("Render model doesn't support Skinning interface.");
 	}
 
-	m_FrameDirty = false;
+	m_DirtyMatrices.set_all();
 	m_BoneTransforms.resize(m_pSkinModel->GetBonesCount());
+	m_EvaluatedBoneTransforms.resize(m_pSkinModel->GetBonesCount());
 	//XMMATRIX identity = XMMatrixIdentity();
 	//for (auto& t : m_BoneTransforms)
 	//	XMStoreA(t, identity);
@@ -206,33 +218,58 @@ void CharacterObject::SetRenderModel(DirectX::Scene::IModelNode * pMesh, int LoD
 	VisualObject::SetRenderModel(pMesh, LoD);
 }
 
-void CharacterObject::Update(time_seconds const & time_delta)
+void CharacterObject::EvaluateAnimation(time_seconds const & time_delta)
 {
-	SceneObject::Update(time_delta);
 	if (m_pCurrentAction != nullptr && m_ActionMutex.try_lock())
 	{
 		std::lock_guard<std::mutex> guard(m_ActionMutex, std::adopt_lock);
-		m_CurrentActionTime += time_delta;
+		m_ActionCursor.Advance(time_delta);
 		this->MapCurrentFrameForUpdate();
 
+		// global data is rebuilt below, for the changed subtrees only
 		if (m_pCurrentAction != nullptr)
-			m_pCurrentAction->GetFrameAt(m_CurrentFrame, m_CurrentActionTime);
+			m_pCurrentAction->GetFrameAt(m_CurrentFrame, m_ActionCursor, false);
 		//ScaleFrame(m_CurrentFrame, Armature().bind_frame(), 0.95);
 		//m_CurrentFrame.RebuildGlobal(Armature());
 		this->ReleaseCurrentFrameFrorUpdate();
 	}
 
-	if (m_IsAutoDisplacement)
+	m_UpdateCounters = UpdateCounters{ 0, 0 };
+	if (m_pArmature && m_DirtyBones.any())
 	{
+		m_UpdateCounters.GlobalBones = FrameRebuildGlobal(*m_pArmature, m_CurrentFrame, m_DirtyBones);
+		m_DirtyMatrices |= m_DirtyBones;
+		m_DirtyBones.reset();
+	}
+
+	if (m_IsAutoDisplacement)
 		ComputeVelocityFrame(time_delta);
-		DisplaceByVelocityFrame();
+
+	if (m_pSkinModel && m_DirtyMatrices.any())
+	{
+		auto pBones = m_EvaluatedBoneTransforms.data();
+		m_UpdateCounters.SkinningMatrices = FrameTransformMatrix(pBones, Armature().bind_frame(), m_CurrentFrame, m_DirtyMatrices, m_pSkinModel->GetBonesCount());
+		m_DirtyMatrices.reset();
+		m_BoneTransformsPending = true;
 	}
+	m_AnimationEvaluated = true;
+}
+
+void CharacterObject::Update(time_seconds const & time_delta)
+{
+	SceneObject::Update(time_delta);
+	if (!m_AnimationEvaluated)
+		EvaluateAnimation(time_delta);
+	m_AnimationEvaluated = false;
+
+	// moves the scene transform, stays on the scene thread
+	if (m_IsAutoDisplacement)
+		DisplaceByVelocityFrame();
 
-	if (m_pSkinModel && m_FrameDirty)
+	if (m_BoneTransformsPending)
 	{
-		auto pBones = m_BoneTransforms.data();
-		FrameTransformMatrix(pBones, Armature().bind_frame(), m_CurrentFrame, m_pSkinModel->GetBonesCount());
-		m_FrameDirty = false;
+		std::copy(m_EvaluatedBoneTransforms.begin(), m_EvaluatedBoneTransforms.end(), m_BoneTransforms.begin());
+		m_BoneTransformsPending = false;
 	}
 }
 
@@ -328,7 +365,9 @@ CharacterObject::CharacterObject()
 	m_pBehavier = nullptr;
 	m_pArmature = nullptr;
 	m_pLastAction = nullptr;
-	m_FrameDirty = false;
+	m_UpdateCounters = UpdateCounters{ 0, 0 };
+	m_AnimationEvaluated = false;
+	m_BoneTransformsPending = false;
 }
 
 
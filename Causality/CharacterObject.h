@@ -9,12 +9,19 @@
 namespace Causality
 {
 	// Represent an Character that have intrinsic animation
-	class CharacterObject : public VisualObject
+	class CharacterObject : public VisualObject, public IAnimated
 	{
 	public:
 		typedef BehavierSpace::frame_type frame_type;
 		typedef vector<BoneVelocity, DirectX::XMAllocator> velocity_frame_type;
 
+		// Number of bones recomputed by the last Update
+		struct UpdateCounters
+		{
+			size_t	GlobalBones;		// bones whose global data was rebuilt
+			size_t	SkinningMatrices;	// bones whose skinning matrix was rebuilt
+		};
+
 		CharacterObject();
 		~CharacterObject();
 
@@ -23,8 +30,11 @@ namespace Causality
 		void							EnabeAutoDisplacement(bool is_enable);
 
 		const frame_type&				GetCurrentFrame() const;
+		// Write the local data of the mapped frame, bones whose local data changed are found on release
+		// and only their subtrees are rebuilt by the next Update
 		frame_type&						MapCurrentFrameForUpdate();
 		void							ReleaseCurrentFrameFrorUpdate();
+		const UpdateCounters&			GetUpdateCounters() const;
 
 		IArmature&						Armature();
 		const IArmature&				Armature() const;
@@ -43,6 +53,9 @@ namespace Causality
 
 		virtual void					SetRenderModel(DirectX::Scene::IModelNode* pMesh, int LoD = 0) override;
 
+		// Sampling, FK and skinning matrices into the character's own buffers, safe to run concurrently with other characters
+		virtual void					EvaluateAnimation(time_seconds const& time_delta) override;
+		// Publish the evaluated bone transforms and displace the character, evaluates first if the scene pass did not
 		virtual void					Update(time_seconds const& time_delta) override;
 
 		// Inherited via IVisual
@@ -60,16 +73,18 @@ namespace Causality
 	private:
 		ISkinningModel*							m_pSkinModel;
 
-		std::vector<Matrix4x4,
+		typedef std::vector<Matrix4x4,
 			AlignedAllocator<Matrix4x4, alignof(XMVECTOR) >>
-												m_BoneTransforms;
+												bone_transforms_type;
+		bone_transforms_type					m_BoneTransforms;			// published, read by Render
+		bone_transforms_type					m_EvaluatedBoneTransforms;	// written by EvaluateAnimation
 
 
 		BehavierSpace*					        m_pBehavier;
 		IArmature*								m_pArmature;
 		BehavierSpace::animation_type*			m_pCurrentAction;
 		BehavierSpace::animation_type*			m_pLastAction;
-		time_seconds							m_CurrentActionTime;
+		AnimationCursor							m_ActionCursor;
 		bool									m_LoopCurrentAction;
 		LowPassFilter<float>					m_SpeedFilter;
 
@@ -81,7 +96,11 @@ namespace Causality
 
 		std::mutex								m_ActionMutex;
 		std::atomic_bool						m_UpdateLock;
-		bool									m_FrameDirty;
+		BoneDirtyMask							m_DirtyBones;		// local data changed, global data is stale
+		BoneDirtyMask							m_DirtyMatrices;	// global data changed, bone transform is stale
+		UpdateCounters							m_UpdateCounters;
+		bool									m_AnimationEvaluated;
+		bool									m_BoneTransformsPending;
 		bool									m_IsAutoDisplacement;
 	};
 
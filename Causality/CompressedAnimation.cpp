@@ -0,0 +1,432 @@
+#include "pch_bcl.h"
+#include "CompressedAnimation.h"
+#include "FrameLanes.h"
+#include <algorithm>
+#include <limits>
+
+using namespace DirectX;
+using namespace Causality;
+
+namespace
+{
+	typedef Internal::FrameLanes FrameLanes;
+
+	const int BoneStride = sizeof(Bone) / sizeof(float);
+	const int LclRotationOffset = offsetof(Bone, LclRotation) / sizeof(float);
+	const int LclTranslationOffset = offsetof(Bone, LclTranslation) / sizeof(float);
+	const int LclScalingOffset = offsetof(Bone, LclScaling) / sizeof(float);
+
+	// tracks are padded to this many, so the AVX2 decompressor always runs whole lanes
+	const size_t TrackAlignment = 8;
+	static_assert(TrackAlignment % FrameLanes::width == 0, "padding must cover whole lanes");
+
+	// smallest-three : the three smaller components of a unit quaternion lie in [-1/sqrt(2), 1/sqrt(2)]
+	const float SmallestThreeRange = 0.707106781f;
+	const float RotationQuantizeMax = 32767.0f;
+	const float LinearQuantizeMax = 65535.0f;
+	// angle bound of a quantized rotation : three components off by half a step, the derived largest one by about four times that
+	const float RotationQuantizeError = 10.0f * SmallestThreeRange / RotationQuantizeMax;
+
+	inline const float* Component(const Bone& bone, int offset) { return reinterpret_cast<const float*>(&bone) + offset; }
+
+	// rotation angle between two unit quaternions, from the chord |a - b| = 2 sin(angle / 4), acos of the dot product is too coarse for small angles
+	float RotationError(const float* a, const float* b)
+	{
+		float s = a[0] * b[0] + a[1] * b[1] + a[2] * b[2] + a[3] * b[3] < 0 ? -1.0f : 1.0f;
+		float c = 0;
+		for (int i = 0; i < 4; i++)
+			c += (a[i] - s * b[i]) * (a[i] - s * b[i]);
+		return 4.0f * std::asin(std::min(std::sqrt(c) * 0.5f, 1.0f));
+	}
+
+	float LinearError(const float* a, const float* b)
+	{
+		return std::max(std::max(std::abs(a[0] - b[0]), std::abs(a[1] - b[1])), std::abs(a[2] - b[2]));
+	}
+
+	// nlerp with the shortest path, same as the decompressor
+	void RotationLerp(float* out, const float* a, const float* b, float t)
+	{
+		float d = a[0] * b[0] + a[1] * b[1] + a[2] * b[2] + a[3] * b[3];
+		float w1 = d < 0 ? -t : t;
+		float l = 0;
+		for (int c = 0; c < 4; c++)
+		{
+			out[c] = a[c] * (1.0f - t) + b[c] * w1;
+			l += out[c] * out[c];
+		}
+		l = 1.0f / std::sqrt(l);
+		for (int c = 0; c < 4; c++)
+			out[c] *= l;
+	}
+
+	struct ChannelTracks
+	{
+		int offset;
+		float tolerance;
+		std::vector<size_t> bones;
+		bool rotation;
+		// tolerance left to the key reduction after the quantization error of the keys
+		float budget;
+
+		float error(const float* a, const float* b) const { return rotation ? RotationError(a, b) : LinearError(a, b); }
+	};
+
+	// can frames (first, last) be reproduced by interpolating the two ends
+	bool SegmentFits(const std::vector<ArmatureFrame>& frames, size_t first, size_t last, const ChannelTracks* channels, size_t channelCount)
+	{
+		for (size_t m = first + 1; m < last; m++)
+		{
+			float t = float(m - first) / float(last - first);
+			for (size_t c = 0; c < channelCount; c++)
+			{
+				auto& channel = channels[c];
+				for (auto bone : channel.bones)
+				{
+					const float* a = Component(frames[first][bone], channel.offset);
+					const float* b = Component(frames[last][bone], channel.offset);
+					float v[4];
+					if (channel.rotation)
+						RotationLerp(v, a, b, t);
+					else
+						for (int k = 0; k < 3; k++)
+							v[k] = a[k] + (b[k] - a[k]) * t;
+
+					if (channel.error(v, Component(frames[m][bone], channel.offset)) > channel.budget)
+						return false;
+				}
+			}
+		}
+		return true;
+	}
+
+	// greedy reduction, every key extends as far as the interpolation stays within the tolerances
+	std::vector<uint32_t> SelectKeyFrames(const std::vector<ArmatureFrame>& frames, const ChannelTracks* channels, size_t channelCount, bool reduce)
+	{
+		size_t n = frames.size();
+		std::vector<uint32_t> keys;
+		keys.reserve(n);
+		if (!reduce)
+		{
+			for (size_t i = 0; i < n; i++)
+				keys.push_back(static_cast<uint32_t>(i));
+			return keys;
+		}
+
+		keys.push_back(0);
+		for (size_t i = 0; i + 1 < n;)
+		{
+			size_t j = i + 1;
+			while (j + 1 < n && SegmentFits(frames, i, j + 1, channels, channelCount))
+				++j;
+			keys.push_back(static_cast<uint32_t>(j));
+			i = j;
+		}
+		return keys;
+	}
+
+	void PadTracks(std::vector<int>& bones)
+	{
+		size_t padded = (bones.size() + TrackAlignment - 1) / TrackAlignment * TrackAlignment;
+		if (!bones.empty())
+			bones.resize(padded, bones.back());
+	}
+
+	inline uint16_t Quantize(float v, float scale, float max)
+	{
+		return static_cast<uint16_t>(std::min(std::max(std::floor(v * scale + 0.5f), .0f), max));
+	}
+
+	// the 2-bit index of the largest component goes to the top bits of a and b, the largest component is made positive
+	void EncodeRotation(const float* q, uint16_t* a, uint16_t* b, uint16_t* c)
+	{
+		float l = 1.0f / std::sqrt(q[0] * q[0] + q[1] * q[1] + q[2] * q[2] + q[3] * q[3]);
+		int largest = 0;
+		for (int i = 1; i < 4; i++)
+			if (std::abs(q[i]) > std::abs(q[largest]))
+				largest = i;
+		if (q[largest] < 0)
+			l = -l;
+
+		uint16_t v[3];
+		const float scale = RotationQuantizeMax / (2.0f * SmallestThreeRange);
+		for (int i = 0, k = 0; i < 4; i++)
+			if (i != largest)
+				v[k++] = Quantize(q[i] * l + SmallestThreeRange, scale, RotationQuantizeMax);
+
+		*a = v[0] | static_cast<uint16_t>((largest & 1) << 15);
+		*b = v[1] | static_cast<uint16_t>((largest >> 1) << 15);
+		*c = v[2];
+	}
+
+	template <class L>
+	inline void DecodeRotation(typename L::type q[4], const uint16_t* a, const uint16_t* b, const uint16_t* c)
+	{
+		typedef typename L::type V;
+		V zero = L::set1(.0f), one = L::set1(1.0f), two = L::set1(2.0f), three = L::set1(3.0f);
+		V high = L::set1(32768.0f);
+
+		V va = L::load_u16(a), vb = L::load_u16(b), vc = L::load_u16(c);
+		auto ha = L::greater_equal(va, high);
+		auto hb = L::greater_equal(vb, high);
+		va = L::select(ha, L::sub(va, high), va);
+		vb = L::select(hb, L::sub(vb, high), vb);
+		V index = L::add(L::select(ha, one, zero), L::select(hb, two, zero));
+
+		V scale = L::set1(2.0f * SmallestThreeRange / RotationQuantizeMax), bias = L::set1(-SmallestThreeRange);
+		V x0 = L::madd(va, scale, bias), x1 = L::madd(vb, scale, bias), x2 = L::madd(vc, scale, bias);
+		V d = L::sqrt(L::max(zero, L::nmadd(x2, x2, L::nmadd(x1, x1, L::nmadd(x0, x0, one)))));
+
+		auto i0 = L::equal(index, zero), i1 = L::equal(index, one), i2 = L::equal(index, two), i3 = L::equal(index, three);
+		q[0] = L::select(i0, d, x0);
+		q[1] = L::select(i0, x0, L::select(i1, d, x1));
+		q[2] = L::select(i3, x2, L::select(i2, d, x1));
+		q[3] = L::select(i3, d, x2);
+	}
+
+	// nlerp the rotation tracks between two keys and write them to the frame
+	template <class L>
+	void DecodeRotations(float* frame, const std::vector<int>& bones, const uint16_t* key0, const uint16_t* key1, float t)
+	{
+		typedef typename L::type V;
+		size_t n = bones.size();
+		V one = L::set1(1.0f), w0 = L::set1(1.0f - t), vt = L::set1(t);
+		for (size_t i = 0; i < n; i += L::width)
+		{
+			V a[4], b[4];
+			DecodeRotation<L>(a, key0 + i, key0 + n + i, key0 + 2 * n + i);
+			DecodeRotation<L>(b, key1 + i, key1 + n + i, key1 + 2 * n + i);
+
+			V d = L::madd(a[3], b[3], L::madd(a[2], b[2], L::madd(a[1], b[1], L::mul(a[0], b[0]))));
+			V w1 = L::mul(vt, L::sign(d));
+			V q[4];
+			for (int c = 0; c < 4; c++)
+				q[c] = L::madd(b[c], w1, L::mul(a[c], w0));
+			V l = L::div(one, L::sqrt(L::madd(q[3], q[3], L::madd(q[2], q[2], L::madd(q[1], q[1], L::mul(q[0], q[0]))))));
+			for (int c = 0; c < 4; c++)
+				L::scatter(frame + LclRotationOffset + c, bones.data() + i, L::mul(q[c], l));
+		}
+	}
+
+	// lerp the translation or scaling tracks between two keys and write them to the frame
+	template <class L>
+	void DecodeLinear(float* frame, int offset, const std::vector<int>& bones, const float* range, const uint16_t* key0, const uint16_t* key1, float t)
+	{
+		typedef typename L::type V;
+		size_t n = bones.size();
+		V vt = L::set1(t);
+		for (int c = 0; c < 3; c++)
+		{
+			for (size_t i = 0; i < n; i += L::width)
+			{
+				V min = L::load(range + c * n + i), step = L::load(range + (3 + c) * n + i);
+				V v0 = L::madd(L::load_u16(key0 + c * n + i), step, min);
+				V v1 = L::madd(L::load_u16(key1 + c * n + i), step, min);
+				L::scatter(frame + offset + c, bones.data() + i, L::madd(L::sub(v1, v0), vt, v0));
+			}
+		}
+	}
+}
+
+CompressedArmatureClip::CompressedArmatureClip()
+{
+	Clear();
+}
+
+void CompressedArmatureClip::Clear()
+{
+	m_frameCount = 0;
+	m_keyStride = 0;
+	m_keyFrames.clear();
+	m_constants.clear();
+	for (auto tracks : { &m_rotations, &m_translations, &m_scalings })
+	{
+		tracks->count = 0;
+		tracks->bones.clear();
+	}
+	m_translationRange.clear();
+	m_scalingRange.clear();
+	m_keyData.clear();
+}
+
+void CompressedArmatureClip::Compress(const std::vector<ArmatureFrame>& frames, const AnimationCompressionOptions& options)
+{
+	Clear();
+	if (frames.empty() || frames[0].empty())
+		return;
+
+	size_t frameCount = frames.size(), boneCount = frames[0].size();
+
+	m_constants.resize(boneCount);
+	for (size_t i = 0; i < boneCount; i++)
+		m_constants[i] = frames[0][i].LocalTransform();
+
+	// constant channel elimination, a channel is animated once any frame leaves the tolerance of the first one
+	ChannelTracks channels[3] = {
+		{ LclRotationOffset, options.RotationTolerance, {}, true },
+		{ LclTranslationOffset, options.TranslationTolerance, {}, false },
+		{ LclScalingOffset, options.ScalingTolerance, {}, false },
+	};
+	for (auto& channel : channels)
+	{
+		for (size_t bone = 0; bone < boneCount; bone++)
+		{
+			const float* first = Component(frames[0][bone], channel.offset);
+			for (size_t f = 1; f < frameCount; f++)
+			{
+				assert(frames[f].size() == boneCount);
+				if (channel.error(first, Component(frames[f][bone], channel.offset)) > channel.tolerance)
+				{
+					channel.bones.push_back(bone);
+					break;
+				}
+			}
+		}
+	}
+
+	// half a quantization step of the widest track, the keys only span a part of the frames' range
+	for (auto& channel : channels)
+	{
+		float error = .0f;
+		if (channel.rotation)
+			error = channel.bones.empty() ? .0f : RotationQuantizeError;
+		else
+		{
+			for (auto bone : channel.bones)
+			{
+				for (int k = 0; k < 3; k++)
+				{
+					float vmin = std::numeric_limits<float>::max(), vmax = std::numeric_limits<float>::lowest();
+					for (auto& frame : frames)
+					{
+						vmin = std::min(vmin, Component(frame[bone], channel.offset)[k]);
+						vmax = std::max(vmax, Component(frame[bone], channel.offset)[k]);
+					}
+					error = std::max(error, 0.5f * (vmax - vmin) / LinearQuantizeMax);
+				}
+			}
+		}
+		channel.budget = std::max(channel.tolerance - error, .0f);
+	}
+
+	m_keyFrames = SelectKeyFrames(frames, channels, 3, options.ReduceKeyframes);
+	m_frameCount = frameCount;
+
+	TrackSet* sets[3] = { &m_rotations, &m_translations, &m_scalings };
+	for (int c = 0; c < 3; c++)
+	{
+		sets[c]->count = channels[c].bones.size();
+		for (auto bone : channels[c].bones)
+			sets[c]->bones.push_back(static_cast<int>(bone) * BoneStride);
+		PadTracks(sets[c]->bones);
+	}
+
+	// per track range of translation and scaling
+	range_array* ranges[2] = { &m_translationRange, &m_scalingRange };
+	for (int c = 1; c < 3; c++)
+	{
+		auto& bones = sets[c]->bones;
+		auto& range = *ranges[c - 1];
+		size_t n = bones.size();
+		range.assign(6 * n, .0f);
+		for (size_t i = 0; i < n; i++)
+		{
+			for (int k = 0; k < 3; k++)
+			{
+				float vmin = std::numeric_limits<float>::max(), vmax = std::numeric_limits<float>::lowest();
+				for (auto key : m_keyFrames)
+				{
+					float v = reinterpret_cast<const float*>(frames[key].data())[bones[i] + channels[c].offset + k];
+					vmin = std::min(vmin, v);
+					vmax = std::max(vmax, v);
+				}
+				range[k * n + i] = vmin;
+				range[(3 + k) * n + i] = (vmax - vmin) / LinearQuantizeMax;
+			}
+		}
+	}
+
+	size_t nr = m_rotations.padded(), nt = m_translations.padded(), ns = m_scalings.padded();
+	m_keyStride = 3 * (nr + nt + ns);
+	m_keyData.resize(m_keyStride * m_keyFrames.size());
+
+	for (size_t k = 0; k < m_keyFrames.size(); k++)
+	{
+		const float* frame = reinterpret_cast<const float*>(frames[m_keyFrames[k]].data());
+		uint16_t* key = m_keyData.data() + k * m_keyStride;
+
+		for (size_t i = 0; i < nr; i++)
+			EncodeRotation(frame + m_rotations.bones[i] + LclRotationOffset, key + i, key + nr + i, key + 2 * nr + i);
+		key += 3 * nr;
+
+		for (int c = 1; c < 3; c++)
+		{
+			auto& bones = sets[c]->bones;
+			auto& range = *ranges[c - 1];
+			size_t n = bones.size();
+			for (int j = 0; j < 3; j++)
+			{
+				for (size_t i = 0; i < n; i++)
+				{
+					float step = range[(3 + j) * n + i];
+					float v = frame[bones[i] + channels[c].offset + j] - range[j * n + i];
+					key[j * n + i] = step > 0 ? Quantize(v, 1.0f / step, LinearQuantizeMax) : 0;
+				}
+			}
+			key += 3 * n;
+		}
+	}
+}
+
+size_t CompressedArmatureClip::byte_size() const
+{
+	return sizeof(*this)
+		+ m_keyFrames.size() * sizeof(uint32_t)
+		+ m_constants.size() * sizeof(IsometricTransform)
+		+ (m_rotations.padded() + m_translations.padded() + m_scalings.padded()) * sizeof(int)
+		+ (m_translationRange.size() + m_scalingRange.size()) * sizeof(float)
+		+ m_keyData.size() * sizeof(uint16_t);
+}
+
+template <class L>
+void CompressedArmatureClip::SampleLanes(ArmatureFrameView out, double framePosition) const
+{
+	if (empty())
+		return;
+	assert(out.size() >= bones());
+
+	double n = static_cast<double>(m_frameCount);
+	double position = std::fmod(framePosition, n);
+	if (position < 0)
+		position += n;
+
+	// the last key interpolates to the first one at frames()
+	size_t k0 = std::upper_bound(m_keyFrames.begin(), m_keyFrames.end(), static_cast<uint32_t>(position)) - m_keyFrames.begin() - 1;
+	size_t k1 = k0 + 1 < m_keyFrames.size() ? k0 + 1 : 0;
+	double f0 = m_keyFrames[k0], f1 = k1 > 0 ? m_keyFrames[k1] : n;
+	float t = static_cast<float>((position - f0) / (f1 - f0));
+
+	for (size_t i = 0; i < m_constants.size(); i++)
+		out[i].LocalTransform() = m_constants[i];
+
+	float* frame = reinterpret_cast<float*>(out.data());
+	const uint16_t* key0 = m_keyData.data() + k0 * m_keyStride;
+	const uint16_t* key1 = m_keyData.data() + k1 * m_keyStride;
+
+	size_t nr = m_rotations.padded(), nt = m_translations.padded();
+	DecodeRotations<L>(frame, m_rotations.bones, key0, key1, t);
+	key0 += 3 * nr, key1 += 3 * nr;
+	DecodeLinear<L>(frame, LclTranslationOffset, m_translations.bones, m_translationRange.data(), key0, key1, t);
+	key0 += 3 * nt, key1 += 3 * nt;
+	DecodeLinear<L>(frame, LclScalingOffset, m_scalings.bones, m_scalingRange.data(), key0, key1, t);
+}
+
+void CompressedArmatureClip::Sample(ArmatureFrameView out, double framePosition) const
+{
+	SampleLanes<FrameLanes>(out, framePosition);
+}
+
+void CompressedArmatureClip::SampleScalar(ArmatureFrameView out, double framePosition) const
+{
+	SampleLanes<Internal::ScalarLanes>(out, framePosition);
+}
@@ -0,0 +1,90 @@
+#pragma once
+#include "Armature.h"
+#include <cstdint>
+#include <vector>
+
+namespace Causality
+{
+	struct AnimationCompressionOptions
+	{
+		// max angle in radians a rotation channel may deviate from the source
+		float	RotationTolerance;
+		// max component wise error of the translation / scaling channels
+		float	TranslationTolerance;
+		float	ScalingTolerance;
+		// drop the frames that their neighbouring keys reproduce within the tolerances
+		bool	ReduceKeyframes;
+
+		AnimationCompressionOptions()
+			: RotationTolerance(1e-3f), TranslationTolerance(1e-3f), ScalingTolerance(1e-3f), ReduceKeyframes(false)
+		{}
+	};
+
+	// Compressed local data of a cyclic, uniformly sampled armature clip
+	// Rotations are smallest-three quantized to 48 bits, translations and scalings to 16 bits per component inside a per bone range,
+	// channels that stay within the tolerance of their first value are stored once as raw floats.
+	// Key data is planar per key (one uint16 array per component), so the decompressor runs 8 tracks per step with AVX2
+	class CompressedArmatureClip
+	{
+	public:
+		CompressedArmatureClip();
+
+		// frames must all have the same size, the last frame interpolates back to the first one
+		void Compress(const std::vector<ArmatureFrame>& frames, const AnimationCompressionOptions& options = AnimationCompressionOptions());
+		void Clear();
+
+		bool empty() const { return m_frameCount == 0; }
+		// bones per frame
+		size_t bones() const { return m_constants.size(); }
+		// frames of the source clip
+		size_t frames() const { return m_frameCount; }
+		// stored key frames, equals frames() without keyframe reduction
+		size_t keys() const { return m_keyFrames.size(); }
+		size_t animated_rotations() const { return m_rotations.count; }
+		size_t animated_translations() const { return m_translations.count; }
+		size_t animated_scalings() const { return m_scalings.count; }
+		// memory footprint of the compressed data
+		size_t byte_size() const;
+
+		// Write the local data at a fractional frame position of the source clip, the position wraps around frames()
+		// Only the local fields of out are written, call FrameRebuildGlobal for the global data
+		void Sample(ArmatureFrameView out, double framePosition) const;
+		// Sample with the one bone per step decoder, the AVX2 decoder of Sample matches it up to rounding
+		void SampleScalar(ArmatureFrameView out, double framePosition) const;
+
+	private:
+		template <class L>
+		void SampleLanes(ArmatureFrameView out, double framePosition) const;
+
+		typedef std::vector<float, DirectX::AlignedAllocator<float, 32>>		range_array;
+		typedef std::vector<uint16_t, DirectX::AlignedAllocator<uint16_t, 32>>	key_array;
+
+		size_t					m_frameCount;
+		// source frame index of each key, ascending, starts with 0
+		std::vector<uint32_t>	m_keyFrames;
+		// the first frame, with the constant channels of every bone
+		IsometricTransformFrame	m_constants;
+
+		struct TrackSet
+		{
+			// number of animated tracks
+			size_t				count;
+			// float offset of each track's bone in a frame, padded to whole lanes by repeating the last track
+			std::vector<int>	bones;
+
+			size_t padded() const { return bones.size(); }
+		};
+
+		TrackSet				m_rotations;
+		TrackSet				m_translations;
+		TrackSet				m_scalings;
+
+		// planar [min.x, min.y, min.z, step.x, step.y, step.z] of the padded tracks, step = extent / 65535
+		range_array				m_translationRange;
+		range_array				m_scalingRange;
+
+		// per key : rotation a, b, c planes, translation x, y, z planes, scaling x, y, z planes
+		key_array				m_keyData;
+		size_t					m_keyStride;
+	};
+}
@@ -0,0 +1,181 @@
+#pragma once
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <new>
+#if defined(_MSC_VER)
+#include <malloc.h>
+#endif
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+namespace Causality
+{
+	namespace Internal
+	{
+		// Lane operations of the bone kernels, one bone per lane
+		// The kernels are written once against these and run 8 bones per step with AVX2, one bone per step otherwise
+		struct ScalarLanes
+		{
+			typedef float type;
+			typedef bool mask_type;
+			static const size_t width = 1;
+
+			static type load(const float* p) { return *p; }
+			// unsigned 16 bit integers converted to float
+			static type load_u16(const uint16_t* p) { return static_cast<float>(*p); }
+			static type loadu(const float* p) { return *p; }
+			static void store(float* p, type v) { *p = v; }
+			// base[offsets[k]] of each lane k
+			static type gather(const float* base, const int* offsets) { return base[*offsets]; }
+			static void scatter(float* base, const int* offsets, type v) { base[*offsets] = v; }
+			static type set1(float s) { return s; }
+			static type add(type a, type b) { return a + b; }
+			static type sub(type a, type b) { return a - b; }
+			static type mul(type a, type b) { return a * b; }
+			static type madd(type a, type b, type c) { return a * b + c; }
+			// c - a * b
+			static type nmadd(type a, type b, type c) { return c - a * b; }
+			static type div(type a, type b) { return a / b; }
+			static type sqrt(type a) { return std::sqrt(a); }
+			// +1.0 or -1.0 by the sign bit of a
+			static type sign(type a) { return std::signbit(a) ? -1.0f : 1.0f; }
+			static type max(type a, type b) { return a > b ? a : b; }
+			static mask_type equal(type a, type b) { return a == b; }
+			static mask_type greater_equal(type a, type b) { return a >= b; }
+			// a where mask is set, b otherwise
+			static type select(mask_type mask, type a, type b) { return mask ? a : b; }
+			// transpose 4 lanes vectors into count rows of 4 floats, row k = (a[k], b[k], c[k], d[k]) at p + k * stride
+			static void store_rows4(float* p, size_t /*stride*/, size_t count, type a, type b, type c, type d)
+			{
+				if (count == 0)
+					return;
+				p[0] = a; p[1] = b; p[2] = c; p[3] = d;
+			}
+			// order the store_rows4 stores before later stores
+			static void fence() {}
+		};
+
+#if defined(__AVX2__)
+		struct Avx2Lanes
+		{
+			typedef __m256 type;
+			typedef __m256 mask_type;
+			static const size_t width = 8;
+
+			static type load(const float* p) { return _mm256_load_ps(p); }
+			static type load_u16(const uint16_t* p) { return _mm256_cvtepi32_ps(_mm256_cvtepu16_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(p)))); }
+			static type loadu(const float* p) { return _mm256_loadu_ps(p); }
+			static void store(float* p, type v) { _mm256_store_ps(p, v); }
+			static type gather(const float* base, const int* offsets) { return _mm256_i32gather_ps(base, _mm256_loadu_si256(reinterpret_cast<const __m256i*>(offsets)), 4); }
+			static void scatter(float* base, const int* offsets, type v)
+			{
+				alignas(32) float lanes[8];
+				_mm256_store_ps(lanes, v);
+				for (size_t k = 0; k < 8; k++)
+					base[offsets[k]] = lanes[k];
+			}
+			static type set1(float s) { return _mm256_set1_ps(s); }
+			static type add(type a, type b) { return _mm256_add_ps(a, b); }
+			static type sub(type a, type b) { return _mm256_sub_ps(a, b); }
+			static type mul(type a, type b) { return _mm256_mul_ps(a, b); }
+			static type madd(type a, type b, type c) { return _mm256_fmadd_ps(a, b, c); }
+			static type nmadd(type a, type b, type c) { return _mm256_fnmadd_ps(a, b, c); }
+			static type div(type a, type b) { return _mm256_div_ps(a, b); }
+			static type sqrt(type a) { return _mm256_sqrt_ps(a); }
+			static type sign(type a) { return _mm256_or_ps(_mm256_and_ps(a, _mm256_set1_ps(-0.0f)), _mm256_set1_ps(1.0f)); }
+			static type max(type a, type b) { return _mm256_max_ps(a, b); }
+			static mask_type equal(type a, type b) { return _mm256_cmp_ps(a, b, _CMP_EQ_OQ); }
+			static mask_type greater_equal(type a, type b) { return _mm256_cmp_ps(a, b, _CMP_GE_OQ); }
+			static type select(mask_type mask, type a, type b) { return _mm256_blendv_ps(b, a, mask); }
+			// rows are written with non-temporal stores when p and stride keep them 16-byte aligned
+			static void store_rows4(float* p, size_t stride, size_t count, type a, type b, type c, type d)
+			{
+				__m256 t0 = _mm256_unpacklo_ps(a, b), t1 = _mm256_unpackhi_ps(a, b);
+				__m256 t2 = _mm256_unpacklo_ps(c, d), t3 = _mm256_unpackhi_ps(c, d);
+				// rows k and k + 4 share one register
+				__m256 r[4] = {
+					_mm256_shuffle_ps(t0, t2, _MM_SHUFFLE(1, 0, 1, 0)), _mm256_shuffle_ps(t0, t2, _MM_SHUFFLE(3, 2, 3, 2)),
+					_mm256_shuffle_ps(t1, t3, _MM_SHUFFLE(1, 0, 1, 0)), _mm256_shuffle_ps(t1, t3, _MM_SHUFFLE(3, 2, 3, 2)) };
+				bool aligned = ((reinterpret_cast<uintptr_t>(p) | stride * sizeof(float)) & 15) == 0;
+				for (size_t k = 0; k < count && k < 8; k++)
+				{
+					__m128 row = k < 4 ? _mm256_castps256_ps128(r[k]) : _mm256_extractf128_ps(r[k - 4], 1);
+					if (aligned)
+						_mm_stream_ps(p + k * stride, row);
+					else
+						_mm_storeu_ps(p + k * stride, row);
+				}
+			}
+			static void fence() { _mm_sfence(); }
+		};
+
+		typedef Avx2Lanes FrameLanes;
+#else
+		typedef ScalarLanes FrameLanes;
+#endif
+
+		// Allocator of Alignment aligned storage for lane planes, without a DirectX dependency
+		template <class T, size_t Alignment>
+		struct LaneAllocator
+		{
+			typedef T value_type;
+			template <class U> struct rebind { typedef LaneAllocator<U, Alignment> other; };
+
+			LaneAllocator() {}
+			template <class U> LaneAllocator(const LaneAllocator<U, Alignment>&) {}
+
+			T* allocate(size_t n)
+			{
+				void* p = nullptr;
+#if defined(_MSC_VER)
+				p = _aligned_malloc(n * sizeof(T), Alignment);
+#else
+				if (posix_memalign(&p, Alignment, n * sizeof(T)) != 0)
+					p = nullptr;
+#endif
+				if (p == nullptr)
+					throw std::bad_alloc();
+				return static_cast<T*>(p);
+			}
+
+			void deallocate(T* p, size_t)
+			{
+#if defined(_MSC_VER)
+				_aligned_free(p);
+#else
+				free(p);
+#endif
+			}
+
+			template <class U> bool operator==(const LaneAllocator<U, Alignment>&) const { return true; }
+			template <class U> bool operator!=(const LaneAllocator<U, Alignment>&) const { return false; }
+		};
+
+		// XMQuaternionMultiply(q1, q2) in lanes
+		template <class L>
+		inline void QuaternionMultiplyLanes(typename L::type out[4], const typename L::type q1[4], const typename L::type q2[4])
+		{
+			out[0] = L::nmadd(q2[2], q1[1], L::madd(q2[1], q1[2], L::madd(q2[0], q1[3], L::mul(q2[3], q1[0]))));
+			out[1] = L::madd(q2[2], q1[0], L::madd(q2[1], q1[3], L::nmadd(q2[0], q1[2], L::mul(q2[3], q1[1]))));
+			out[2] = L::madd(q2[2], q1[3], L::nmadd(q2[1], q1[0], L::madd(q2[0], q1[1], L::mul(q2[3], q1[2]))));
+			out[3] = L::nmadd(q2[2], q1[2], L::nmadd(q2[1], q1[1], L::nmadd(q2[0], q1[0], L::mul(q2[3], q1[3]))));
+		}
+
+		// XMVector3Rotate(v, q) in lanes, v + w * t + u x t with t = 2 * (u x v)
+		template <class L>
+		inline void RotateLanes(typename L::type v[3], const typename L::type q[4])
+		{
+			typedef typename L::type V;
+			V two = L::set1(2.0f);
+			V tx = L::mul(two, L::nmadd(q[2], v[1], L::mul(q[1], v[2])));
+			V ty = L::mul(two, L::nmadd(q[0], v[2], L::mul(q[2], v[0])));
+			V tz = L::mul(two, L::nmadd(q[1], v[0], L::mul(q[0], v[1])));
+			v[0] = L::add(L::madd(q[3], tx, v[0]), L::nmadd(q[2], ty, L::mul(q[1], tz)));
+			v[1] = L::add(L::madd(q[3], ty, v[1]), L::nmadd(q[0], tz, L::mul(q[2], tx)));
+			v[2] = L::add(L::madd(q[3], tz, v[2]), L::nmadd(q[1], tx, L::mul(q[0], ty)));
+		}
+	}
+}
@@ -0,0 +1,376 @@
+#include "pch_bcl.h"
+#include <Geometrics\MeshNormals.h>
+#include <Geometrics\CurveCollection.h>
+#include <Geometrics\Extrusion.h>
+#include <Geometrics\MeshFile.h>
+#include <cstdio>
+#include <functional>
+#include <iostream>
+#include <random>
+#include "Tests.h"
+
+using namespace DirectX;
+using namespace Geometrics;
+using namespace std;
+
+namespace Causality
+{
+	namespace
+	{
+		typedef VertexPositionNormalTangentColorTexture TangentVertex;
+
+		// wavy grid of size x size quads, mirrored flips u so the tangent frames are left handed
+		void make_tangent_grid(vector<TangentVertex>& vertices, vector<Triangle<uint16_t>>& facets, int size, bool mirrored)
+		{
+			uint16_t base = static_cast<uint16_t>(vertices.size());
+			for (int y = 0; y <= size; y++)
+			{
+				for (int x = 0; x <= size; x++)
+				{
+					float u = float(x) / size, v = float(y) / size;
+					TangentVertex vertex;
+					vertex.position = XMFLOAT3(u, v, 0.2f * sinf(6.0f * u) * cosf(4.0f * v));
+					vertex.normal = XMFLOAT3(0, 0, 0);
+					vertex.tangent = XMFLOAT4(0, 0, 0, 0);
+					vertex.color = 0xffffffff;
+					vertex.textureCoordinate = XMFLOAT2(mirrored ? 1.0f - u : u, v);
+					vertices.push_back(vertex);
+				}
+			}
+
+			auto id = [base, size](int x, int y) { return static_cast<uint16_t>(base + y * (size + 1) + x); };
+			for (int y = 0; y < size; y++)
+			{
+				for (int x = 0; x < size; x++)
+				{
+					facets.emplace_back(id(x, y), id(x + 1, y), id(x + 1, y + 1));
+					facets.emplace_back(id(x, y), id(x + 1, y + 1), id(x, y + 1));
+				}
+			}
+		}
+
+		// random walk of count anchors starting at start
+		void make_random_curve(SpaceCurve& curve, XMFLOAT3 start, size_t count, mt19937& rng)
+		{
+			normal_distribution<float> step(.0f, 0.1f);
+			XMVECTOR p = XMLoadFloat3(&start);
+			for (size_t i = 0; i < count; i++)
+			{
+				curve.push_back(p);
+				p += XMVectorSet(step(rng), step(rng), step(rng), .0f);
+			}
+		}
+
+		// closest point over every segment of every curve
+		CurveHit brute_force_closest(const CurveCollection& curves, FXMVECTOR p)
+		{
+			CurveHit best;
+			for (size_t c = 0; c < curves.size(); c++)
+			{
+				for (uint32_t seg = 0; seg + 1 < curves[c].size(); seg++)
+				{
+					auto hit = curves[c].segmentClosestPoint(seg, p);
+					if (hit.distance < best.distance)
+					{
+						best = hit;
+						best.curve = (uint32_t)c;
+					}
+				}
+			}
+			return best;
+		}
+	}
+
+	// parallel_generate_normal must produce the same tangent frames, handedness included, as generate_tangent
+	bool ParallelTangentTest()
+	{
+		vector<TangentVertex> vertices;
+		vector<Triangle<uint16_t>> facets;
+		make_tangent_grid(vertices, facets, 16, false);
+		make_tangent_grid(vertices, facets, 16, true);
+
+		if (!parallel_generate_normal<TangentVertex, uint16_t>(vertices, facets))
+			return false;
+
+		// same normals, tangents from the serial generator
+		auto reference = vertices;
+		for (auto& vertex : reference)
+			vertex.tangent = XMFLOAT4(0, 0, 0, 0);
+		generate_tangent<TangentVertex, uint16_t>(reference, facets);
+
+		size_t mismatches = 0;
+		float maxError = .0f;
+		for (size_t i = 0; i < vertices.size(); i++)
+		{
+			XMVECTOR t = XMLoadFloat4(&vertices[i].tangent);
+			XMVECTOR r = XMLoadFloat4(&reference[i].tangent);
+			float error = XMVectorGetX(XMVector3Length(t - r));
+			maxError = max(maxError, error);
+			if (error > 1e-4f || vertices[i].tangent.w != reference[i].tangent.w)
+				++mismatches;
+		}
+
+		cout << "parallel tangent test : " << vertices.size() << " vertices, max error = " << maxError << ", mismatches = " << mismatches << endl;
+		return mismatches == 0;
+	}
+
+	REGISTER_TEST_METHOD(ParallelTangentTest, ParallelTangentTest);
+
+	// bvh queries of SpaceCurve / CurveCollection against brute force over all segments
+	bool CurveQueryTest()
+	{
+		mt19937 rng(7);
+		vector<SpaceCurve> strokes(4);
+		for (size_t i = 0; i < strokes.size(); i++)
+			make_random_curve(strokes[i], XMFLOAT3(float(i), .0f, .0f), 300, rng);
+
+		CurveCollection curves;
+		for (auto& stroke : strokes)
+			curves.add(&stroke);
+		curves.build();
+
+		size_t failures = 0;
+		uniform_real_distribution<float> uniform(-1.0f, 4.0f);
+		for (int i = 0; i < 200; i++)
+		{
+			XMVECTOR p = XMVectorSet(uniform(rng), uniform(rng) * 0.5f, uniform(rng) * 0.5f, .0f);
+
+			// closest point, parameter included
+			auto hit = curves.closestPoint(p);
+			auto expected = brute_force_closest(curves, p);
+			if (fabsf(hit.distance - expected.distance) > 1e-4f || (hit.curve == expected.curve && hit.segment == expected.segment && fabsf(hit.t - expected.t) > 1e-3f))
+				++failures;
+
+			// every reported segment is within the radius, t is the projection of the center
+			vector<CurveHit> hits;
+			float radius = expected.distance + 0.2f;
+			curves.querySphere(p, radius, hits);
+			bool nearest = false;
+			for (auto& sphereHit : hits)
+			{
+				auto projection = curves[sphereHit.curve].segmentClosestPoint(sphereHit.segment, p);
+				if (sphereHit.distance > radius + 1e-4f || fabsf(sphereHit.t - projection.t) > 1e-4f)
+					++failures;
+				nearest |= sphereHit.curve == expected.curve && sphereHit.segment == expected.segment;
+			}
+			if (!nearest)
+				++failures;
+		}
+
+		// axis parallel rays through an anchor, a zero direction component must not drop the hit
+		const XMVECTOR axes[] = { g_XMIdentityR0.v, g_XMIdentityR1.v, g_XMIdentityR2.v, -g_XMIdentityR2.v };
+		for (int i = 0; i < 50; i++)
+		{
+			auto& stroke = strokes[i % strokes.size()];
+			XMVECTOR anchor = stroke.position(int(i * 5 + 1));
+			XMVECTOR dir = axes[i % 4];
+			auto hit = curves.rayDistance(anchor - dir * 10.0f, dir, 1.0f);
+			if (!hit.valid() || hit.distance > 1e-4f)
+				++failures;
+		}
+
+		// an edit in place is picked up after updateLength
+		XMVECTOR target = XMVectorSet(10.0f, 10.0f, 10.0f, .0f);
+		XMStoreFloat3A(reinterpret_cast<XMFLOAT3A*>(&strokes[2].anchor(150)), target);
+		strokes[2].updateLength();
+		curves.build();
+		auto moved = curves.closestPoint(target);
+		if (moved.curve != 2 || moved.distance > 1e-4f || fabsf(moved.t - strokes[2].anchor(150).w) > 1e-3f)
+			++failures;
+
+		cout << "curve query test : failures = " << failures << endl;
+		return failures == 0;
+	}
+
+	REGISTER_TEST_METHOD(CurveQueryTest, CurveQueryTest);
+
+	// save -> open -> copy_to keeps the mesh and its bvh, a corrupted header, index, bvh node or truncated file is rejected
+	bool MeshFileTest()
+	{
+		typedef TriangleMesh<TangentVertex, uint16_t> GridMesh;
+		typedef MappedTriangleMesh<TangentVertex, uint16_t> MappedGridMesh;
+		const char* fileName = "geometrics_mesh_file_test.gmsh";
+		const wstring path = L"geometrics_mesh_file_test.gmsh";
+		int failures = 0;
+
+		GridMesh mesh;
+		vector<Triangle<uint16_t>> facets;
+		make_tangent_grid(mesh.vertices, facets, 16, false);
+		for (auto& facet : facets)
+			for (int k = 0; k < 3; k++)
+				mesh.indices.push_back(facet[k]);
+		mesh.build();
+		vector<MeshBVHNode> nodes;
+		vector<uint32_t> primitives;
+		build_mesh_bvh(mesh, nodes, primitives);
+
+		if (!MeshFile::save(path, mesh, &nodes, &primitives))
+		{
+			cout << "mesh file test : can not write " << fileName << endl;
+			return false;
+		}
+
+		{
+			MappedGridMesh mapped;
+			if (!mapped.open(path) || !mapped.has_adjacency() || !mapped.has_bvh())
+				++failures;
+			else
+			{
+				GridMesh copy;
+				mapped.copy_to(copy);
+				if (copy.vertices.size() != mesh.vertices.size() || memcmp(copy.vertices.data(), mesh.vertices.data(), mesh.vertices.size() * sizeof(TangentVertex)) != 0)
+					++failures;
+				if (copy.indices != mesh.indices || copy.revedges != mesh.revedges)
+					++failures;
+				auto mappedNodes = mapped.bvh_nodes();
+				auto mappedPrimitives = mapped.bvh_primitives();
+				if (mappedNodes.size() != nodes.size() || memcmp(mappedNodes.data(), nodes.data(), nodes.size() * sizeof(MeshBVHNode)) != 0)
+					++failures;
+				if (!equal(mappedPrimitives.begin(), mappedPrimitives.end(), primitives.begin(), primitives.end()))
+					++failures;
+			}
+		}
+
+		vector<uint8_t> bytes;
+		{
+			MappedFile file(path);
+			bytes.assign(file.data(), file.data() + file.size());
+		}
+
+		// write a corrupted copy of the saved file over it, true if open rejects it
+		auto rejects = [&](const function<void(vector<uint8_t>&)>& corrupt)
+		{
+			auto corrupted = bytes;
+			corrupt(corrupted);
+			{
+				ofstream file;
+				if (!open_output_file(file, path))
+					return false;
+				file.write(reinterpret_cast<const char*>(corrupted.data()), corrupted.size());
+			}
+			MappedGridMesh mapped;
+			return !mapped.open(path);
+		};
+		auto header = [](vector<uint8_t>& data) { return reinterpret_cast<MeshFile::Header*>(data.data()); };
+		auto internalNode = find_if(nodes.begin(), nodes.end(), [](const MeshBVHNode& node) { return !node.is_leaf(); }) - nodes.begin();
+
+		// the unmodified copy still opens
+		if (rejects([](vector<uint8_t>&) {}))
+			++failures;
+		if (!rejects([&](vector<uint8_t>& data) { header(data)->magic ^= 0xff; }))
+			++failures;
+		if (!rejects([&](vector<uint8_t>& data) { header(data)->vertexCount += 1; }))
+			++failures;
+		if (!rejects([&](vector<uint8_t>& data) { data.resize(data.size() - MeshFile::BlockAlignment); }))
+			++failures;
+		if (!rejects([&](vector<uint8_t>& data) {
+			auto indices = reinterpret_cast<uint16_t*>(data.data() + header(data)->blocks[MeshFile::Indices].offset);
+			indices[7] = static_cast<uint16_t>(mesh.vertices.size()); }))
+			++failures;
+		if (!rejects([&](vector<uint8_t>& data) {
+			auto bvh = reinterpret_cast<MeshBVHNode*>(data.data() + header(data)->blocks[MeshFile::BVHNodes].offset);
+			bvh[internalNode].first = static_cast<uint32_t>(nodes.size()); }))
+			++failures;
+		if (!rejects([&](vector<uint8_t>& data) {
+			auto bvh = reinterpret_cast<MeshBVHNode*>(data.data() + header(data)->blocks[MeshFile::BVHNodes].offset);
+			bvh[nodes.size() - 1].count = static_cast<uint32_t>(primitives.size()) + 1; }))
+			++failures;
+		if (!rejects([&](vector<uint8_t>& data) {
+			auto table = reinterpret_cast<uint32_t*>(data.data() + header(data)->blocks[MeshFile::BVHPrimitives].offset);
+			table[0] = static_cast<uint32_t>(facets.size()); }))
+			++failures;
+
+		remove(fileName);
+		cout << "mesh file test : failures = " << failures << endl;
+		return failures == 0;
+	}
+
+	REGISTER_TEST_METHOD(MeshFileTest, MeshFileTest);
+
+	// a growing stroke must only append rings to the committed mesh, so the buffer upload stays a NO_OVERWRITE append
+	bool ExtrusionIncrementalTest()
+	{
+		int failures = 0;
+
+		// a circular patch on a single big facet
+		MeshType surface;
+		surface.vertices.resize(3);
+		const float corners[3][2] = { { -1.0f, -1.0f }, { 1.0f, -1.0f }, { .0f, 1.0f } };
+		for (int i = 0; i < 3; i++)
+		{
+			surface.vertices[i].position = Vector3(corners[i][0], corners[i][1], .0f);
+			surface.vertices[i].normal = Vector3(.0f, .0f, 1.0f);
+			surface.vertices[i].uv = Vector2(corners[i][0] * 0.5f + 0.5f, corners[i][1] * 0.5f + 0.5f);
+		}
+		surface.add_facet(0, 1, 2);
+
+		SurfacePatch bottom;
+		bottom.setSurface(&surface);
+		for (int i = 0; i < 24; i++)
+		{
+			float angle = XM_2PI * i / 24;
+			bottom.append(XMVectorSet(0.1f * cosf(angle), 0.1f * sinf(angle), .0f, 1.0f), 0);
+		}
+		bottom.closeLoop();
+
+		// a wavy stroke with online simplification, the tip anchor moves on most appends
+		Curve axis;
+		axis.setSimplifyTolerance(0.02f);
+		Extrusion extrusion(nullptr, &bottom, &axis);
+		const float interval = 0.05f;
+		const int polarSubdiv = 16, cols = polarSubdiv + 1;
+
+		vector<DefaultVertex> committed;
+		size_t committedIndices = 0, uploadedVertices = 0;
+		for (int i = 0; i < 400; i++)
+		{
+			float s = i * 0.01f;
+			axis.append(XMVectorSet(0.3f * sinf(2.0f * s), 0.2f * sinf(3.0f * s), s, 1.0f));
+			if (axis.size() < 2 || axis.length() < 2.0f * interval)
+				continue;
+
+			auto& mesh = extrusion.triangulateIncremental(interval, polarSubdiv);
+			auto& dirty = extrusion.dirtyRange();
+			size_t rings = static_cast<size_t>(floorf(axis.length() / interval)) + 1;
+			if (mesh.vertices.size() != rings * cols || dirty.vertexEnd != mesh.vertices.size() || dirty.indexEnd != mesh.indices.size())
+				++failures;
+
+			// the committed rings are neither rewritten nor changed
+			if (dirty.vertexBegin != committed.size() || dirty.indexBegin != committedIndices)
+				++failures;
+			if (!committed.empty() && memcmp(mesh.vertices.data(), committed.data(), committed.size() * sizeof(DefaultVertex)) != 0)
+				++failures;
+			uploadedVertices += dirty.vertexEnd - dirty.vertexBegin;
+
+			// the tail runs from the last committed ring to the path end
+			auto& tail = extrusion.tail();
+			if (!tail.vertices.empty())
+			{
+				if (tail.vertices.size() != 2 * cols || tail.indices.size() != 6 * polarSubdiv)
+					++failures;
+				for (int k = 0; k < cols && tail.vertices.size() == 2 * cols; k++)
+				{
+					auto& a = tail.vertices[k].position;
+					auto& b = mesh.vertices[mesh.vertices.size() - cols + k].position;
+					if (!XMVector3NearEqual(XMLoadFloat3(&a), XMLoadFloat3(&b), XMVectorReplicate(1e-5f)))
+						++failures;
+				}
+				XMVECTOR end = XMLoadFloat3(&tail.vertices[cols].position);
+				if (XMVectorGetX(XMVector3Length(end - axis.back())) > 0.11f)
+					++failures;
+			}
+
+			committed.assign(mesh.vertices.begin(), mesh.vertices.end());
+			committedIndices = mesh.indices.size();
+		}
+
+		// every vertex went up exactly once
+		if (committed.empty() || uploadedVertices != committed.size())
+			++failures;
+
+		cout << "extrusion incremental test : failures = " << failures << endl;
+		return failures == 0;
+	}
+
+	REGISTER_TEST_METHOD(ExtrusionIncrementalTest, ExtrusionIncrementalTest);
+}
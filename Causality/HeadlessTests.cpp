@@ -0,0 +1,7 @@
+#include "Tests.h"
+
+// Entry of the headless test build (CMakeLists.txt), runs the unit tests that need no device or window
+int main()
+{
+	return Causality::TestManager::RunTest() ? 0 : 1;
+}
@@ -25,6 +25,11 @@ static const size_t	g_MeshBufferIndexCap = 16384;
 static const size_t g_DecalResolution = 512;
 
 static float g_contactThred = 0.5f; //cm
+// initial ring spacing of the live extrusion preview, cm
+static const float g_extrusionRingInterval = 0.25f;
+static const int g_extrusionPolarSubdiv = 32;
+// tracked pen samples within this distance of the simplified extrusion axis are merged, cm
+static const float g_strokeSimplifyTolerance = 0.02f;
 
 inline D2D1_COLOR_F XM_CALLCONV GetD2DColor(const Color& color)
 {
@@ -41,7 +46,7 @@ inline D2D1_POINT_2F XM_CALLCONV GetD2DPoint(const Vector2& v)
 
 
 PenModeler::PenModeler(int objectIdx)
-	: m_state(None), m_target(nullptr)
+	: m_state(None), m_target(nullptr), m_ringInterval(g_extrusionRingInterval)
 {
 	m_pen = nullptr;
 	m_patches.reserve(100);
@@ -130,6 +135,12 @@ void PenModeler::CreateDeviceResources()
 		m_meshBuffer->CreateDeviceResources<VertexType, IndexType>(m_pDevice, g_MeshBufferVertexCap, g_MeshBufferIndexCap);
 	}
 
+	if (!m_extruTailBuffer)
+	{
+		m_extruTailBuffer.reset(new DynamicMeshBuffer);
+		m_extruTailBuffer->CreateDeviceResources<VertexType, IndexType>(m_pDevice, 2 * (g_extrusionPolarSubdiv + 1), 6 * g_extrusionPolarSubdiv);
+	}
+
 	auto context = this->Scene->GetRenderContext();
 
 	// Update our mesh with same geometry as the target
@@ -276,6 +287,7 @@ void PenModeler::OnAirDragBegin()
 		g_MeshBufferIndexCap);
 
 	auto& extruder = m_extrusions.back();
+	m_ringInterval = g_extrusionRingInterval;
 
 	XMVECTOR lclPos = m_Transform.LclTranslation;
 	float minDis = std::numeric_limits<float>::max();
@@ -295,16 +307,25 @@ void PenModeler::OnAirDragBegin()
 	}
 	extruder.setBottom(&m_patches[idx]);
 	extruder.setAxis(new Curve());
+	extruder.axis().setSimplifyTolerance(g_strokeSimplifyTolerance);
 }
 
 void PenModeler::OnAirDragUpdate(FXMVECTOR pos)
 {
 	auto& extruder = m_extrusions.back();
-	extruder.axis().append(pos);
+	auto& axis = extruder.axis();
+	axis.append(pos);
 
-	if (extruder.axis().size() > 16)
+	// the simplified axis of a straight stroke keeps few anchors, so wait for length instead of samples
+	if (axis.size() >= 2 && axis.length() >= 2.0f * g_extrusionRingInterval)
 	{
-		extruder.triangulate(64, 32);
+		// coarsen the rings once the stroke outgrows the mesh buffer, all rings are rebuilt then
+		size_t cols = g_extrusionPolarSubdiv + 1;
+		auto rings = [&]() { return (size_t)(axis.length() / m_ringInterval) + 2; };
+		while (rings() * cols > g_MeshBufferVertexCap || rings() * g_extrusionPolarSubdiv * 6 > g_MeshBufferIndexCap)
+			m_ringInterval *= 2.0f;
+
+		extruder.triangulateIncremental(m_ringInterval, g_extrusionPolarSubdiv);
 		UpdateMeshBuffer(extruder);
 	}
 }
@@ -314,13 +335,28 @@ void PenModeler::UpdateMeshBuffer(Geometrics::Extrusion & extruder)
 	auto context = this->Scene->GetRenderContext();
 	auto& vertices = extruder.mesh().vertices;
 	auto& indices = extruder.mesh().indices;
+	auto& dirty = extruder.dirtyRange();
+	auto& buffer = *m_extruBuffers.back();
+
+	// committed rings are only appended while the stroke grows, so this is a NO_OVERWRITE append of the new rings
+	if (dirty.vertexBegin == 0 && dirty.vertexEnd == vertices.size())
+		buffer.UpdateVertexBuffer(context,
+			reinterpret_cast<VertexType*>(vertices.data()),
+			vertices.size());
+	else
+		buffer.UpdateVertexBuffer(context, vertices.data(),
+			dirty.vertexBegin, dirty.vertexEnd - dirty.vertexBegin, vertices.size(), sizeof(VertexType));
 
-	m_extruBuffers.back()->UpdateVertexBuffer(context,
-		reinterpret_cast<VertexType*>(vertices.data()),
-		vertices.size());
-
-	m_extruBuffers.back()->UpdateIndexBuffer(context, indices.data(), indices.size());
+	if (dirty.indexBegin == 0 && dirty.indexEnd == indices.size())
+		buffer.UpdateIndexBuffer(context, indices.data(), indices.size());
+	else
+		buffer.UpdateIndexBuffer(context, indices.data(),
+			dirty.indexBegin, dirty.indexEnd - dirty.indexBegin, indices.size(), sizeof(IndexType));
 
+	// the tail ring moves with the pen, it is the only geometry uploaded in full every update
+	auto& tail = extruder.tail();
+	m_extruTailBuffer->UpdateVertexBuffer(context, const_cast<VertexType*>(reinterpret_cast<const VertexType*>(tail.vertices.data())), tail.vertices.size());
+	m_extruTailBuffer->UpdateIndexBuffer(context, const_cast<IndexType*>(tail.indices.data()), tail.indices.size());
 }
 
 void PenModeler::OnAirDragEnd()
@@ -394,17 +430,25 @@ void PenModeler::UpdateRenderGeometry(array_view<Vector3> points, const Vector2
 	if (points.size() <= 1)
 		return;
 
+	// drop the outline points within half a texel of the simplified stroke, they would not change the decal
+	Curve stroke;
+	stroke.setSimplifyTolerance(0.5f / std::max(canvasSize.x, canvasSize.y));
+	for (const auto& point : points)
+		stroke.append(point);
+	if (stroke.size() <= 1)
+		return;
+
 	m_p2DFactory->CreatePathGeometry(&m_patchGeos);
 	cptr<ID2D1GeometrySink> pSink;
 	ThrowIfFailed(m_patchGeos->Open(&pSink));
 	pSink->SetFillMode(D2D1_FILL_MODE_WINDING);
 
-	int n = points.size();
+	int n = stroke.size();
 	vector<D2D1_POINT_2F> dpoints(n);
 	for (int i = 0; i < n; i++)
 	{
-		Vector2 p(points[i].x, points[i].y);
-		dpoints[i] = GetD2DPoint(p * canvasSize);
+		XMVECTOR p = stroke.position(i);
+		dpoints[i] = GetD2DPoint(Vector2(XMVectorGetX(p), XMVectorGetY(p)) * canvasSize);
 	}
 
 	pSink->BeginFigure(
@@ -495,6 +539,8 @@ void PenModeler::Render(IRenderContext * context, IEffect * pEffect)
 	for (int i = 0; i < m_extruBuffers.size(); i++) {
 		m_extruBuffers[i]->Draw(context, pEffect);
 	}
+	if (m_state == Dragging && m_extruTailBuffer && m_extruTailBuffer->IndexCount > 0)
+		m_extruTailBuffer->Draw(context, pEffect);
 
 
 	RenderPen();	//g_PrimitiveDrawer.DrawCylinder(pos - (yDir * TrackedPen::TipLength), -yDir, length * 3, radius * 0.5, color);
@@ -64,6 +64,8 @@ namespace Causality
 		vector<SurfacePatch>		m_patches;
 
 		vector<Extrusion>			m_extrusions;
+		// ring spacing of the extrusion being dragged
+		float						m_ringInterval;
 
 		IRenderDevice*				m_pDevice;
 		I2DContext*					m_p2DContex;
@@ -76,6 +78,8 @@ namespace Causality
 		uptr<DynamicMeshBuffer>		m_meshBuffer;
 		vector<uptr<DynamicMeshBuffer>>
 									m_extruBuffers;
+		// the provisional tail of the extrusion being dragged, see Extrusion::tail()
+		uptr<DynamicMeshBuffer>		m_extruTailBuffer;
 
 		// Decal texture for rendering highlights in target model
 		sptr<PhongMaterial>			m_decalMat;
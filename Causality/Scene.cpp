@@ -7,6 +7,7 @@
 #include "VisualObject.h"
 #include <HUD.h>
 #include <tinyxml2.h>
+#include <ppl.h>
 
 using namespace Causality;
 using namespace std;
@@ -123,6 +124,19 @@ void Scene::Update()
 	lock_guard<mutex> guard(content_mutex);
 	m_timer.Tick([this]() {
 		time_seconds deltaTime(m_timer.GetElapsedSeconds() * time_scale);
+
+		// Animation pass, sampling and skinning of every character on worker threads, published by the Update walk
+		m_animated.clear();
+		for (auto& pObj : m_sceneRoot->nodes())
+		{
+			auto pAnimated = pObj.As<IAnimated>();
+			if (pAnimated && pObj.IsEnabled())
+				m_animated.push_back(pAnimated);
+		}
+		concurrency::parallel_for_each(m_animated.begin(), m_animated.end(), [&deltaTime](IAnimated* pAnimated) {
+			pAnimated->EvaluateAnimation(deltaTime);
+		});
+
 		for (auto& pObj : m_sceneRoot->nodes())
 		{
 			if (pObj.IsEnabled())
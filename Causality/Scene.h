@@ -195,6 +195,7 @@ namespace Causality
 		vector<ILight*>				m_lights;
 		vector<IVisual*>			m_renderables;
 		vector<IEffect*>			m_effects;
+		vector<IAnimated*>			m_animated;
 
 		std::mutex					content_mutex;
 
@@ -21,6 +21,14 @@ namespace Causality
 	class Scene;
 	class Component;
 
+	// Objects whose per frame animation only touches their own state
+	// Scene evaluates all enabled animated objects in parallel before the update walk, and their Update publishes the result
+	class IAnimated abstract
+	{
+	public:
+		virtual void EvaluateAnimation(time_seconds const& time_delta) = 0;
+	};
+
 	enum SceneObjectCollisionType
 	{
 		Collision_Dynamic,	// Passive, Collision with Static and Kinametic Object
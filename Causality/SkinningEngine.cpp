@@ -0,0 +1,458 @@
+#include "SkinningEngine.h"
+#include "FrameLanes.h"
+#include <algorithm>
+#include <cassert>
+#include <cfloat>
+
+using namespace Causality;
+
+namespace
+{
+	// vertices per dispatched range, a multiple of every lane width
+	const size_t RangeVertices = 4096;
+
+	enum BindPlanes
+	{
+		PositionPlane = 0,
+		NormalPlane = 3,
+		TangentPlane = 6,
+		BindPlanesCount = 10,
+	};
+
+	inline const void* StreamElement(const void* base, size_t stride, size_t index)
+	{
+		return reinterpret_cast<const uint8_t*>(base) + stride * index;
+	}
+
+	// palette entry offsets of influence j of the lanes, bones points to the first lane's bone of the first influence
+	template <class L>
+	inline void InfluenceOffsets(int offsets[], const int* bones, size_t planeStride, size_t j, int entryStride)
+	{
+		for (size_t k = 0; k < L::width; k++)
+			offsets[k] = bones[j * planeStride + k] * entryStride;
+	}
+
+	template <class L>
+	inline void NormalizeLanes(typename L::type v[3])
+	{
+		typedef typename L::type V;
+		V lsq = L::madd(v[2], v[2], L::madd(v[1], v[1], L::mul(v[0], v[0])));
+		V inv = L::div(L::set1(1.0f), L::sqrt(L::max(lsq, L::set1(FLT_MIN))));
+		for (int c = 0; c < 3; c++)
+			v[c] = L::mul(v[c], inv);
+	}
+
+	// v = m * v with the 3x4 rows of m, w = 1 for points and 0 for directions
+	template <class L>
+	inline void TransformLanes(typename L::type v[3], const typename L::type m[12], bool point)
+	{
+		typedef typename L::type V;
+		V r[3];
+		for (int c = 0; c < 3; c++)
+		{
+			V h = point ? m[c * 4 + 3] : L::set1(.0f);
+			r[c] = L::madd(m[c * 4], v[0], L::madd(m[c * 4 + 1], v[1], L::madd(m[c * 4 + 2], v[2], h)));
+		}
+		for (int c = 0; c < 3; c++)
+			v[c] = r[c];
+	}
+
+	// linear blend skinning, the weighted sum of the influence matrices applied to the bind pose
+	template <class L>
+	inline void LinearBlendLanes(const float* palette, const int* bones, const float* weights, size_t planeStride, size_t influences,
+		typename L::type p[3], typename L::type n[3], typename L::type t[3], bool normals, bool tangents)
+	{
+		typedef typename L::type V;
+		V m[12];
+		for (size_t j = 0; j < influences; j++)
+		{
+			alignas(32) int offsets[L::width];
+			InfluenceOffsets<L>(offsets, bones, planeStride, j, 12);
+			V w = L::load(weights + j * planeStride);
+			for (int c = 0; c < 12; c++)
+			{
+				V e = L::gather(palette + c, offsets);
+				m[c] = j == 0 ? L::mul(w, e) : L::madd(w, e, m[c]);
+			}
+		}
+
+		TransformLanes<L>(p, m, true);
+		if (normals)
+			TransformLanes<L>(n, m, false);
+		if (tangents)
+			TransformLanes<L>(t, m, false);
+	}
+
+	// dual quaternion skinning, influences are flipped into the hemisphere of the first one before blending
+	template <class L>
+	inline void DualQuaternionLanes(const float* palette, const int* bones, const float* weights, size_t planeStride, size_t influences,
+		typename L::type p[3], typename L::type n[3], typename L::type t[3], bool normals, bool tangents)
+	{
+		typedef typename L::type V;
+		V r[4], e[4], pivot[4];
+		for (size_t j = 0; j < influences; j++)
+		{
+			alignas(32) int offsets[L::width];
+			InfluenceOffsets<L>(offsets, bones, planeStride, j, 8);
+			V w = L::load(weights + j * planeStride);
+			V qr[4], qe[4];
+			for (int c = 0; c < 4; c++)
+			{
+				qr[c] = L::gather(palette + c, offsets);
+				qe[c] = L::gather(palette + 4 + c, offsets);
+			}
+
+			if (j == 0)
+			{
+				for (int c = 0; c < 4; c++)
+				{
+					pivot[c] = qr[c];
+					r[c] = L::mul(w, qr[c]);
+					e[c] = L::mul(w, qe[c]);
+				}
+			}
+			else
+			{
+				V dot = L::madd(pivot[3], qr[3], L::madd(pivot[2], qr[2], L::madd(pivot[1], qr[1], L::mul(pivot[0], qr[0]))));
+				w = L::mul(w, L::sign(dot));
+				for (int c = 0; c < 4; c++)
+				{
+					r[c] = L::madd(w, qr[c], r[c]);
+					e[c] = L::madd(w, qe[c], e[c]);
+				}
+			}
+		}
+
+		V lsq = L::madd(r[3], r[3], L::madd(r[2], r[2], L::madd(r[1], r[1], L::mul(r[0], r[0]))));
+		V inv = L::div(L::set1(1.0f), L::sqrt(L::max(lsq, L::set1(FLT_MIN))));
+		for (int c = 0; c < 4; c++)
+		{
+			r[c] = L::mul(r[c], inv);
+			e[c] = L::mul(e[c], inv);
+		}
+
+		// translation = 2 * Qe * conjugate(Qr) = 2 * (r.w * e.xyz - e.w * r.xyz + r.xyz x e.xyz)
+		V two = L::set1(2.0f);
+		V tr[3] = {
+			L::mul(two, L::add(L::nmadd(e[3], r[0], L::mul(r[3], e[0])), L::nmadd(r[2], e[1], L::mul(r[1], e[2])))),
+			L::mul(two, L::add(L::nmadd(e[3], r[1], L::mul(r[3], e[1])), L::nmadd(r[0], e[2], L::mul(r[2], e[0])))),
+			L::mul(two, L::add(L::nmadd(e[3], r[2], L::mul(r[3], e[2])), L::nmadd(r[1], e[0], L::mul(r[0], e[1])))) };
+
+		Internal::RotateLanes<L>(p, r);
+		for (int c = 0; c < 3; c++)
+			p[c] = L::add(p[c], tr[c]);
+		if (normals)
+			Internal::RotateLanes<L>(n, r);
+		if (tangents)
+			Internal::RotateLanes<L>(t, r);
+	}
+}
+
+SkinningEngine::SkinningEngine(size_t workers)
+	: m_count(0), m_padded(0), m_bonesCount(0), m_hasNormals(false), m_hasTangents(false),
+	m_job(nullptr), m_ranges(0), m_nextRange(0), m_generation(0), m_busyWorkers(0), m_exit(false)
+{
+	if (workers == 0)
+		workers = std::max(1U, std::thread::hardware_concurrency());
+	// the calling thread is worker 0
+	m_threads.reserve(workers - 1);
+	for (size_t worker = 1; worker < workers; worker++)
+		m_threads.emplace_back(&SkinningEngine::WorkerLoop, this, worker);
+}
+
+SkinningEngine::~SkinningEngine()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_exit = true;
+	}
+	m_startSignal.notify_all();
+	for (auto& thread : m_threads)
+		thread.join();
+}
+
+bool SkinningEngine::SetMesh(const SkinnedVertexStreams & source, size_t bonesCount)
+{
+	typedef Internal::FrameLanes L;
+	Clear();
+	if (source.Count == 0)
+		return true;
+	assert(source.Positions && source.BlendIndices && source.BlendWeights);
+
+	size_t n = source.Count;
+	size_t padded = (n + L::width - 1) / L::width * L::width;
+	bool hasNormals = source.Normals != nullptr, hasTangents = source.Tangents != nullptr;
+
+	m_bind.resize(padded * BindPlanesCount);
+	m_bones.resize(padded * 4);
+	m_weights.resize(padded * 4);
+	m_blockInfluences.assign(padded / L::width, 1);
+
+	for (size_t i = 0; i < padded; i++)
+	{
+		size_t v = std::min(i, n - 1);
+		auto position = static_cast<const float*>(StreamElement(source.Positions, source.PositionStride, v));
+		for (int c = 0; c < 3; c++)
+			m_bind[(PositionPlane + c) * padded + i] = position[c];
+		if (hasNormals)
+		{
+			auto normal = static_cast<const float*>(StreamElement(source.Normals, source.NormalStride, v));
+			for (int c = 0; c < 3; c++)
+				m_bind[(NormalPlane + c) * padded + i] = normal[c];
+		}
+		if (hasTangents)
+		{
+			auto tangent = static_cast<const float*>(StreamElement(source.Tangents, source.TangentStride, v));
+			for (int c = 0; c < 4; c++)
+				m_bind[(TangentPlane + c) * padded + i] = tangent[c];
+		}
+
+		uint32_t packedIndices = *static_cast<const uint32_t*>(StreamElement(source.BlendIndices, source.BlendIndicesStride, v));
+		uint32_t packedWeights = *static_cast<const uint32_t*>(StreamElement(source.BlendWeights, source.BlendWeightsStride, v));
+		int bones[4];
+		float weights[4];
+		for (int j = 0; j < 4; j++)
+		{
+			bones[j] = (packedIndices >> (j * 8)) & 0xff;
+			weights[j] = static_cast<float>((packedWeights >> (j * 8)) & 0xff) / 255.0f;
+		}
+
+		// heaviest influence first
+		for (int j = 1; j < 4; j++)
+		{
+			for (int k = j; k > 0 && weights[k] > weights[k - 1]; k--)
+			{
+				std::swap(weights[k], weights[k - 1]);
+				std::swap(bones[k], bones[k - 1]);
+			}
+		}
+
+		float sum = weights[0] + weights[1] + weights[2] + weights[3];
+		if (sum <= .0f)
+		{
+			weights[0] = sum = 1.0f;
+		}
+
+		size_t influences = 0;
+		for (int j = 0; j < 4; j++)
+		{
+			if (weights[j] > .0f)
+			{
+				if (bones[j] >= static_cast<int>(bonesCount))
+				{
+					Clear();
+					return false;
+				}
+				weights[j] /= sum;
+				influences = j + 1;
+			}
+			else
+			{
+				// empty influences read the first bone with zero weight, so every gather stays inside the palette
+				bones[j] = bones[0];
+			}
+			m_bones[j * padded + i] = bones[j];
+			m_weights[j * padded + i] = weights[j];
+		}
+
+		auto& blockInfluences = m_blockInfluences[i / L::width];
+		blockInfluences = std::max(blockInfluences, static_cast<uint8_t>(influences));
+	}
+
+	m_count = n;
+	m_padded = padded;
+	m_bonesCount = bonesCount;
+	m_hasNormals = hasNormals;
+	m_hasTangents = hasTangents;
+
+	m_positions.resize(n);
+	if (hasNormals)
+		m_normals.resize(n);
+	if (hasTangents)
+		m_tangents.resize(n);
+	m_boneBoxes.assign(bonesCount, SkinningBox{ { .0f, .0f, .0f }, { .0f, .0f, .0f } });
+	return true;
+}
+
+void SkinningEngine::Clear()
+{
+	m_count = m_padded = m_bonesCount = 0;
+	m_hasNormals = m_hasTangents = false;
+	m_bind.clear();
+	m_bones.clear();
+	m_weights.clear();
+	m_blockInfluences.clear();
+	m_positions.clear();
+	m_normals.clear();
+	m_tangents.clear();
+	m_boxAccumulators.clear();
+	m_boneBoxes.clear();
+}
+
+void SkinningEngine::Skin(const SkinningMatrix * palette, bool updateBoneBoxes)
+{
+	SkinRanges(reinterpret_cast<const float*>(palette), updateBoneBoxes, LinearBlendLanes<Internal::FrameLanes>);
+}
+
+void SkinningEngine::Skin(const SkinningDualQuaternion * palette, bool updateBoneBoxes)
+{
+	SkinRanges(reinterpret_cast<const float*>(palette), updateBoneBoxes, DualQuaternionLanes<Internal::FrameLanes>);
+}
+
+template <class Kernel>
+void SkinningEngine::SkinRanges(const float * palette, bool updateBoneBoxes, Kernel kernel)
+{
+	typedef Internal::FrameLanes L;
+	typedef L::type V;
+	if (m_count == 0)
+		return;
+	assert(palette != nullptr);
+
+	size_t boxStride = m_bonesCount * 6;
+	if (updateBoneBoxes)
+	{
+		// [min.x, min.y, min.z, max.x, max.y, max.z] of each bone, one set per worker
+		m_boxAccumulators.resize(WorkersCount() * boxStride);
+		for (size_t i = 0; i < m_boxAccumulators.size(); i += 6)
+		{
+			std::fill_n(&m_boxAccumulators[i], 3, FLT_MAX);
+			std::fill_n(&m_boxAccumulators[i + 3], 3, -FLT_MAX);
+		}
+	}
+
+	size_t ranges = (m_padded + RangeVertices - 1) / RangeVertices;
+	Dispatch(ranges, [&](size_t range, size_t worker)
+	{
+		size_t begin = range * RangeVertices, end = std::min(begin + RangeVertices, m_padded);
+		float* boxes = updateBoneBoxes ? &m_boxAccumulators[worker * boxStride] : nullptr;
+		V one = L::set1(1.0f), zero = L::set1(.0f);
+
+		for (size_t i = begin; i < end; i += L::width)
+		{
+			V p[3], n[3], t[3];
+			for (int c = 0; c < 3; c++)
+			{
+				p[c] = L::load(&m_bind[(PositionPlane + c) * m_padded + i]);
+				n[c] = m_hasNormals ? L::load(&m_bind[(NormalPlane + c) * m_padded + i]) : zero;
+				t[c] = m_hasTangents ? L::load(&m_bind[(TangentPlane + c) * m_padded + i]) : zero;
+			}
+
+			kernel(palette, &m_bones[i], &m_weights[i], m_padded, m_blockInfluences[i / L::width], p, n, t, m_hasNormals, m_hasTangents);
+
+			// the padding lanes of the last block are not stored
+			size_t count = std::min(size_t(L::width), m_count - i);
+			L::store_rows4(&m_positions[i].x, 4, count, p[0], p[1], p[2], one);
+			if (m_hasNormals)
+			{
+				NormalizeLanes<L>(n);
+				L::store_rows4(&m_normals[i].x, 4, count, n[0], n[1], n[2], zero);
+			}
+			if (m_hasTangents)
+			{
+				NormalizeLanes<L>(t);
+				L::store_rows4(&m_tangents[i].x, 4, count, t[0], t[1], t[2], L::load(&m_bind[(TangentPlane + 3) * m_padded + i]));
+			}
+
+			if (boxes)
+			{
+				alignas(32) float lanes[3][L::width];
+				for (int c = 0; c < 3; c++)
+					L::store(lanes[c], p[c]);
+				for (size_t k = 0; k < count; k++)
+				{
+					float* box = boxes + m_bones[i + k] * 6;
+					for (int c = 0; c < 3; c++)
+					{
+						box[c] = std::min(box[c], lanes[c][k]);
+						box[c + 3] = std::max(box[c + 3], lanes[c][k]);
+					}
+				}
+			}
+		}
+		L::fence();
+	});
+
+	if (updateBoneBoxes)
+	{
+		for (size_t bone = 0; bone < m_bonesCount; bone++)
+		{
+			float box[6] = { FLT_MAX, FLT_MAX, FLT_MAX, -FLT_MAX, -FLT_MAX, -FLT_MAX };
+			for (size_t worker = 0; worker < WorkersCount(); worker++)
+			{
+				const float* accumulator = &m_boxAccumulators[worker * boxStride + bone * 6];
+				for (int c = 0; c < 3; c++)
+				{
+					box[c] = std::min(box[c], accumulator[c]);
+					box[c + 3] = std::max(box[c + 3], accumulator[c + 3]);
+				}
+			}
+
+			auto& boneBox = m_boneBoxes[bone];
+			if (box[0] > box[3])
+			{
+				boneBox.Center = SkinningFloat3{ .0f, .0f, .0f };
+				boneBox.Extents = SkinningFloat3{ .0f, .0f, .0f };
+			}
+			else
+			{
+				boneBox.Center = SkinningFloat3{ (box[0] + box[3]) * 0.5f, (box[1] + box[4]) * 0.5f, (box[2] + box[5]) * 0.5f };
+				boneBox.Extents = SkinningFloat3{ (box[3] - box[0]) * 0.5f, (box[4] - box[1]) * 0.5f, (box[5] - box[2]) * 0.5f };
+			}
+		}
+	}
+}
+
+void SkinningEngine::Dispatch(size_t ranges, const std::function<void(size_t, size_t)>& job)
+{
+	if (m_threads.empty() || ranges <= 1)
+	{
+		for (size_t range = 0; range < ranges; range++)
+			job(range, 0);
+		return;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_job = &job;
+		m_ranges = ranges;
+		m_nextRange = 0;
+		m_busyWorkers = m_threads.size();
+		++m_generation;
+	}
+	m_startSignal.notify_all();
+
+	RunRanges(0);
+
+	std::unique_lock<std::mutex> lock(m_mutex);
+	m_doneSignal.wait(lock, [this]() { return m_busyWorkers == 0; });
+	m_job = nullptr;
+}
+
+void SkinningEngine::RunRanges(size_t worker)
+{
+	for (size_t range = m_nextRange++; range < m_ranges; range = m_nextRange++)
+		(*m_job)(range, worker);
+}
+
+void SkinningEngine::WorkerLoop(size_t worker)
+{
+	size_t generation = 0;
+	for (;;)
+	{
+		{
+			std::unique_lock<std::mutex> lock(m_mutex);
+			m_startSignal.wait(lock, [&]() { return m_exit || m_generation != generation; });
+			if (m_exit)
+				return;
+			generation = m_generation;
+		}
+
+		RunRanges(worker);
+
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			--m_busyWorkers;
+		}
+		m_doneSignal.notify_one();
+	}
+}
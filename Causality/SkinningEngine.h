@@ -0,0 +1,148 @@
+#pragma once
+#include "SkinningPalette.h"
+#include "FrameLanes.h"
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace Causality
+{
+	// Strided source streams of a skinned mesh, strides are in bytes and must be multiples of 4
+	// Blend indices are 4 packed 8 bit bone ids, blend weights 4 packed unorm8, the layout of VertexPositionNormalTangentColorTextureSkinning
+	struct SkinnedVertexStreams
+	{
+		size_t			Count;
+		const float*	Positions;
+		size_t			PositionStride;
+		// optional, nullptr to skip
+		const float*	Normals;
+		size_t			NormalStride;
+		// optional, xyz is deformed, w (handedness) is copied
+		const float*	Tangents;
+		size_t			TangentStride;
+		const uint32_t*	BlendIndices;
+		size_t			BlendIndicesStride;
+		const uint32_t*	BlendWeights;
+		size_t			BlendWeightsStride;
+
+		SkinnedVertexStreams()
+			: Count(0), Positions(nullptr), PositionStride(0), Normals(nullptr), NormalStride(0), Tangents(nullptr), TangentStride(0),
+			BlendIndices(nullptr), BlendIndicesStride(0), BlendWeights(nullptr), BlendWeightsStride(0)
+		{}
+
+		// streams of a vertex array with position, normal, tangent, indices and weights members, e.g. DefaultSkinningModel::GetVertices()
+		template <class TVertex>
+		static SkinnedVertexStreams FromVertices(const TVertex* vertices, size_t count)
+		{
+			SkinnedVertexStreams streams;
+			if (vertices == nullptr || count == 0)
+				return streams;
+			streams.Count = count;
+			streams.Positions = &vertices->position.x;
+			streams.Normals = &vertices->normal.x;
+			streams.Tangents = &vertices->tangent.x;
+			streams.BlendIndices = &vertices->indices;
+			streams.BlendWeights = &vertices->weights;
+			streams.PositionStride = streams.NormalStride = streams.TangentStride = streams.BlendIndicesStride = streams.BlendWeightsStride = sizeof(TVertex);
+			return streams;
+		}
+	};
+
+	/// <summary>
+	/// CPU skinning of one mesh, linear blend with a FrameSkinningPalette matrix palette or dual quaternion with a dual quaternion palette.
+	/// Standard C++ only, the renderer palettes convert with AsSkinningPalette of Armature.h.
+	/// The bind pose is copied into lane planes once by SetMesh, Skin then runs 8 vertices per step with AVX2,
+	/// vertex ranges are split across a pool of worker threads, the calling thread works on a range too.
+	/// No device is involved, the results are plain arrays for picking, collision and bounding updates.
+	/// </summary>
+	class SkinningEngine
+	{
+	public:
+		// workers = 0 uses one worker per hardware thread, 1 skins on the calling thread only
+		explicit SkinningEngine(size_t workers = 0);
+		~SkinningEngine();
+
+		SkinningEngine(const SkinningEngine&) = delete;
+		SkinningEngine& operator=(const SkinningEngine&) = delete;
+
+		/// <summary>
+		/// Copy the bind pose of the mesh, the source streams are not referenced afterwards.
+		/// Influences are sorted by weight and renormalized, the first one is the bone a vertex belongs to for the bone boxes.
+		/// </summary>
+		/// <returns>false if a weighted influence refers to a bone out of [0, bonesCount)</returns>
+		bool SetMesh(const SkinnedVertexStreams& source, size_t bonesCount);
+		void Clear();
+
+		/// <summary>
+		/// Skin all vertices with a palette of BonesCount() entries.
+		/// Outputs are written with streaming stores, normals and tangents are renormalized.
+		/// </summary>
+		/// <param name="updateBoneBoxes">also rebuild BoneBoxes() from the skinned positions</param>
+		void Skin(const SkinningMatrix* palette, bool updateBoneBoxes = false);
+		void Skin(const SkinningDualQuaternion* palette, bool updateBoneBoxes = false);
+
+		size_t VerticesCount() const { return m_count; }
+		size_t BonesCount() const { return m_bonesCount; }
+		size_t WorkersCount() const { return m_threads.size() + 1; }
+
+		// skinned positions with w = 1
+		const SkinningFloat4* Positions() const { return m_positions.data(); }
+		// skinned normals with w = 0, nullptr if the mesh has no normals
+		const SkinningFloat4* Normals() const { return m_normals.empty() ? nullptr : m_normals.data(); }
+		// skinned tangents with the source handedness in w, nullptr if the mesh has no tangents
+		const SkinningFloat4* Tangents() const { return m_tangents.empty() ? nullptr : m_tangents.data(); }
+		// model space box of the vertices of each bone after the last Skin(.., true), empty bones have zero extents
+		const std::vector<SkinningBox>& BoneBoxes() const { return m_boneBoxes; }
+
+	private:
+		typedef std::vector<float, Internal::LaneAllocator<float, 32>>			lane_array;
+		typedef std::vector<int, Internal::LaneAllocator<int, 32>>				index_array;
+		typedef std::vector<SkinningFloat4, Internal::LaneAllocator<SkinningFloat4, 16>>	vector_array;
+
+		// run job(range, worker) for ranges [0, ranges) on the pool and the calling thread
+		void Dispatch(size_t ranges, const std::function<void(size_t, size_t)>& job);
+		void WorkerLoop(size_t worker);
+		void RunRanges(size_t worker);
+
+		template <class Kernel>
+		void SkinRanges(const float* palette, bool updateBoneBoxes, Kernel kernel);
+
+		size_t					m_count;
+		// m_count rounded up to whole lanes, the padding repeats the last vertex
+		size_t					m_padded;
+		size_t					m_bonesCount;
+		bool					m_hasNormals;
+		bool					m_hasTangents;
+
+		// planar bind pose : position x, y, z, normal x, y, z, tangent x, y, z, w
+		lane_array				m_bind;
+		// planar influences : 4 bone id planes and 4 weight planes, sorted by weight
+		index_array				m_bones;
+		lane_array				m_weights;
+		// influences in use of each lane block, blocks of rigid vertices skip the empty ones
+		std::vector<uint8_t>	m_blockInfluences;
+
+		vector_array			m_positions;
+		vector_array			m_normals;
+		vector_array			m_tangents;
+
+		// per worker min / max of each bone, merged into m_boneBoxes
+		std::vector<float>		m_boxAccumulators;
+		std::vector<SkinningBox>	m_boneBoxes;
+
+		std::vector<std::thread>	m_threads;
+		std::mutex					m_mutex;
+		std::condition_variable		m_startSignal;
+		std::condition_variable		m_doneSignal;
+		const std::function<void(size_t, size_t)>* m_job;
+		size_t					m_ranges;
+		std::atomic<size_t>		m_nextRange;
+		size_t					m_generation;
+		size_t					m_busyWorkers;
+		bool					m_exit;
+	};
+}
@@ -0,0 +1,386 @@
+#include "SkinningEngine.h"
+#include "SkinningPalette.h"
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <random>
+#include <vector>
+#include "Tests.h"
+
+using namespace std;
+
+namespace Causality
+{
+	namespace
+	{
+		// standard C++ only, the skinning tests also run in the headless build
+
+		struct Quaternion
+		{
+			float x, y, z, w;
+		};
+
+		struct Vector3
+		{
+			float x, y, z;
+		};
+
+		// Hamilton product a * b
+		Quaternion multiply(const Quaternion& a, const Quaternion& b)
+		{
+			return Quaternion{
+				a.w * b.x + a.x * b.w + a.y * b.z - a.z * b.y,
+				a.w * b.y - a.x * b.z + a.y * b.w + a.z * b.x,
+				a.w * b.z + a.x * b.y - a.y * b.x + a.z * b.w,
+				a.w * b.w - a.x * b.x - a.y * b.y - a.z * b.z };
+		}
+
+		Quaternion conjugate(const Quaternion& q)
+		{
+			return Quaternion{ -q.x, -q.y, -q.z, q.w };
+		}
+
+		// q * v * conjugate(q), the same as XMVector3Rotate
+		Vector3 rotate(const Vector3& v, const Quaternion& q)
+		{
+			Quaternion r = multiply(multiply(q, Quaternion{ v.x, v.y, v.z, .0f }), conjugate(q));
+			return Vector3{ r.x, r.y, r.z };
+		}
+
+		Vector3 add(const Vector3& a, const Vector3& b) { return Vector3{ a.x + b.x, a.y + b.y, a.z + b.z }; }
+		Vector3 scale(const Vector3& a, float s) { return Vector3{ a.x * s, a.y * s, a.z * s }; }
+
+		Vector3 normalize(const Vector3& v)
+		{
+			float l = sqrtf(v.x * v.x + v.y * v.y + v.z * v.z);
+			return l > .0f ? scale(v, 1.0f / l) : v;
+		}
+
+		float distance(const Vector3& a, const Vector3& b)
+		{
+			return sqrtf((a.x - b.x) * (a.x - b.x) + (a.y - b.y) * (a.y - b.y) + (a.z - b.z) * (a.z - b.z));
+		}
+
+		float distance(const Vector3& a, const SkinningFloat4& b)
+		{
+			return distance(a, Vector3{ b.x, b.y, b.z });
+		}
+
+		Vector3 transform(const SkinningMatrix& m, const Vector3& v, float w)
+		{
+			return Vector3{
+				m.m[0][0] * v.x + m.m[0][1] * v.y + m.m[0][2] * v.z + m.m[0][3] * w,
+				m.m[1][0] * v.x + m.m[1][1] * v.y + m.m[1][2] * v.z + m.m[1][3] * w,
+				m.m[2][0] * v.x + m.m[2][1] * v.y + m.m[2][2] * v.z + m.m[2][3] * w };
+		}
+
+		Quaternion as_quaternion(const SkinningFloat4& v)
+		{
+			return Quaternion{ v.x, v.y, v.z, v.w };
+		}
+
+		// rotation by Qr and translation 2 * Qe * conjugate(Qr)
+		Vector3 transform(const Quaternion& qr, const Quaternion& qe, const Vector3& v, bool point)
+		{
+			Vector3 r = rotate(v, qr);
+			if (!point)
+				return r;
+			Quaternion t = multiply(qe, conjugate(qr));
+			return add(r, Vector3{ 2.0f * t.x, 2.0f * t.y, 2.0f * t.z });
+		}
+
+		Quaternion random_rotation(mt19937& gen)
+		{
+			normal_distribution<float> normal;
+			Quaternion q{ normal(gen), normal(gen), normal(gen), normal(gen) };
+			float l = sqrtf(q.x * q.x + q.y * q.y + q.z * q.z + q.w * q.w);
+			return Quaternion{ q.x / l, q.y / l, q.z / l, q.w / l };
+		}
+
+		Vector3 random_vector(mt19937& gen, float extent)
+		{
+			uniform_real_distribution<float> uniform(-extent, extent);
+			return Vector3{ uniform(gen), uniform(gen), uniform(gen) };
+		}
+
+		// bone records with the global pose at a layout unlike Bone, so the offsets really come from the layout
+		const SkinningBoneLayout TestLayout = { 16, 4, 8, 12 };
+
+		void make_bone_records(vector<float>& records, size_t count, mt19937& gen, bool scaled)
+		{
+			uniform_real_distribution<float> scaling(0.5f, 2.0f);
+			records.assign(count * TestLayout.Stride, -1.0f);
+			for (size_t i = 0; i < count; i++)
+			{
+				float* bone = &records[i * TestLayout.Stride];
+				Quaternion q = random_rotation(gen);
+				Vector3 t = random_vector(gen, 3.0f);
+				float rotation[4] = { q.x, q.y, q.z, q.w }, translation[3] = { t.x, t.y, t.z };
+				copy(rotation, rotation + 4, bone + TestLayout.GblRotation);
+				copy(translation, translation + 3, bone + TestLayout.GblTranslation);
+				for (int c = 0; c < 3; c++)
+					bone[TestLayout.GblScaling + c] = scaled ? scaling(gen) : 1.0f;
+			}
+		}
+
+		Quaternion record_rotation(const float* bone)
+		{
+			const float* q = bone + TestLayout.GblRotation;
+			return Quaternion{ q[0], q[1], q[2], q[3] };
+		}
+
+		Vector3 record_vector(const float* bone, int offset)
+		{
+			return Vector3{ bone[offset], bone[offset + 1], bone[offset + 2] };
+		}
+	}
+
+	// BuildSkinningPalette against a scalar evaluation of Bone::TransformMatrix and Bone::RigidTransformDualQuaternion
+	bool SkinningPaletteTest()
+	{
+		mt19937 gen(7);
+		int failures = 0;
+
+		// 13 bones leave a partial lane chunk at the end with AVX2
+		const size_t count = 13;
+		vector<float> from, to;
+		make_bone_records(from, count, gen, true);
+		make_bone_records(to, count, gen, true);
+
+		vector<SkinningMatrix> matrices(count + 1);
+		vector<SkinningDualQuaternion> dualQuaternions(count + 1);
+		const float sentinel = 12345.0f;
+		fill(&matrices[count].m[0][0], &matrices[count].m[0][0] + 12, sentinel);
+		BuildSkinningPalette(matrices.data(), from.data(), to.data(), count, TestLayout);
+
+		for (size_t i = 0; i < count; i++)
+		{
+			const float* f = &from[i * TestLayout.Stride];
+			const float* t = &to[i * TestLayout.Stride];
+			Quaternion qf = record_rotation(f), qt = record_rotation(t);
+			Vector3 pf = record_vector(f, TestLayout.GblTranslation), pt = record_vector(t, TestLayout.GblTranslation);
+			Vector3 sf = record_vector(f, TestLayout.GblScaling), st = record_vector(t, TestLayout.GblScaling);
+
+			// rotation from the inverse from rotation to the to rotation, the scaling ratio only moves the pivot
+			Vector3 pivot = rotate(scale(pf, -1.0f), conjugate(qf));
+			pivot = Vector3{ pivot.x * st.x / sf.x, pivot.y * st.y / sf.y, pivot.z * st.z / sf.z };
+			Vector3 translation = add(rotate(pivot, qt), pt);
+
+			for (int k = 0; k < 4; k++)
+			{
+				Vector3 v = random_vector(gen, 2.0f);
+				Vector3 expected = add(rotate(rotate(v, conjugate(qf)), qt), translation);
+				if (distance(expected, transform(matrices[i], v, 1.0f)) > 1e-4f)
+					++failures;
+			}
+		}
+		if (matrices[count].m[2][3] != sentinel)
+			++failures;
+
+		// without scaling the dual quaternions move points as the matrices do
+		make_bone_records(from, count, gen, false);
+		make_bone_records(to, count, gen, false);
+		BuildSkinningPalette(matrices.data(), from.data(), to.data(), count, TestLayout);
+		BuildSkinningPalette(dualQuaternions.data(), from.data(), to.data(), count, TestLayout);
+		for (size_t i = 0; i < count; i++)
+		{
+			Quaternion qr = as_quaternion(dualQuaternions[i].Qr), qe = as_quaternion(dualQuaternions[i].Qe);
+			if (fabsf(qr.x * qr.x + qr.y * qr.y + qr.z * qr.z + qr.w * qr.w - 1.0f) > 1e-4f)
+				++failures;
+			Vector3 v = random_vector(gen, 2.0f);
+			if (distance(transform(matrices[i], v, 1.0f), transform(qr, qe, v, true)) > 1e-4f)
+				++failures;
+		}
+
+		cout << "skinning palette test : failures = " << failures << endl;
+		return failures == 0;
+	}
+
+	REGISTER_TEST_METHOD(SkinningPaletteTest, SkinningPaletteTest);
+
+	namespace
+	{
+		struct SkinnedTestVertex
+		{
+			Vector3		position;
+			Vector3		normal;
+			SkinningFloat4	tangent;
+			uint32_t	indices;
+			uint32_t	weights;
+		};
+
+		// 1 to 4 influences, the heaviest first with a unique weight, packed unorm8 weights summing to 255
+		void make_skinned_vertices(vector<SkinnedTestVertex>& vertices, size_t count, int bones, mt19937& gen)
+		{
+			uniform_int_distribution<int> bone(0, bones - 1), influences(1, 4);
+			vertices.resize(count);
+			for (size_t i = 0; i < count; i++)
+			{
+				auto& vertex = vertices[i];
+				vertex.position = random_vector(gen, 5.0f);
+				vertex.normal = normalize(random_vector(gen, 1.0f));
+				Vector3 tangent = normalize(random_vector(gen, 1.0f));
+				vertex.tangent = SkinningFloat4{ tangent.x, tangent.y, tangent.z, i % 2 ? 1.0f : -1.0f };
+
+				// blocks of rigid vertices take the single influence path
+				int n = (i / 64) % 3 == 0 ? 1 : influences(gen);
+				uint32_t weights[4] = { 255, 0, 0, 0 };
+				if (n > 1)
+				{
+					weights[0] = 128 + gen() % 64;
+					uint32_t rest = 255 - weights[0];
+					for (int j = 1; j < n; j++)
+					{
+						weights[j] = j == n - 1 ? rest : rest / 2;
+						rest -= weights[j];
+					}
+				}
+
+				vertex.indices = vertex.weights = 0;
+				for (int j = 0; j < 4; j++)
+				{
+					vertex.indices |= uint32_t(bone(gen)) << (j * 8);
+					vertex.weights |= weights[j] << (j * 8);
+				}
+			}
+		}
+
+		int influence_bone(const SkinnedTestVertex& vertex, int j) { return (vertex.indices >> (j * 8)) & 0xff; }
+		float influence_weight(const SkinnedTestVertex& vertex, int j) { return float((vertex.weights >> (j * 8)) & 0xff) / 255.0f; }
+
+		// the scalar linear blend and dual quaternion skinning of one vertex
+		void skin_reference(const SkinnedTestVertex& vertex, const SkinningMatrix* matrices, const SkinningDualQuaternion* dualQuaternions,
+			Vector3& position, Vector3& normal, Vector3& tangent)
+		{
+			Vector3 t{ vertex.tangent.x, vertex.tangent.y, vertex.tangent.z };
+			if (matrices)
+			{
+				position = normal = tangent = Vector3{ .0f, .0f, .0f };
+				for (int j = 0; j < 4; j++)
+				{
+					float w = influence_weight(vertex, j);
+					auto& m = matrices[influence_bone(vertex, j)];
+					position = add(position, scale(transform(m, vertex.position, 1.0f), w));
+					normal = add(normal, scale(transform(m, vertex.normal, .0f), w));
+					tangent = add(tangent, scale(transform(m, t, .0f), w));
+				}
+			}
+			else
+			{
+				Quaternion pivot = as_quaternion(dualQuaternions[influence_bone(vertex, 0)].Qr);
+				Quaternion qr{ 0, 0, 0, 0 }, qe{ 0, 0, 0, 0 };
+				for (int j = 0; j < 4; j++)
+				{
+					float w = influence_weight(vertex, j);
+					auto& dq = dualQuaternions[influence_bone(vertex, j)];
+					Quaternion r = as_quaternion(dq.Qr), e = as_quaternion(dq.Qe);
+					if (pivot.x * r.x + pivot.y * r.y + pivot.z * r.z + pivot.w * r.w < .0f)
+						w = -w;
+					qr = Quaternion{ qr.x + w * r.x, qr.y + w * r.y, qr.z + w * r.z, qr.w + w * r.w };
+					qe = Quaternion{ qe.x + w * e.x, qe.y + w * e.y, qe.z + w * e.z, qe.w + w * e.w };
+				}
+				float l = sqrtf(qr.x * qr.x + qr.y * qr.y + qr.z * qr.z + qr.w * qr.w);
+				qr = Quaternion{ qr.x / l, qr.y / l, qr.z / l, qr.w / l };
+				qe = Quaternion{ qe.x / l, qe.y / l, qe.z / l, qe.w / l };
+				position = transform(qr, qe, vertex.position, true);
+				normal = transform(qr, qe, vertex.normal, false);
+				tangent = transform(qr, qe, t, false);
+			}
+			normal = normalize(normal);
+			tangent = normalize(tangent);
+		}
+
+		int compare_skinning(const SkinningEngine& engine, const vector<SkinnedTestVertex>& vertices,
+			const SkinningMatrix* matrices, const SkinningDualQuaternion* dualQuaternions)
+		{
+			int failures = 0;
+			for (size_t i = 0; i < vertices.size(); i++)
+			{
+				Vector3 position, normal, tangent;
+				skin_reference(vertices[i], matrices, dualQuaternions, position, normal, tangent);
+				if (distance(position, engine.Positions()[i]) > 1e-3f || engine.Positions()[i].w != 1.0f)
+					++failures;
+				if (distance(normal, engine.Normals()[i]) > 1e-3f)
+					++failures;
+				if (distance(tangent, engine.Tangents()[i]) > 1e-3f || engine.Tangents()[i].w != vertices[i].tangent.w)
+					++failures;
+			}
+			return failures;
+		}
+	}
+
+	// SkinningEngine on a worker pool against scalar per vertex skinning, with the bone boxes of the heaviest influences
+	bool SkinningEngineTest()
+	{
+		mt19937 gen(11);
+		int failures = 0;
+
+		const int bones = 21;
+		// several dispatch ranges and a partial lane block at the end
+		const size_t count = 10003;
+		vector<SkinnedTestVertex> vertices;
+		make_skinned_vertices(vertices, count, bones, gen);
+
+		vector<float> from, to;
+		make_bone_records(from, bones, gen, false);
+		make_bone_records(to, bones, gen, false);
+		vector<SkinningMatrix> matrices(bones);
+		vector<SkinningDualQuaternion> dualQuaternions(bones);
+		BuildSkinningPalette(matrices.data(), from.data(), to.data(), bones, TestLayout);
+		BuildSkinningPalette(dualQuaternions.data(), from.data(), to.data(), bones, TestLayout);
+
+		SkinningEngine engine(3);
+		if (!engine.SetMesh(SkinnedVertexStreams::FromVertices(vertices.data(), count), bones) || engine.VerticesCount() != count)
+			++failures;
+
+		engine.Skin(matrices.data(), true);
+		failures += compare_skinning(engine, vertices, matrices.data(), nullptr);
+
+		vector<float> boxes(bones * 6);
+		for (int b = 0; b < bones; b++)
+		{
+			fill(&boxes[b * 6], &boxes[b * 6] + 3, HUGE_VALF);
+			fill(&boxes[b * 6 + 3], &boxes[b * 6] + 6, -HUGE_VALF);
+		}
+		for (size_t i = 0; i < count; i++)
+		{
+			float* box = &boxes[influence_bone(vertices[i], 0) * 6];
+			const SkinningFloat4& p = engine.Positions()[i];
+			const float position[3] = { p.x, p.y, p.z };
+			for (int c = 0; c < 3; c++)
+			{
+				box[c] = min(box[c], position[c]);
+				box[c + 3] = max(box[c + 3], position[c]);
+			}
+		}
+		for (int b = 0; b < bones; b++)
+		{
+			const float* box = &boxes[b * 6];
+			auto& boneBox = engine.BoneBoxes()[b];
+			if (box[0] > box[3])
+			{
+				if (boneBox.Extents.x != .0f || boneBox.Extents.y != .0f || boneBox.Extents.z != .0f)
+					++failures;
+				continue;
+			}
+			Vector3 center{ (box[0] + box[3]) * 0.5f, (box[1] + box[4]) * 0.5f, (box[2] + box[5]) * 0.5f };
+			Vector3 extents{ (box[3] - box[0]) * 0.5f, (box[4] - box[1]) * 0.5f, (box[5] - box[2]) * 0.5f };
+			if (distance(center, Vector3{ boneBox.Center.x, boneBox.Center.y, boneBox.Center.z }) > 1e-4f ||
+				distance(extents, Vector3{ boneBox.Extents.x, boneBox.Extents.y, boneBox.Extents.z }) > 1e-4f)
+				++failures;
+		}
+
+		engine.Skin(dualQuaternions.data());
+		failures += compare_skinning(engine, vertices, nullptr, dualQuaternions.data());
+
+		// an influence out of the palette is rejected
+		vertices[5].indices = bones;
+		if (engine.SetMesh(SkinnedVertexStreams::FromVertices(vertices.data(), count), bones) || engine.VerticesCount() != 0)
+			++failures;
+
+		cout << "skinning engine test : failures = " << failures << endl;
+		return failures == 0;
+	}
+
+	REGISTER_TEST_METHOD(SkinningEngineTest, SkinningEngineTest);
+}
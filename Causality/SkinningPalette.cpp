@@ -0,0 +1,109 @@
+#include "SkinningPalette.h"
+#include "FrameLanes.h"
+#include <algorithm>
+
+using namespace Causality;
+
+namespace
+{
+	// the global rotation and translation of L::width bones, lane k from the bone record at base + bones[k]
+	template <class L>
+	inline void GatherGlobalLanes(const float* base, const int* bones, const SkinningBoneLayout& layout, typename L::type q[4], typename L::type t[3])
+	{
+		for (int c = 0; c < 4; c++)
+			q[c] = L::gather(base + layout.GblRotation + c, bones);
+		for (int c = 0; c < 3; c++)
+			t[c] = L::gather(base + layout.GblTranslation + c, bones);
+	}
+
+	// Bone::TransformMatrix of L::width bones, transposed into 3x4 rows
+	template <class L>
+	inline void TransformMatrixLanes(float* out, const float* from, const float* to, const int* bones, size_t count, const SkinningBoneLayout& layout)
+	{
+		typedef typename L::type V;
+		V qf[4], pf[3], qt[4], pt[3];
+		GatherGlobalLanes<L>(from, bones, layout, qf, pf);
+		GatherGlobalLanes<L>(to, bones, layout, qt, pt);
+
+		// rotation by the inverse from rotation, then by the to rotation
+		V zero = L::set1(.0f);
+		for (int c = 0; c < 3; c++)
+			qf[c] = L::sub(zero, qf[c]);
+		V q[4];
+		Internal::QuaternionMultiplyLanes<L>(q, qf, qt);
+
+		// translation = Rotate(Rotate(-from.GblTranslation, from^-1) * scaling, to) + to.GblTranslation
+		V u[3];
+		for (int c = 0; c < 3; c++)
+			u[c] = L::sub(zero, pf[c]);
+		Internal::RotateLanes<L>(u, qf);
+		for (int c = 0; c < 3; c++)
+			u[c] = L::mul(u[c], L::div(L::gather(to + layout.GblScaling + c, bones), L::gather(from + layout.GblScaling + c, bones)));
+		Internal::RotateLanes<L>(u, qt);
+		for (int c = 0; c < 3; c++)
+			u[c] = L::add(u[c], pt[c]);
+
+		// XMMatrixRotationQuaternion(q), transposed
+		V one = L::set1(1.0f), two = L::set1(2.0f);
+		V x2 = L::mul(two, q[0]), y2 = L::mul(two, q[1]), z2 = L::mul(two, q[2]);
+		V xx = L::mul(x2, q[0]), yy = L::mul(y2, q[1]), zz = L::mul(z2, q[2]);
+		V xy = L::mul(x2, q[1]), xz = L::mul(x2, q[2]), yz = L::mul(y2, q[2]);
+		V xw = L::mul(x2, q[3]), yw = L::mul(y2, q[3]), zw = L::mul(z2, q[3]);
+
+		L::store_rows4(out, 12, count, L::sub(one, L::add(yy, zz)), L::sub(xy, zw), L::add(xz, yw), u[0]);
+		L::store_rows4(out + 4, 12, count, L::add(xy, zw), L::sub(one, L::add(xx, zz)), L::sub(yz, xw), u[1]);
+		L::store_rows4(out + 8, 12, count, L::sub(xz, yw), L::add(yz, xw), L::sub(one, L::add(xx, yy)), u[2]);
+	}
+
+	// Bone::RigidTransformDualQuaternion of L::width bones
+	template <class L>
+	inline void TransformDualQuaternionLanes(float* out, const float* from, const float* to, const int* bones, size_t count, const SkinningBoneLayout& layout)
+	{
+		typedef typename L::type V;
+		V qf[4], pf[3], qt[4], pt[3];
+		GatherGlobalLanes<L>(from, bones, layout, qf, pf);
+		GatherGlobalLanes<L>(to, bones, layout, qt, pt);
+
+		V zero = L::set1(.0f), half = L::set1(0.5f);
+		for (int c = 0; c < 3; c++)
+			qf[c] = L::sub(zero, qf[c]);
+		V q[4];
+		Internal::QuaternionMultiplyLanes<L>(q, qf, qt);
+
+		// Qe = XMQuaternionMultiply(q, 0.5 * to) + XMQuaternionMultiply(-0.5 * from, q)
+		V e[4] = { L::mul(half, pt[0]), L::mul(half, pt[1]), L::mul(half, pt[2]), zero };
+		V o[4] = { L::mul(L::set1(-0.5f), pf[0]), L::mul(L::set1(-0.5f), pf[1]), L::mul(L::set1(-0.5f), pf[2]), zero };
+		V qe[4], qo[4];
+		Internal::QuaternionMultiplyLanes<L>(qe, q, e);
+		Internal::QuaternionMultiplyLanes<L>(qo, o, q);
+
+		L::store_rows4(out, 8, count, q[0], q[1], q[2], q[3]);
+		L::store_rows4(out + 4, 8, count, L::add(qe[0], qo[0]), L::add(qe[1], qo[1]), L::add(qe[2], qo[2]), L::add(qe[3], qo[3]));
+	}
+
+	// run a palette kernel over all n bones, stride is the palette entry size in floats
+	template <class Kernel>
+	void BuildPalette(float* out, size_t stride, const float* from, const float* to, size_t n, const SkinningBoneLayout& layout, Kernel kernel)
+	{
+		typedef Internal::FrameLanes L;
+		for (size_t i = 0; i < n; i += L::width)
+		{
+			// the last chunk repeats the last bone and stores only the real ones
+			int bones[L::width];
+			for (size_t j = 0; j < L::width; j++)
+				bones[j] = static_cast<int>(std::min(i + j, n - 1)) * layout.Stride;
+			kernel(out + i * stride, from, to, bones, std::min(n - i, size_t(L::width)), layout);
+		}
+		L::fence();
+	}
+}
+
+void Causality::BuildSkinningPalette(SkinningMatrix * out, const float * from, const float * to, size_t count, const SkinningBoneLayout & layout)
+{
+	BuildPalette(&out->m[0][0], 12, from, to, count, layout, TransformMatrixLanes<Internal::FrameLanes>);
+}
+
+void Causality::BuildSkinningPalette(SkinningDualQuaternion * out, const float * from, const float * to, size_t count, const SkinningBoneLayout & layout)
+{
+	BuildPalette(&out->Qr.x, 8, from, to, count, layout, TransformDualQuaternionLanes<Internal::FrameLanes>);
+}
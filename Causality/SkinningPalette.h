@@ -0,0 +1,57 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+
+namespace Causality
+{
+	// Skinning types shared by the renderer and the headless CPU skinning, standard C++ only
+	// The layouts match the DirectXMath types of the renderer, Armature.h checks them
+
+	// the layout of DirectX::XMFLOAT3
+	struct SkinningFloat3
+	{
+		float x, y, z;
+	};
+
+	// the layout of DirectX::XMFLOAT4A
+	struct alignas(16) SkinningFloat4
+	{
+		float x, y, z, w;
+	};
+
+	// 3 rows of a row major 3x4 transform, the layout of DirectX::XMFLOAT3X4
+	struct SkinningMatrix
+	{
+		float m[3][4];
+	};
+
+	// rotation and 0.5 * translation * rotation, the layout of BoneDualQuaternion
+	struct alignas(16) SkinningDualQuaternion
+	{
+		SkinningFloat4 Qr;
+		SkinningFloat4 Qe;
+	};
+
+	// center and half extents, the layout of DirectX::BoundingBox
+	struct SkinningBox
+	{
+		SkinningFloat3 Center;
+		SkinningFloat3 Extents;
+	};
+
+	// Where the global pose lives inside a bone record, all in floats, e.g. offsetof(Bone, GblRotation) / sizeof(float)
+	struct SkinningBoneLayout
+	{
+		int Stride;
+		// quaternion x, y, z, w
+		int GblRotation;
+		int GblTranslation;
+		int GblScaling;
+	};
+
+	// Skinning palette of count bones from the bone records of the from (bind) and to frames, 8 bones per step with AVX2
+	// The matrices equal Bone::TransformMatrix transposed into 3x4 rows, the dual quaternions Bone::RigidTransformDualQuaternion
+	// Entries are written with streaming stores when out is 16-byte aligned
+	void BuildSkinningPalette(SkinningMatrix* out, const float* from, const float* to, size_t count, const SkinningBoneLayout& layout);
+	void BuildSkinningPalette(SkinningDualQuaternion* out, const float* from, const float* to, size_t count, const SkinningBoneLayout& layout);
+}
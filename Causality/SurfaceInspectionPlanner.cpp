@@ -297,16 +297,21 @@ void SurfaceInspectionPlanner::BuildTriangleMesh(int tessellation, DirectX::Simp
 		m_patch[i] = TeapotControlPoints[patch.indices[i]].v;
 	}
 
-	bool succ = Geometrics::triangluate(m_patch, m_mesh, tessellation);
+	// the 4 mirrored quarters of the teapot body, tessellated in one parallel pass
+	CubicBezierPatch patches[4];
+	patches[0] = m_patch;
 
 	for (auto& cp : m_patch) { cp.x = -cp.x; cp.z = -cp.z; }
-	succ = Geometrics::triangluate(m_patch, m_mesh, tessellation);
+	patches[1] = m_patch;
 
 	for (auto& cp : m_patch) cp.x = -cp.x;
-	succ = Geometrics::triangluate(m_patch, m_mesh, tessellation, true);
+	patches[2] = m_patch;
 
 	for (auto& cp : m_patch) { cp.x = -cp.x; cp.z = -cp.z; }
-	succ = Geometrics::triangluate(m_patch, m_mesh, tessellation, true);
+	patches[3] = m_patch;
+
+	const bool flips[4] = { false, false, true, true };
+	bool succ = Geometrics::tessellate(gsl::span<const CubicBezierPatch>(patches), m_mesh, tessellation, flips);
 
 	for (auto& v : m_mesh.vertices)
 	{
@@ -1,5 +1,5 @@
-#include "pch_bcl.h"
 #include "Tests.h"
+#include <cassert>
 #include <map>
 #include <iostream>
 
@@ -15,14 +15,15 @@ namespace Causality
 		return collection;
 	}
 
-	void TestManager::RegisterTest(const char* name, std::function<bool(void)> func)
+	static test_function_collection& GetBenchmarkMethods()
 	{
-		GetTestMethods()[name] = std::move(func);
+		static test_function_collection collection;
+		return collection;
 	}
 
-	bool TestManager::RunTest()
+	static bool RunTestCollection(const test_function_collection& tests)
 	{
-		for (auto& test : GetTestMethods())
+		for (auto& test : tests)
 		{
 			bool result = test.second();
 			if (!result)
@@ -34,4 +35,24 @@ namespace Causality
 		}
 		return true;
 	}
+
+	void TestManager::RegisterTest(const char* name, std::function<bool(void)> func)
+	{
+		GetTestMethods()[name] = std::move(func);
+	}
+
+	bool TestManager::RunTest()
+	{
+		return RunTestCollection(GetTestMethods());
+	}
+
+	void TestManager::RegisterBenchmark(const char* name, std::function<bool(void)> func)
+	{
+		GetBenchmarkMethods()[name] = std::move(func);
+	}
+
+	bool TestManager::RunBenchmark()
+	{
+		return RunTestCollection(GetBenchmarkMethods());
+	}
 }
\ No newline at end of file
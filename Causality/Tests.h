@@ -11,6 +11,10 @@ namespace Causality
 
 		static void RegisterTest(const char* name, std::function<bool(void)> func);
 		static bool RunTest();
+
+		// benchmarks run on full sized inputs, they are kept out of RunTest and only run on request
+		static void RegisterBenchmark(const char* name, std::function<bool(void)> func);
+		static bool RunBenchmark();
 	};
 
 #define REGISTER_TEST_METHOD(test_name,function) \
@@ -19,4 +23,11 @@ namespace Causality
 		_test_register_##test_name##_ () {\
 		::Causality::TestManager::RegisterTest((#test_name),(function)); }\
 	} _test_register_##test_name##_instance;
+
+#define REGISTER_BENCHMARK_METHOD(benchmark_name,function) \
+	struct _benchmark_register_##benchmark_name##_ \
+	{ \
+		_benchmark_register_##benchmark_name##_ () {\
+		::Causality::TestManager::RegisterBenchmark((#benchmark_name),(function)); }\
+	} _benchmark_register_##benchmark_name##_instance;
 }
\ No newline at end of file
@@ -258,6 +258,13 @@ namespace DirectX
 
 			void UpdateIndexBuffer(ID3D11DeviceContext* pContext, void * pIndices, size_t indicesCount, size_t indexSize);
 
+			// Partial updates, write elements [first, first + count) of the source array and set the element count to totalCount.
+			// Ranges past the current element count were never drawn and are appended with D3D11_MAP_WRITE_NO_OVERWRITE,
+			// a range overlapping drawn elements discards the buffer and re-uploads [0, totalCount) of the source array
+			void UpdateVertexBuffer(ID3D11DeviceContext* pContext, const void * pVertics, size_t first, size_t count, size_t totalCount, size_t vertexSize);
+
+			void UpdateIndexBuffer(ID3D11DeviceContext* pContext, const void * pIndices, size_t first, size_t count, size_t totalCount, size_t indexSize);
+
 			template<class _TVertex>
 			void CreateDeviceResources(ID3D11Device* pDevice, unsigned int VerticesCapacity, IEffect *pEffect = nullptr, D3D_PRIMITIVE_TOPOLOGY primitiveTopology = D3D_PRIMITIVE_TOPOLOGY::D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
 			template<class _TVertex, class _TIndex>
@@ -598,6 +605,13 @@ namespace DirectX
 			//virtual DirectX::XMMATRIX* GetBoneTransforms() override;
 			virtual const BoundingOrientedBox* GetBoneBoundingBoxes() const override;
 
+			// CPU copy of the vertices, nullptr after ReleaseDynamicResource
+			const VertexType* GetVertices() const { return m_Vertices.get(); }
+			size_t GetVerticesCount() const { return m_Vertices ? m_VertexCount : 0; }
+
+			// Refit the bind space box of each bone from the CPU vertices, needs GetVertices()
+			void CaculateBoneBoxes(const Matrix4x4* defaultBoneTransforms);
+
 			DefaultSkinningModel();
 			virtual ~DefaultSkinningModel() override;
 
@@ -636,7 +650,6 @@ namespace DirectX
 			void SetFromSkinMeshData(std::list<SkinMeshData> &meshes, const std::wstring& textureDir = L"");
 			void SetFromSkinMeshData(SkinMeshData* pData, const std::wstring& textureDir = L"");
 			void ResetRanges();
-			void CaculateBoneBoxes(const Matrix4x4* defaultBoneTransforms);
 		};
 
 		template <class _TVertex>
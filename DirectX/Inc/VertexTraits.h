@@ -326,6 +326,30 @@ namespace DirectX
 			set_weights(vertex, weights, index);
 		}
 
+		// checks if the vertex member is a tightly packed float3 (or float4) which can be accessed as a float stream
+		template <class TMember>
+		struct is_float3_member : std::integral_constant<bool,
+			std::is_base_of<XMFLOAT3, TMember>::value || std::is_base_of<XMFLOAT4, TMember>::value> {};
+
+#ifndef XM_FLOAT3_MEMBER_STREAM
+#define XM_FLOAT3_MEMBER_STREAM(member_name, name)							\
+		template <class TVertex, class = void>									\
+		struct name {															\
+			static constexpr bool value = false;									\
+			static float* get(TVertex* vertex) { return nullptr; }				\
+		};																		\
+		template <class TVertex>													\
+		struct name<TVertex, std::enable_if_t<is_float3_member<decltype(TVertex::member_name)>::value>> { \
+			static constexpr bool value = true;									\
+			static float* get(TVertex* vertex) { return &vertex->member_name.x; }	\
+		}
+#endif
+
+		// float stream access to position/normal/tangent, value == false for unusual layouts (packed, half, etc)
+		XM_FLOAT3_MEMBER_STREAM(position, position_stream);
+		XM_FLOAT3_MEMBER_STREAM(normal, normal_stream);
+		XM_FLOAT3_MEMBER_STREAM(tangent, tangent_stream);
+
 		template <class TSrcVertex, class TDstVertex>
 		void convert_vertex(const TSrcVertex& src, TDstVertex& dst)
 		{
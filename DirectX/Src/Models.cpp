@@ -14,7 +14,7 @@
 #include <algorithm>
 #include <unordered_map>
 #include <DirectXPackedVector.h>
-#include <unordered_set>
+#include <ppl.h>
 #include <Geometrics\TriangleMesh.h>
 
 //using namespace Causality;
@@ -627,22 +627,22 @@ void DefaultSkinningModel::ReleaseDynamicResource()
 
 void DefaultSkinningModel::ResetRanges()
 {
-	Vertices.reset(m_Vertices.get(), sizeof(VertexType), m_VertexCount);
+	Vertices.reset(m_Vertices.get(), m_VertexCount, sizeof(VertexType));
 	Facets.reset(reinterpret_cast<TriangleType*>(m_Indices.get()),
-		sizeof(TriangleType),
-		m_VertexCount / 3);
+		m_IndexCount / 3,
+		sizeof(TriangleType));
 	Positions.reset(reinterpret_cast<Vector3*>(&m_Vertices[0].position),
-		sizeof(VertexType), m_VertexCount);
+		m_VertexCount, sizeof(VertexType));
 	Normals.reset(reinterpret_cast<Vector3*>(&m_Vertices[0].normal),
-		sizeof(VertexType), m_VertexCount);
+		m_VertexCount, sizeof(VertexType));
 	TexCoords.reset(reinterpret_cast<Vector2*>(&m_Vertices[0].textureCoordinate),
-		sizeof(VertexType), m_VertexCount);
+		m_VertexCount, sizeof(VertexType));
 	Tagents.reset(reinterpret_cast<Vector4*>(&m_Vertices[0].tangent),
-		sizeof(VertexType), m_VertexCount);
+		m_VertexCount, sizeof(VertexType));
 	BlendWeights.reset(&m_Vertices[0].weights,
-		sizeof(VertexType), m_VertexCount);
+		m_VertexCount, sizeof(VertexType));
 	BlendIndices.reset(&m_Vertices[0].indices,
-		sizeof(VertexType), m_VertexCount);
+		m_VertexCount, sizeof(VertexType));
 }
 
 XMUINT4 UnpackBlendIndices(uint32_t val)
@@ -658,97 +658,80 @@ XMUINT4 UnpackBlendIndices(uint32_t val)
 void DefaultSkinningModel::CaculateBoneBoxes(_In_reads_(m_BonesCount) const Matrix4x4* defaultBoneTransforms)
 {
 	assert(!Positions.empty() && !BlendWeights.empty());
-	std::vector<XMFLOAT4A, XMAllocator> points;
-	points.reserve(m_IndexCount);
 	m_BoneBoxes.resize(m_BonesCount);
-	BoundingBox box;
-	PackedVector::XMUBYTEN4 packed;
-	std::unordered_set<uint16_t> pointset(m_IndexCount);
 
-	for (int bone = 0; bone < m_BonesCount; bone++)
+	// Bucket the vertices by the bones they are weighted to with a counting sort,
+	// every bone then owns the contiguous slice [offsets[bone], offsets[bone + 1]) of points
+	std::vector<uint32_t> offsets(m_BonesCount + 1, 0);
+	auto forEachInfluence = [this](uint32_t vertex, auto&& func)
 	{
-		points.clear();
-		pointset.clear();
-		for (int idx = 0; idx < m_IndexCount / 3; idx++)
+		uint32_t indices = BlendIndices[vertex], weights = BlendWeights[vertex];
+		for (int j = 0; j < 4; j++)
 		{
-			int x, y, z;
-			x = BlendIndices[m_Indices[idx * 3 + 0]] & 0xff;
-			y = BlendIndices[m_Indices[idx * 3 + 1]] & 0xff;
-			z = BlendIndices[m_Indices[idx * 3 + 2]] & 0xff;
+			uint32_t bone = (indices >> (j * 8)) & 0xff;
+			if (((weights >> (j * 8)) & 0xff) == 0 || bone >= m_BonesCount)
+				continue;
+			// a bone listed twice in one vertex gets the vertex once
+			bool repeated = false;
+			for (int k = 0; k < j; k++)
+				repeated |= ((indices >> (k * 8)) & 0xff) == bone && ((weights >> (k * 8)) & 0xff) != 0;
+			if (!repeated)
+				func(bone);
+		}
+	};
 
-			if (x == bone || y == bone || z == bone)
-			{
-				x = m_Indices[idx * 3 + 0];
-				y = m_Indices[idx * 3 + 1];
-				z = m_Indices[idx * 3 + 2];
-				if (pointset.count(x) == 0)
-				{
-					pointset.insert(x);
-					points.emplace_back(&Positions[x].x);
-					points.back().w = 1.0f;
-				}
-				if (pointset.count(y) == 0)
-				{
-					pointset.insert(y);
-					points.emplace_back(&Positions[y].x);
-					points.back().w = 1.0f;
-				}
-				if (pointset.count(z) == 0)
-				{
-					pointset.insert(z);
-					points.emplace_back(&Positions[x].x);
-					points.back().w = 1.0f;
-				}
-			}
-			//packed.v = BlendWeights[0];
+	for (uint32_t i = 0; i < m_VertexCount; i++)
+		forEachInfluence(i, [&offsets](uint32_t bone) { ++offsets[bone + 1]; });
+	for (uint32_t bone = 0; bone < m_BonesCount; bone++)
+		offsets[bone + 1] += offsets[bone];
 
-			//Vector4 vweights = PackedVector::XMLoadUByteN4(&packed);
-			//XMUINT4 vindices = UnpackBlendIndices(BlendIndices[idx]);
+	std::vector<XMFLOAT4A, XMAllocator> points(offsets[m_BonesCount]);
+	std::vector<uint32_t> cursors(offsets.begin(), offsets.end() - 1);
+	for (uint32_t i = 0; i < m_VertexCount; i++)
+	{
+		forEachInfluence(i, [&](uint32_t bone)
+		{
+			auto& point = points[cursors[bone]++];
+			point = XMFLOAT4A(Positions[i].x, Positions[i].y, Positions[i].z, 1.0f);
+		});
+	}
 
-			//auto indices = &vindices.x;
-			//auto weights = &vweights.x;
+	// the slices are disjoint, so the bones are boxed in place in parallel
+	concurrency::parallel_for(0U, m_BonesCount, [&](uint32_t bone)
+	{
+		auto pPoints = points.data() + offsets[bone];
+		size_t count = offsets[bone + 1] - offsets[bone];
+		auto& boneBox = m_BoneBoxes[bone];
+		BoundingBox box;
 
-			//for (int j = 0; j < 4; j++)
-			//{
-			//	if (indices[j] == bone && weights[j] > 0.5f)
-			//	{
-			//		points.emplace_back(&Positions[idx].x);
-			//		points.back().w = 1.0f;
-			//		break;
-			//	}
-			//}
+		if (count == 0)
+		{
+			boneBox.Extents = { 0,0,0 };
+			return;
 		}
 
-		if (!points.empty())
+		if (defaultBoneTransforms != nullptr)
 		{
-			if (defaultBoneTransforms != nullptr)
-			{
-				XMMATRIX trans = XMLoad(defaultBoneTransforms[bone]);
-				XMVECTOR determinate;
-				XMMATRIX invTrans = XMMatrixInverse(&determinate, trans);
-
-				XMVector4TransformStream(points.data(), sizeof(XMFLOAT4A),
-					points.data(), sizeof(XMFLOAT4A),
-					points.size(), invTrans);
-
-				//BoundingBox::CreateFromPoints(box, points.size(), reinterpret_cast<XMFLOAT3A*>(points.data()), sizeof(XMFLOAT4A));
-				CreateBoundingBoxesFromPoints(box, m_BoneBoxes[bone], points.size(),
-					reinterpret_cast<XMFLOAT3A*>(points.data()), sizeof(XMFLOAT4A));
-
-				//m_BoneBoxes[bone].Center = box.Center;
-				//m_BoneBoxes[bone].Extents = box.Extents;
-				//m_BoneBoxes[bone].Extents.y = 0.1f;
-				m_BoneBoxes[bone].Transform(m_BoneBoxes[bone], trans);
-			}
-			else
-			{
-				CreateBoundingBoxesFromPoints(box, m_BoneBoxes[bone], points.size(),
-					reinterpret_cast<XMFLOAT3A*>(points.data()), sizeof(XMFLOAT4A));
-			}
+			// fit the box in the bone's bind space, so it follows the bone when transformed
+			XMMATRIX trans = XMLoad(defaultBoneTransforms[bone]);
+			XMVECTOR determinate;
+			XMMATRIX invTrans = XMMatrixInverse(&determinate, trans);
+
+			XMVector4TransformStream(pPoints, sizeof(XMFLOAT4A),
+				pPoints, sizeof(XMFLOAT4A),
+				count, invTrans);
+
+			CreateBoundingBoxesFromPoints(box, boneBox, count,
+				reinterpret_cast<XMFLOAT3A*>(pPoints), sizeof(XMFLOAT4A));
+
+			boneBox.Transform(boneBox, trans);
 		}
 		else
-			m_BoneBoxes[bone].Extents = { 0,0,0 };
-	}
+		{
+			CreateBoundingBoxesFromPoints(box, boneBox, count,
+				reinterpret_cast<XMFLOAT3A*>(pPoints), sizeof(XMFLOAT4A));
+		}
+	});
 }
 
 size_t DefaultSkinningModel::GetBonesCount() const
@@ -1256,5 +1239,57 @@ namespace DirectX {
 			pContext->Unmap(pIndexBuffer.Get(), 0);
 			IndexCount = indicesCount;
 		}
+
+		void DynamicMeshBuffer::UpdateVertexBuffer(ID3D11DeviceContext * pContext, const void * pVertics, size_t first, size_t count, size_t totalCount, size_t vertexSize)
+		{
+			D3D11_MAPPED_SUBRESOURCE mappedResource;
+
+			if (first + count > VertexBufferCapacity || totalCount > VertexBufferCapacity)
+				throw out_of_range("Input vertices data out of buffer capacity");
+
+			// elements below VertexCount may still be read by submitted draws, rewriting them needs a fresh buffer
+			if (first < VertexCount && count > 0)
+			{
+				UpdateVertexBuffer(pContext, const_cast<void*>(pVertics), totalCount, vertexSize);
+				return;
+			}
+
+			if (count > 0)
+			{
+				auto hr = pContext->Map(pVertexBuffer.Get(), 0, D3D11_MAP::D3D11_MAP_WRITE_NO_OVERWRITE, 0, &mappedResource);
+				ThrowIfFailed(hr);
+
+				memcpy(static_cast<char*>(mappedResource.pData) + first * vertexSize, static_cast<const char*>(pVertics) + first * vertexSize, count * vertexSize);
+
+				pContext->Unmap(pVertexBuffer.Get(), 0);
+			}
+			VertexCount = totalCount;
+		}
+
+		void DynamicMeshBuffer::UpdateIndexBuffer(ID3D11DeviceContext * pContext, const void * pIndices, size_t first, size_t count, size_t totalCount, size_t indexSize)
+		{
+			D3D11_MAPPED_SUBRESOURCE mappedResource;
+
+			if (first + count > IndexBufferCapacity || totalCount > IndexBufferCapacity)
+				throw out_of_range("Input indices data out of buffer capacity");
+
+			// elements below IndexCount may still be read by submitted draws, rewriting them needs a fresh buffer
+			if (first < IndexCount && count > 0)
+			{
+				UpdateIndexBuffer(pContext, const_cast<void*>(pIndices), totalCount, indexSize);
+				return;
+			}
+
+			if (count > 0)
+			{
+				auto hr = pContext->Map(pIndexBuffer.Get(), 0, D3D11_MAP::D3D11_MAP_WRITE_NO_OVERWRITE, 0, &mappedResource);
+				ThrowIfFailed(hr);
+
+				memcpy(static_cast<char*>(mappedResource.pData) + first * indexSize, static_cast<const char*>(pIndices) + first * indexSize, count * indexSize);
+
+				pContext->Unmap(pIndexBuffer.Get(), 0);
+			}
+			IndexCount = totalCount;
+		}
 	}
 }
\ No newline at end of file
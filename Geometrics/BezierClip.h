@@ -3,6 +3,7 @@
 #include <array>
 #include <algorithm>
 #include <cassert>
+#include <type_traits>
 
 namespace Geometrics
 {
@@ -45,6 +46,148 @@ namespace Geometrics
 				return (d < 0 || d > n) ? 0 : (((d == 0) || (n == d)) ? 1 : (Combination(d - 1, n - 1) + Combination(d, n - 1)));
 			}
 
+			// Compile time unrolled kernels, instantiated per order (the 3rd order patches and the 6th order metaball clippings)
+			// _Scalar may be float, or a SIMD vector type to run several clippings / parameters in lanes
+
+			// C[j] = q * C[j] + r * C[j + 1] , j in [J, End)
+			template <size_t J, size_t End, bool = (J < End)>
+			struct lerp_forward
+			{
+				template <class _Ty, class _Scalar>
+				static inline void apply(_Ty* C, const _Scalar& q, const _Scalar& r)
+				{
+					C[J] = q * C[J] + r * C[J + 1];
+					lerp_forward<J + 1, End>::apply(C, q, r);
+				}
+			};
+
+			template <size_t J, size_t End>
+			struct lerp_forward<J, End, false>
+			{
+				template <class _Ty, class _Scalar>
+				static inline void apply(_Ty*, const _Scalar&, const _Scalar&) {}
+			};
+
+			// C[j] = q * C[j - 1] + r * C[j] , j in (Begin, J] , descending
+			template <size_t J, size_t Begin, bool = (J > Begin)>
+			struct lerp_backward
+			{
+				template <class _Ty, class _Scalar>
+				static inline void apply(_Ty* C, const _Scalar& q, const _Scalar& r)
+				{
+					C[J] = q * C[J - 1] + r * C[J];
+					lerp_backward<J - 1, Begin>::apply(C, q, r);
+				}
+			};
+
+			template <size_t J, size_t Begin>
+			struct lerp_backward<J, Begin, false>
+			{
+				template <class _Ty, class _Scalar>
+				static inline void apply(_Ty*, const _Scalar&, const _Scalar&) {}
+			};
+
+			// de Casteljau levels I, I-1, ... 1 of an Order curve
+			template <size_t Order, size_t I = Order, bool = (I > 0)>
+			struct de_casteljau
+			{
+				// C becomes the [r,1] part
+				template <class _Ty, class _Scalar>
+				static inline void crop_front(_Ty* C, const _Scalar& q, const _Scalar& r)
+				{
+					lerp_forward<0, I>::apply(C, q, r);
+					de_casteljau<Order, I - 1>::crop_front(C, q, r);
+				}
+
+				// C becomes the [0,r] part
+				template <class _Ty, class _Scalar>
+				static inline void crop_back(_Ty* C, const _Scalar& q, const _Scalar& r)
+				{
+					lerp_backward<Order, Order - I>::apply(C, q, r);
+					de_casteljau<Order, I - 1>::crop_back(C, q, r);
+				}
+
+				// C becomes the [r,1] part, Front receives the [0,r] part
+				template <class _Ty, class _Scalar>
+				static inline void divide_front(_Ty* C, _Ty* Front, const _Scalar& q, const _Scalar& r)
+				{
+					lerp_forward<0, I>::apply(C, q, r);
+					Front[Order - I + 1] = C[0];
+					de_casteljau<Order, I - 1>::divide_front(C, Front, q, r);
+				}
+
+				// C becomes the [0,r] part, Back receives the [r,1] part
+				template <class _Ty, class _Scalar>
+				static inline void divide_back(_Ty* C, _Ty* Back, const _Scalar& q, const _Scalar& r)
+				{
+					lerp_backward<Order, Order - I>::apply(C, q, r);
+					Back[I - 1] = C[Order];
+					de_casteljau<Order, I - 1>::divide_back(C, Back, q, r);
+				}
+			};
+
+			template <size_t Order, size_t I>
+			struct de_casteljau<Order, I, false>
+			{
+				template <class _Ty, class _Scalar>
+				static inline void crop_front(_Ty*, const _Scalar&, const _Scalar&) {}
+				template <class _Ty, class _Scalar>
+				static inline void crop_back(_Ty*, const _Scalar&, const _Scalar&) {}
+				template <class _Ty, class _Scalar>
+				static inline void divide_front(_Ty*, _Ty*, const _Scalar&, const _Scalar&) {}
+				template <class _Ty, class _Scalar>
+				static inline void divide_back(_Ty*, _Ty*, const _Scalar&, const _Scalar&) {}
+			};
+
+			// value += sum of B(I..Order)(t) * C[i], P[i] = t^i, Q[i] = (1-t)^i
+			template <size_t Order, size_t I = 1, bool = (I <= Order)>
+			struct bernstein_sum
+			{
+				template <class _Ty, class _Scalar>
+				static inline void apply(_Ty& value, const _Ty* C, const _Scalar* P, const _Scalar* Q)
+				{
+					value += (P[I] * Q[Order - I] * static_cast<float>(std::integral_constant<size_t, Combination(I, Order)>::value)) * C[I];
+					bernstein_sum<Order, I + 1>::apply(value, C, P, Q);
+				}
+			};
+
+			template <size_t Order, size_t I>
+			struct bernstein_sum<Order, I, false>
+			{
+				template <class _Ty, class _Scalar>
+				static inline void apply(_Ty&, const _Ty*, const _Scalar*, const _Scalar*) {}
+			};
+
+			// P[i] = t^i, Q[i] = (1-t)^i , i in [0, N]
+			template <size_t N, size_t I = 0, bool = (I < N)>
+			struct powers
+			{
+				template <class _Scalar>
+				static inline void apply(_Scalar* P, _Scalar* Q, const _Scalar& t, const _Scalar& q)
+				{
+					P[I + 1] = P[I] * t;
+					Q[I + 1] = Q[I] * q;
+					powers<N, I + 1>::apply(P, Q, t, q);
+				}
+			};
+
+			template <size_t N, size_t I>
+			struct powers<N, I, false>
+			{
+				template <class _Scalar>
+				static inline void apply(_Scalar*, _Scalar*, const _Scalar&, const _Scalar&) {}
+			};
+
+			// Bernstein form evaluation at t, P and Q[0] must be initialized to one
+			template <size_t Order, class _Ty, class _Scalar>
+			inline _Ty bernstein_eval(const _Ty* C, const _Scalar& t, const _Scalar& q, _Scalar* P, _Scalar* Q)
+			{
+				powers<Order>::apply(P, Q, t, q);
+				_Ty value = Q[Order] * C[0];
+				bernstein_sum<Order>::apply(value, C, P, Q);
+				return value;
+			}
+
 			// static_assert
 			//const static size_t C62 = Combination(2, 6);
 			//const static size_t C64 = Combination(4, 6);
@@ -119,14 +262,7 @@ namespace Geometrics
 				C = *this;
 
 				FrontClipping[0] = C[0];
-				for (size_t i = Order; i > 0; --i)
-				{
-					for (size_t j = 0; j < i; ++j)
-					{
-						C[j] = (q*C[j]) + (r*C[j + 1]);
-					}
-					FrontClipping[Order - i] = C[0];
-				}
+				Internal::de_casteljau<Order>::divide_front(C.data(), FrontClipping.data(), q, r);
 			}
 
 			/// <summary>
@@ -141,42 +277,21 @@ namespace Geometrics
 				auto& Front = *this;
 
 				BackClipping[Order] = Front[Order];
-				for (size_t i = Order; i > 0; --i)
-				{
-					for (size_t j = Order; j > Order - i; --j)
-					{
-						Front[j] = (q*Front[j - 1]) + (r*Front[j]);
-					}
-					BackClipping[i - 1] = Front[Order];
-				}
+				Internal::de_casteljau<Order>::divide_back(Front.data(), BackClipping.data(), q, r);
 			}
 
 			void crop_front(float r)
 			{
 				assert(0 <= r && r <= 1);
 				const float q = 1 - r;
-
-				for (size_t i = Order; i > 0; --i)
-				{
-					for (size_t j = 0; j < i; ++j)
-					{
-						(*this)[j] = (q*(*this)[j]) + (r*(*this)[j + 1]);
-					}
-				}
+				Internal::de_casteljau<Order>::crop_front(this->data(), q, r);
 			}
 
 			void crop_back(float r)
 			{
 				assert(0 <= r && r <= 1);
 				const float q = 1 - r;
-
-				for (size_t i = Order; i > 0; --i)
-				{
-					for (size_t j = Order; j > Order - i; --j)
-					{
-						(*this)[j] = (q*(*this)[j - 1]) + (r*(*this)[j]);
-					}
-				}
+				Internal::de_casteljau<Order>::crop_back(this->data(), q, r);
 			}
 
 			void crop(float s, float t)
@@ -208,7 +323,7 @@ namespace Geometrics
 			BezierClipping subclip(float s, float t) const
 			{
 				assert(s < t);
-				BezierClipping clip;
+				BezierClipping clip(*this);
 				if (s == 0.0f)
 				{
 					clip.crop_back(t);
@@ -231,19 +346,7 @@ namespace Geometrics
 				float q = 1 - t;
 				std::array<float, Order + 1> P, Q;
 				P[0] = 1.0f; Q[0] = 1.0f;
-				for (size_t i = 0; i < Order; i++)
-				{
-					P[i + 1] = P[i] * t;
-					Q[i + 1] = Q[i] * q;
-				}
-
-				_Ty value = (*this)[0] * Q[Order];
-				for (int i = 1; i <= Order; i++)
-				{
-					value += P[i] * Q[Order - i] * Combination(i) * (*this)[i];
-				}
-
-				return value;
+				return Internal::bernstein_eval<Order>(this->data(), t, q, P.data(), Q.data());
 			}
 
 			ValueType tangent(float t) const
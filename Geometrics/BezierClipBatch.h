@@ -0,0 +1,233 @@
+#pragma once
+
+#include <DirectXMathExtend.h>
+#include <span.h>
+#include "BezierClip.h"
+
+namespace Geometrics
+{
+	namespace Bezier
+	{
+		/// <summary>
+		/// 4 float clippings in SIMD lanes, lane k of every control point belongs to the k-th clipping.
+		/// </summary>
+		template <size_t _Order>
+		using BezierClipping4 = BezierClipping<DirectX::XMVECTOR, _Order>;
+
+		/// <summary>
+		/// Evaluate the 4 clippings, each at its own parameter lane of t.
+		/// </summary>
+		template <size_t Order>
+		inline DirectX::XMVECTOR XM_CALLCONV eval(const BezierClipping4<Order>& clippings, DirectX::FXMVECTOR t)
+		{
+			using namespace DirectX;
+			XMVECTOR P[Order + 1], Q[Order + 1];
+			P[0] = Q[0] = g_XMOne.v;
+			return Internal::bernstein_eval<Order>(clippings.data(), t, XMVectorSubtract(g_XMOne.v, t), P, Q);
+		}
+
+		/// <summary>
+		/// Evaluate one clipping at many parameters, 4 parameters per step.
+		/// </summary>
+		template <size_t Order>
+		inline void eval(const BezierClipping<float, Order>& clipping, gsl::span<const float> ts, gsl::span<float> values)
+		{
+			using namespace DirectX;
+			assert(values.size() >= ts.size());
+
+			BezierClipping4<Order> C;
+			for (size_t i = 0; i <= Order; i++)
+				C[i] = XMVectorReplicate(clipping[i]);
+
+			size_t n = ts.size();
+			for (size_t i = 0; i < n; i += 4)
+			{
+				size_t m = std::min<size_t>(4, n - i);
+				XMFLOAT4A t(.0f, .0f, .0f, .0f), v;
+				std::copy_n(ts.data() + i, m, &t.x);
+				XMStoreFloat4A(&v, eval(C, XMLoadFloat4A(&t)));
+				std::copy_n(&v.x, m, values.data() + i);
+			}
+		}
+
+		/// <summary>
+		/// Crop every lane to its own parameter range [s, t].
+		/// </summary>
+		template <size_t Order>
+		inline void XM_CALLCONV crop(BezierClipping4<Order>& clippings, DirectX::FXMVECTOR s, DirectX::FXMVECTOR t)
+		{
+			using namespace DirectX;
+			XMVECTOR q = XMVectorSubtract(g_XMOne.v, s);
+			Internal::de_casteljau<Order>::crop_front(clippings.data(), q, s);
+			XMVECTOR r = XMVectorSaturate(XMVectorDivide(XMVectorSubtract(t, s), XMVectorMax(q, g_XMEpsilon.v)));
+			Internal::de_casteljau<Order>::crop_back(clippings.data(), XMVectorSubtract(g_XMOne.v, r), r);
+		}
+
+		/// <summary>
+		/// Lane wise intersection of the t-axis with the convex hull of the control polygons.
+		/// tmin is the crossing of the steepest line from the first control point, tmax of the steepest line from the last one.
+		/// </summary>
+		/// <returns>mask of the lanes whose control points are not all on one side of the t-axis</returns>
+		template <size_t Order>
+		inline DirectX::XMVECTOR XM_CALLCONV convex_hull_intersection(const BezierClipping4<Order>& D, DirectX::XMVECTOR& tmin, DirectX::XMVECTOR& tmax)
+		{
+			using namespace DirectX;
+			const float delta = 1.0f / (float)Order;
+			XMVECTOR zero = XMVectorZero();
+			XMVECTOR dmin = D[0], dmax = D[0];
+			XMVECTOR umin = g_XMInfinity.v;
+			tmin = g_XMInfinity.v;
+
+			for (size_t i = 1; i <= Order; i++)
+			{
+				dmin = XMVectorMin(dmin, D[i]);
+				dmax = XMVectorMax(dmax, D[i]);
+
+				// crossing of the line P(0)P(i), a negative or nan ratio means the line leaves the axis
+				XMVECTOR r = XMVectorDivide(D[0], XMVectorSubtract(D[0], D[i]));
+				tmin = XMVectorSelect(tmin, XMVectorMin(tmin, r * (i * delta)), XMVectorGreaterOrEqual(r, zero));
+
+				// crossing of the line P(Order)P(Order - i), measured from the back
+				r = XMVectorDivide(D[Order], XMVectorSubtract(D[Order], D[Order - i]));
+				umin = XMVectorSelect(umin, XMVectorMin(umin, r * (i * delta)), XMVectorGreaterOrEqual(r, zero));
+			}
+
+			tmin = XMVectorSaturate(tmin);
+			tmax = XMVectorMax(XMVectorSaturate(XMVectorSubtract(g_XMOne.v, umin)), tmin);
+			return XMVectorAndInt(XMVectorLessOrEqual(dmin, zero), XMVectorGreaterOrEqual(dmax, zero));
+		}
+
+		/// <summary>
+		/// Bezier clipping root isolation of 4 clippings in lanes, finds the first root of B(t) = 0 in each lane.
+		/// The hull clipping and cropping run in SIMD, lanes that need a subdivision keep their pending back halves in a small stack.
+		/// </summary>
+		/// <param name="clippings">The clippings.</param>
+		/// <param name="precision">Lane wise precision in the parameter space.</param>
+		/// <returns>Lane wise root in [0,1], or -1.0f if there is no root</returns>
+		template <size_t Order>
+		inline DirectX::XMVECTOR XM_CALLCONV solove_first_root(const BezierClipping4<Order>& clippings, DirectX::FXMVECTOR precision)
+		{
+			using namespace DirectX;
+			const unsigned int MaxIteration = 64;
+			const int MaxDepth = 24;
+
+			XMFLOAT4A precise, roots(-1.0f, -1.0f, -1.0f, -1.0f);
+			XMStoreFloat4A(&precise, precision);
+
+			// interval of the current lane clipping in the original parameter space
+			float begin[4] = { .0f, .0f, .0f, .0f }, end[4] = { 1.0f, 1.0f, 1.0f, 1.0f };
+			float pending[4][MaxDepth][2];
+			int depth[4] = { 0, 0, 0, 0 };
+			bool active[4] = { true, true, true, true };
+
+			BezierClipping4<Order> D = clippings;
+			for (unsigned int iteration = 0; iteration < MaxIteration; iteration++)
+			{
+				XMVECTOR vmin, vmax;
+				XMVECTOR vhull = convex_hull_intersection(D, vmin, vmax);
+				XMFLOAT4A tmin, tmax;
+				XMStoreFloat4A(&tmin, vmin);
+				XMStoreFloat4A(&tmax, vmax);
+				uint32_t hull[4];
+				XMStoreInt4(hull, vhull);
+
+				// the crop of each lane relative to its source, restarting lanes crop the original clipping
+				XMFLOAT4A from(.0f, .0f, .0f, .0f), to(1.0f, 1.0f, 1.0f, 1.0f);
+				uint32_t restart[4] = { 0, 0, 0, 0 };
+				bool any = false;
+				for (int k = 0; k < 4; k++)
+				{
+					if (!active[k])
+						continue;
+
+					float lo = (&tmin.x)[k], hi = (&tmax.x)[k];
+					if (hull[k])
+					{
+						float width = end[k] - begin[k];
+						float a = begin[k] + width * lo, b = begin[k] + width * hi;
+						if (b - a <= (&precise.x)[k])
+						{
+							(&roots.x)[k] = 0.5f * (a + b);
+							active[k] = false;
+							continue;
+						}
+
+						if (hi - lo > 0.5f && depth[k] < MaxDepth)
+						{
+							// several roots or a poor clip, continue on the front half
+							float mid = 0.5f * (a + b);
+							pending[k][depth[k]][0] = mid;
+							pending[k][depth[k]][1] = b;
+							++depth[k];
+							b = mid;
+							hi = 0.5f * (lo + hi);
+						}
+						(&from.x)[k] = lo;
+						(&to.x)[k] = hi;
+						begin[k] = a;
+						end[k] = b;
+					}
+					else if (depth[k] > 0)
+					{
+						--depth[k];
+						begin[k] = pending[k][depth[k]][0];
+						end[k] = pending[k][depth[k]][1];
+						(&from.x)[k] = begin[k];
+						(&to.x)[k] = end[k];
+						restart[k] = 0xFFFFFFFF;
+					}
+					else
+					{
+						active[k] = false;
+						continue;
+					}
+					any = true;
+				}
+
+				if (!any)
+					break;
+
+				XMVECTOR vrestart = XMLoadInt4(restart);
+				for (size_t i = 0; i <= Order; i++)
+					D[i] = XMVectorSelect(D[i], clippings[i], vrestart);
+				crop(D, XMLoadFloat4A(&from), XMLoadFloat4A(&to));
+			}
+
+			return XMLoadFloat4A(&roots);
+		}
+
+		/// <summary>
+		/// Batch version of solove_first_root(clipping, T, preciese), clippings are solved 4 per step.
+		/// </summary>
+		/// <param name="clippings">The clippings.</param>
+		/// <param name="T">The target value T, Equation : B(root) = T.</param>
+		/// <param name="precisions">Precision of each clipping.</param>
+		/// <param name="roots">Output root in [0,1] of each clipping, or -1.0f if there is no root.</param>
+		template <size_t Order>
+		inline void solove_first_roots(gsl::span<const BezierClipping<float, Order>> clippings, float T, gsl::span<const float> precisions, gsl::span<float> roots)
+		{
+			using namespace DirectX;
+			size_t n = clippings.size();
+			assert(precisions.size() >= n && roots.size() >= n);
+
+			for (size_t i = 0; i < n; i += 4)
+			{
+				size_t m = std::min<size_t>(4, n - i);
+				BezierClipping4<Order> C;
+				for (size_t j = 0; j <= Order; j++)
+				{
+					// unused lanes are constant 1, no root
+					XMFLOAT4A lanes(1.0f, 1.0f, 1.0f, 1.0f);
+					for (size_t k = 0; k < m; k++)
+						(&lanes.x)[k] = clippings[i + k][j] - T;
+					C[j] = XMLoadFloat4A(&lanes);
+				}
+
+				XMFLOAT4A precise(1.0f, 1.0f, 1.0f, 1.0f), r;
+				std::copy_n(precisions.data() + i, m, &precise.x);
+				XMStoreFloat4A(&r, solove_first_root(C, XMLoadFloat4A(&precise)));
+				std::copy_n(&r.x, m, roots.data() + i);
+			}
+		}
+	}
+}
@@ -1,8 +1,9 @@
 #pragma once
 #include "BezierClip.h"
 #include <vector>
-#include <list>
 #include "csg.h"
+#include "MeshAdjacency.h"
+#include "HalfEdgeMesh.h"
 
 namespace Geometrics
 {
@@ -16,56 +17,30 @@ namespace Geometrics
 			typedef BezierClipping<PointType, 3>  CurveType;
 			typedef BezierPatch<PointType, 3>	  PatchType;
 
-			class BezierMesh;
-
-			class HalfEdge;
-
-			class Face;
-
-			struct Vertex
-			{
-				PointType position;
-
-				BezierMesh* mesh;
-
-				std::list<HalfEdge*> in_edges;
-				std::list<HalfEdge*> out_edges;
-			};
-
-			struct HalfEdge
-			{
-				CurveType curve;
-
-				// owner mesh
-				BezierMesh* mesh;
-
-				// incident vertex
-				Vertex* vertex;
-				// incident face
-				Face*	face;
-
-				// opposite half edge
-				HalfEdge* opposite;
-				// previous half edge
-				HalfEdge* prev;
-				// next half edge
-				HalfEdge* next;
-
-				const Vertex* incident_vertex() const { return nullptr; }
-				Vertex* incident_vertex() { return nullptr; }
-			};
-
-			struct Face
-			{
-				PatchType patch;
-
-				HalfEdge* boundry_edge;
-			};
-
+			/// <summary>
+			/// Bezier mesh over an index based half-edge topology,
+			/// the corner points, the edge curves (one per half-edge) and the patches (one per face) are tables indexed by the topology.
+			/// </summary>
 			class BezierMesh
 			{
 			public:
-				std::vector<Vertex> Vertices;
+				HalfEdgeTopology		Topology;
+				std::vector<PointType>	Vertices;
+				std::vector<CurveType>	Curves;
+				std::vector<PatchType>	Patches;
+
+				void clear()
+				{
+					Topology.clear();
+					Vertices.clear();
+					Curves.clear();
+					Patches.clear();
+				}
+
+				// the curve of half-edge h
+				const CurveType& curve(HalfEdgeTopology::index_type h) const { return Curves[h]; }
+				// the patch of the face incident to half-edge h, h must not be a boundary half-edge
+				const PatchType& patch(HalfEdgeTopology::index_type h) const { return Patches[Topology.face(h)]; }
 			};
 		}
 	}
@@ -73,108 +48,157 @@ namespace Geometrics
 	template <typename _Ty, int _Order>
 	bool is_curve_degreed(const Bezier::BezierClipping<_Ty, _Order>& latitude, float epsilon)
 	{
-		return ((latitude[0] - latitude[1]).Length() < epsilon) && ((latitude[1] - latitude[2]).Length() < epsilon) && ((latitude[2] - latitude[3]).Length() < epsilon);
+		return ((latitude[0] - latitude[1]).Length() < epsilon) && ((latitude[1] - latitude[2]).Length() < epsilon) && ((latitude[2] - latitude[3]).Length() < epsilon);
 	}
 
-	template <typename _Ty, int _Order, typename MeshType>
-	bool triangluate(const Bezier::BezierPatch<_Ty, _Order>& patch, MeshType& mesh, int tessellation, bool flip = false, const DirectX::Vector4 &uvRect = DirectX::Vector4(.0f,.0f,1.f,1.f))
+	namespace Bezier
 	{
-		using namespace DirectX::VertexTraits;
-		if (tessellation == 0)
-			return false;
-		size_t offset = mesh.vertices.size();
-		size_t stride = tessellation + 1;
-
-		MeshType::VertexType d_vertex;
-		using DirectX::XMVECTOR;
-
-		float delta = 1.0f / (float)tessellation;
-
-		static constexpr float epsilon = std::numeric_limits<float>::epsilon() * 100;
-		for (size_t i = 0; i <= tessellation; i++)
-		{
-			float u = (float)i * delta;
-
-			auto latitude = patch.row_clipping(u);
-
-			if (is_curve_degreed(latitude,epsilon))
-				latitude = patch.row_clipping(u + copysignf(0.01f * delta, 0.5f - u));
-
-			for (size_t j = 0; j <= tessellation; j++)
-			{
-				float v = (float)j  * delta;
-				XMVECTOR position = latitude.eval(v);
-				XMVECTOR tangent = latitude.tangent(v);
-				//tangent = DirectX::XMVector3Normalize(tangent);
-				// storage the tangent info in normal field
-
-				set_position(d_vertex, position);
-				set_uv(d_vertex, u * uvRect.z + uvRect.x, v * uvRect.w + uvRect.y);
-				set_normal(d_vertex, tangent);
-				set_tangent(d_vertex, tangent);
-
-				mesh.vertices.push_back(d_vertex);
-			}
-		}
-
-		// Fix normals
-		if (has_normal<MeshType::VertexType>::value)
-		{
-			for (size_t j = 0; j <= tessellation; j++)
-			{
-				float v = (float)j * delta;
-
-				auto longitude = patch.col_clipping(v);
-
-				if (is_curve_degreed(longitude, epsilon))
-					longitude = patch.col_clipping(v + copysignf(0.01f * delta, 0.5f - v));
-
-
-				for (size_t i = 0; i <= tessellation; i++)
-				{
-					float u = (float)i  * delta;
-					XMVECTOR binormal = longitude.tangent(u);
-
-					int idx = offset + i * stride + j;
-					auto& vertex = mesh.vertices[idx];
-
-					XMVECTOR tangent = get_normal(vertex);
-
-					XMVECTOR normal = DirectX::XMVector3Cross(tangent, binormal);
-					normal = DirectX::XMVector3Normalize(normal);
-
-					if (flip)
-						normal = -normal;
-
-					set_normal(vertex, normal);
-				}
-			}
-		}
-
-		for (size_t i = 0; i < tessellation; i++)
-		{
-			for (size_t j = 0; j < tessellation; j++)
-			{
-				// Make a list of six index values (two triangles).
-				mesh.add_facet(
-					offset + i * stride + j,
-					offset + (i + 1) * stride + j,
-					offset + (i + 1) * stride + j + 1);
-				mesh.add_facet(
-					offset + i * stride + j,
-					offset + (i + 1) * stride + j + 1,
-					offset + i * stride + j + 1);
-
-				if (flip)
-				{
-					auto pIdices = &mesh.indices.back() - 5;
-					std::swap(pIdices[0], pIdices[2]);
-					std::swap(pIdices[3], pIdices[5]);
-				}
-
-			}
+		// Bernstein weights (and their derivatives if dw is not null) of an _Order curve at t
+		template <size_t _Order>
+		inline void bernstein_weights(float t, float* w, float* dw)
+		{
+			BezierClipping<float, _Order> basis;
+			for (size_t a = 0; a <= _Order; a++)
+			{
+				basis.fill(.0f);
+				basis[a] = 1.0f;
+				w[a] = basis.eval(t);
+				if (dw)
+					dw[a] = basis.tangent(t);
+			}
 		}
+	}
+
+	/// <summary>
+	/// Tessellate patches into uniform (tessellation + 1)^2 vertex grids appended to mesh, same layout and winding as triangluate.
+	/// The Bernstein weights of the grid parameters are tabulated once, each grid row is P(u, v) = Bv . C . Bu^T,
+	/// rows of all patches are evaluated in parallel and written straight into the mesh storage.
+	/// </summary>
+	/// <param name="patches">The patches.</param>
+	/// <param name="mesh">The output mesh.</param>
+	/// <param name="tessellation">Quads per patch side.</param>
+	/// <param name="flips">Optional, per patch, reverse the winding and normals.</param>
+	/// <param name="uvRect">uv = (u * z + x, v * w + y).</param>
+	template <typename _Ty, size_t _Order, typename MeshType>
+	bool tessellate(gsl::span<const Bezier::BezierPatch<_Ty, _Order>> patches, MeshType& mesh, int tessellation, gsl::span<const bool> flips = gsl::span<const bool>(), const DirectX::Vector4 &uvRect = DirectX::Vector4(.0f, .0f, 1.f, 1.f))
+	{
+		using namespace DirectX;
+		using namespace DirectX::VertexTraits;
+		typedef typename MeshType::VertexType VertexType;
+		typedef typename MeshType::IndexType IndexType;
+		static constexpr size_t N = _Order + 1;
+
+		if (tessellation <= 0)
+			return false;
+		assert(flips.size() == 0 || flips.size() >= patches.size());
+
+		size_t stride = tessellation + 1;
+		size_t gridSize = stride * stride;
+		size_t patchIndices = 6 * tessellation * tessellation;
+		size_t vbase = mesh.vertices.size();
+		size_t ibase = mesh.indices.size();
+		mesh.vertices.resize(vbase + patches.size() * gridSize);
+		mesh.indices.resize(ibase + patches.size() * patchIndices);
+
+		float delta = 1.0f / (float)tessellation;
+		std::vector<float> B(stride * N), dB(stride * N);
+		for (size_t k = 0; k < stride; k++)
+			Bezier::bernstein_weights<_Order>(std::min(1.0f, k * delta), &B[k * N], &dB[k * N]);
+
+		static constexpr float epsilon = std::numeric_limits<float>::epsilon() * 100;
+		size_t rows = patches.size() * stride;
+		Internal::for_each_chunk(rows, Internal::chunk_count(rows, std::max<size_t>(1, 1024 / stride)), [&](size_t, size_t begin, size_t end) {
+			float w[N];
+			for (size_t row = begin; row < end; row++)
+			{
+				size_t p = row / stride, i = row % stride;
+				const auto& patch = patches[p];
+				bool flip = flips.size() > 0 && flips[p];
+				float u = std::min(1.0f, i * delta);
+
+				// the curve of this u over the first control point index, and its u derivative
+				XMVECTOR R[N], dR[N];
+				for (size_t a = 0; a < N; a++)
+				{
+					R[a] = dR[a] = XMVectorZero();
+					for (size_t b = 0; b < N; b++)
+					{
+						XMVECTOR c = patch.control_point(a, b);
+						R[a] += B[i * N + b] * c;
+						dR[a] += dB[i * N + b] * c;
+					}
+				}
+
+				VertexType* vertices = &mesh.vertices[vbase + p * gridSize + i * stride];
+				for (size_t j = 0; j < stride; j++)
+				{
+					const float* Bv = &B[j * N];
+					const float* dBv = &dB[j * N];
+					XMVECTOR position = XMVectorZero(), tangent = XMVectorZero(), binormal = XMVectorZero();
+					for (size_t a = 0; a < N; a++)
+					{
+						position += Bv[a] * R[a];
+						tangent += dBv[a] * R[a];
+						binormal += Bv[a] * dR[a];
+					}
+
+					// degenerated rows / columns (poles), take the derivative slightly inside the patch
+					float v = std::min(1.0f, j * delta);
+					if (XMVector3Less(XMVector3LengthSq(tangent), XMVectorReplicate(epsilon)))
+					{
+						Bezier::bernstein_weights<_Order>(u + copysignf(0.01f * delta, 0.5f - u), w, nullptr);
+						tangent = XMVectorZero();
+						for (size_t a = 0; a < N; a++)
+							for (size_t b = 0; b < N; b++)
+								tangent += (dBv[a] * w[b]) * XMVECTOR(patch.control_point(a, b));
+					}
+					if (XMVector3Less(XMVector3LengthSq(binormal), XMVectorReplicate(epsilon)))
+					{
+						Bezier::bernstein_weights<_Order>(v + copysignf(0.01f * delta, 0.5f - v), w, nullptr);
+						binormal = XMVectorZero();
+						for (size_t a = 0; a < N; a++)
+							binormal += w[a] * dR[a];
+					}
+
+					XMVECTOR normal = XMVector3Normalize(XMVector3Cross(tangent, binormal));
+					if (flip)
+						normal = -normal;
+
+					auto& vertex = vertices[j];
+					vertex = VertexType();
+					set_position(vertex, position);
+					set_uv(vertex, u * uvRect.z + uvRect.x, v * uvRect.w + uvRect.y);
+					set_normal(vertex, normal);
+					set_tangent(vertex, tangent);
+				}
+
+				if (i + 1 == stride)
+					continue;
+
+				// the two triangles of each quad in this row
+				size_t offset = vbase + p * gridSize;
+				IndexType* indices = &mesh.indices[ibase + p * patchIndices + i * tessellation * 6];
+				for (size_t j = 0; j + 1 < stride; j++, indices += 6)
+				{
+					IndexType i0 = static_cast<IndexType>(offset + i * stride + j);
+					IndexType i1 = static_cast<IndexType>(offset + (i + 1) * stride + j);
+					indices[0] = i0; indices[1] = i1; indices[2] = i1 + 1;
+					indices[3] = i0; indices[4] = i1 + 1; indices[5] = i0 + 1;
+					if (flip)
+					{
+						std::swap(indices[0], indices[2]);
+						std::swap(indices[3], indices[5]);
+					}
+				}
+			}
+		});
 
 		return true;
 	}
+
+	template <typename _Ty, int _Order, typename MeshType>
+	bool triangluate(const Bezier::BezierPatch<_Ty, _Order>& patch, MeshType& mesh, int tessellation, bool flip = false, const DirectX::Vector4 &uvRect = DirectX::Vector4(.0f,.0f,1.f,1.f))
+	{
+		return tessellate(gsl::span<const Bezier::BezierPatch<_Ty, _Order>>(&patch, 1), mesh, tessellation, gsl::span<const bool>(&flip, 1), uvRect);
+	}
 }
\ No newline at end of file
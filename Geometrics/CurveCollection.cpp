@@ -0,0 +1,121 @@
+#define NOMINMAX
+#include "CurveCollection.h"
+#include "MeshAdjacency.h"
+
+using namespace Geometrics;
+using namespace DirectX;
+
+void CurveCollection::build()
+{
+	size_t n = m_curves.size();
+	std::vector<XMFLOAT3> cmin(n), cmax(n);
+	for (size_t i = 0; i < n; i++)
+	{
+		auto& tree = m_curves[i]->bvh();
+		if (tree.empty())
+		{
+			// empty or single anchor curve
+			XMFLOAT3 p = m_curves[i]->empty() ? XMFLOAT3(FLT_MAX, FLT_MAX, FLT_MAX) : reinterpret_cast<const XMFLOAT3&>(m_curves[i]->anchor(0));
+			cmin[i] = cmax[i] = p;
+		}
+		else
+		{
+			cmin[i] = reinterpret_cast<const XMFLOAT3&>(tree[0].min);
+			cmax[i] = reinterpret_cast<const XMFLOAT3&>(tree[0].max);
+		}
+	}
+	build_flat_bvh(n, cmin.data(), cmax.data(), m_nodes, m_order, 2);
+}
+
+CurveHit XM_CALLCONV CurveCollection::closestPoint(FXMVECTOR p, float maxDistance) const
+{
+	assert(!dirty());
+	CurveHit best;
+	float bestDis = maxDistance;
+	traverse_flat_bvh(m_nodes, [&](const FlatBVHNode& node) {
+		if (node.distance_sq(p) > bestDis * bestDis)
+			return false;
+		for (uint32_t i = node.first; node.is_leaf() && i < node.first + node.count; i++)
+		{
+			auto hit = m_curves[m_order[i]]->closestPoint(p, bestDis);
+			if (hit.valid() && hit.distance <= bestDis)
+			{
+				hit.curve = m_order[i];
+				bestDis = hit.distance;
+				best = hit;
+			}
+		}
+		return true;
+	});
+	return best;
+}
+
+CurveHit XM_CALLCONV CurveCollection::rayDistance(FXMVECTOR origin, FXMVECTOR direction, float maxDistance) const
+{
+	assert(!dirty());
+	CurveHit best;
+	float bestDis = maxDistance;
+	XMVECTOR invDir = ray_inverse_direction(XMVector3Normalize(direction));
+	traverse_flat_bvh(m_nodes, [&](const FlatBVHNode& node) {
+		if (!node.intersects(origin, invDir, bestDis, FLT_MAX))
+			return false;
+		for (uint32_t i = node.first; node.is_leaf() && i < node.first + node.count; i++)
+		{
+			auto hit = m_curves[m_order[i]]->rayDistance(origin, direction, bestDis);
+			if (hit.valid() && hit.distance <= bestDis)
+			{
+				hit.curve = m_order[i];
+				bestDis = hit.distance;
+				best = hit;
+			}
+		}
+		return true;
+	});
+	return best;
+}
+
+size_t XM_CALLCONV CurveCollection::querySphere(FXMVECTOR center, float radius, std::vector<CurveHit>& hits) const
+{
+	assert(!dirty());
+	size_t count = 0;
+	std::vector<uint32_t> segments;
+	traverse_flat_bvh(m_nodes, [&](const FlatBVHNode& node) {
+		if (node.distance_sq(center) > radius * radius)
+			return false;
+		for (uint32_t i = node.first; node.is_leaf() && i < node.first + node.count; i++)
+		{
+			segments.clear();
+			auto& curve = *m_curves[m_order[i]];
+			curve.querySphere(center, radius, &segments);
+			for (auto seg : segments)
+			{
+				auto hit = curve.segmentClosestPoint(seg, center);
+				hit.curve = m_order[i];
+				hits.push_back(hit);
+			}
+			count += segments.size();
+		}
+		return true;
+	});
+	return count;
+}
+
+void CurveCollection::closestPoints(gsl::span<const point_type> points, gsl::span<CurveHit> hits, float maxDistance) const
+{
+	assert(hits.size() >= points.size());
+	size_t n = points.size();
+	Internal::for_each_chunk(n, Internal::chunk_count(n, 64), [&](size_t, size_t begin, size_t end) {
+		for (size_t i = begin; i < end; i++)
+			hits[i] = closestPoint(XMLoadFloat3(&points[i]), maxDistance);
+	});
+}
+
+void CurveCollection::rayDistances(gsl::span<const point_type> origins, gsl::span<const point_type> directions, gsl::span<CurveHit> hits, float maxDistance) const
+{
+	assert(directions.size() == origins.size() && hits.size() >= origins.size());
+	size_t n = origins.size();
+	Internal::for_each_chunk(n, Internal::chunk_count(n, 64), [&](size_t, size_t begin, size_t end) {
+		for (size_t i = begin; i < end; i++)
+			hits[i] = rayDistance(XMLoadFloat3(&origins[i]), XMLoadFloat3(&directions[i]), maxDistance);
+	});
+}
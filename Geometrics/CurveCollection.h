@@ -0,0 +1,39 @@
+#pragma once
+
+#include <vector>
+#include "SpaceCurve.h"
+
+namespace Geometrics
+{
+	// A set of curves (e.g. all strokes of a drawing) with a two level bvh for picking
+	// The top level tree bounds every curve, each curve answers with its own segment bvh
+	// Curves are referenced, call build() after any of them is edited
+	class CurveCollection
+	{
+	public:
+		typedef DirectX::XMFLOAT3 point_type;
+
+		void clear() { m_curves.clear(); m_nodes.clear(); }
+		void add(const SpaceCurve* curve) { m_curves.push_back(curve); m_nodes.clear(); }
+		size_t size() const { return m_curves.size(); }
+		const SpaceCurve& operator[](size_t idx) const { return *m_curves[idx]; }
+
+		// rebuild the top level tree and the outdated curve trees, queries are thread safe afterwards
+		void build();
+		bool dirty() const { return m_nodes.empty() && !m_curves.empty(); }
+
+		CurveHit XM_CALLCONV closestPoint(FXMVECTOR p, float maxDistance = FLT_MAX) const;
+		CurveHit XM_CALLCONV rayDistance(FXMVECTOR origin, FXMVECTOR direction, float maxDistance) const;
+		// every (curve, segment) within radius of center, appended to hits
+		size_t XM_CALLCONV querySphere(FXMVECTOR center, float radius, std::vector<CurveHit>& hits) const;
+
+		// batch forms, queries are distributed over worker threads
+		void closestPoints(gsl::span<const point_type> points, gsl::span<CurveHit> hits, float maxDistance = FLT_MAX) const;
+		void rayDistances(gsl::span<const point_type> origins, gsl::span<const point_type> directions, gsl::span<CurveHit> hits, float maxDistance) const;
+
+	private:
+		std::vector<const SpaceCurve*>	m_curves;
+		std::vector<FlatBVHNode>		m_nodes;
+		std::vector<uint32_t>			m_order;
+	};
+}
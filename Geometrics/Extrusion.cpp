@@ -8,13 +8,13 @@ using namespace std;
 typedef uint16_t IndexType;
 
 Extrusion::Extrusion()
-	: m_top(nullptr), m_bottom(nullptr), m_path(nullptr), m_dirty(1)
+	: m_top(nullptr), m_bottom(nullptr), m_path(nullptr), m_dirty(1), m_ringInterval(.0f), m_dirtyRange{}
 {
 
 }
 
 Extrusion::Extrusion(SurfacePatch * top, SurfacePatch * bottom, Curve * axis)
-	: m_top(top), m_bottom(bottom), m_path(axis), m_dirty(1)
+	: m_top(top), m_bottom(bottom), m_path(axis), m_dirty(1), m_ringInterval(.0f), m_dirtyRange{}
 {}
 
 Extrusion::~Extrusion()
@@ -69,10 +69,11 @@ void XM_CALLCONV centralize(_Inout_ Curve & curve, FXMVECTOR center, FXMVECTOR r
 		{
 			curve.anchor(i) = temp.anchor((minAidx + i) % n);
 		}
-
-		curve.updateLength();
 	}
 
+	// the anchors were edited in place
+	curve.updateLength();
+
 }
 
 RigidTransform XM_CALLCONV centralize(Curve& curve, FXMVECTOR identityAxis = DirectX::g_XMIdentityR1.v, bool rotateRespectPolarAngle = true);
@@ -119,6 +120,18 @@ RigidTransform XM_CALLCONV centralize(_Inout_ Curve & curve, FXMVECTOR identityA
 	return transform;
 }
 
+// fill the SoA sweep profile with the first count anchors of a centralized curve
+void assignProfile(SweepProfile& profile, const Curve& curve, int count)
+{
+	std::vector<Vector3> positions(count), tangents(count);
+	for (int i = 0; i < count; i++)
+	{
+		positions[i] = curve.position(i);
+		tangents[i] = curve.tangent(i);
+	}
+	profile.assign<Vector3>(positions, tangents);
+}
+
 template <typename IndexType>
 std::enable_if_t<std::is_integral<IndexType>::value> pushTriangle(vector<IndexType>& indices, IndexType a, IndexType b, IndexType c)
 {
@@ -126,6 +139,23 @@ std::enable_if_t<std::is_integral<IndexType>::value> pushTriangle(vector<IndexTy
 	indices.push_back(b);
 	indices.push_back(c);
 }
+
+// the quads between the ring starting at vertex first and the next one, rings are polarSubdiv + 1 vertices
+template <typename IndexType>
+void pushRingRow(vector<IndexType>& indices, size_t first, int polarSubdiv)
+{
+	int cols = polarSubdiv + 1;
+	for (int i = 0; i < polarSubdiv; ++i)
+	{
+		IndexType idx = static_cast<IndexType>(first + i);
+		IndexType upIdx = idx + cols;
+		IndexType idx_1 = idx + 1;
+		IndexType upIdx_1 = idx_1 + cols;
+
+		pushTriangle(indices, idx, idx_1, upIdx);
+		pushTriangle(indices, idx_1, upIdx_1, upIdx);
+	}
+}
 // triangulate top and bottom with path into m_mesh
 MeshType & Extrusion::triangulate(int axisSubdiv, int polarSubdiv)
 {
@@ -183,9 +213,34 @@ MeshType & Extrusion::triangulate(int axisSubdiv, int polarSubdiv)
 
 	int idxBase = vertices.size();
 
+	if (!useTop)
+	{
+		// frames along the resampled path, then all rings in the batch kernel
+		int rings = axisSubdiv + 1;
+		Curve::AnchorCollection positions(rings), tangents(rings);
+		std::vector<float> params(rings);
+		for (int axisIdx = 0; axisIdx < rings; axisIdx++)
+		{
+			XMStoreFloat4A(&positions[axisIdx], path.position(axisIdx));
+			// tangent(int) is a central difference over the arc length, the frames need unit tangents
+			XMStoreFloat4A(&tangents[axisIdx], XMVector3Normalize(path.tangent(axisIdx)));
+			params[axisIdx] = axisIdx * interval;
+		}
+		XMStoreFloat4A(&tangents[0], t0);
+
+		std::vector<SweepFrame, AlignedAllocator<SweepFrame>> frames(rings);
+		compute_rotation_minimizing_frames(positions, tangents, XMVector3Rotate(g_XMIdentityR0.v, r0), frames);
+
+		SweepProfile profile;
+		assignProfile(profile, bottom, polarSubdiv + 1);
+
+		vertices.resize(rings * (polarSubdiv + 1));
+		sweep_profile<DefaultVertex>(frames, params, profile, vertices);
+	}
+
 	XMVECTOR r0t = XMQuaternionIdentity();
 	XMVECTOR tprev = t0;
-	for (int axisIdx = 0; axisIdx <= axisSubdiv; axisIdx++)
+	for (int axisIdx = 0; useTop && axisIdx <= axisSubdiv; axisIdx++)
 	{
 		float t = axisIdx * interval;
 		XMVECTOR tv = XMVectorReplicate(t);
@@ -252,6 +307,148 @@ MeshType & Extrusion::triangulate(int axisSubdiv, int polarSubdiv)
 
 	//m_mesh.build();
 
+	m_rings.clear();
+	m_profile.clear();
+	m_tail.vertices.clear();
+	m_tail.indices.clear();
+	m_dirtyRange = { 0, vertices.size(), 0, indices.size() };
+
+	m_dirty = false;
+	return m_mesh;
+}
+
+MeshType & Extrusion::triangulateIncremental(float ringInterval, int polarSubdiv)
+{
+	using namespace DirectX;
+	using namespace DirectX::VertexTraits;
+	assert(m_bottom != nullptr && m_path != nullptr && ringInterval > .0f);
+	XMVECTOR stdAxis = g_XMIdentityR1.v;
+
+	auto& path = *m_path;
+	auto& vertices = m_mesh.vertices;
+	auto& indices = m_mesh.indices;
+
+	float length = path.length();
+	// committed rings sit at k * ringInterval <= length, the end of the path is the provisional tail ring
+	int rings = (int)floorf(length / ringInterval) + 1;
+	int cols = polarSubdiv + 1;
+
+	Curve bottom = m_bottom->boundry();
+	bottom.resample(polarSubdiv);
+
+	// a changed profile, subdivision or ring interval, or a shorter path invalidates every ring
+	int oldRings = (int)m_rings.size() / RingStateStride;
+	bool relayout = m_profile.size() != (size_t)cols || m_ringInterval != ringInterval || rings < oldRings;
+	for (int i = 0; i < cols && !relayout; i++)
+		relayout = !XMVector3NearEqual(bottom.position(i), m_profile[i], g_XMEpsilon.v);
+
+	XMVECTOR initialNormal, t0 = stdAxis;
+	if (relayout)
+	{
+		m_profile.resize(cols);
+		for (int i = 0; i < cols; i++)
+			m_profile[i] = bottom.position(i);
+		m_ringInterval = ringInterval;
+		m_rings.clear();
+		vertices.clear();
+		indices.clear();
+		oldRings = 0;
+
+		// the section is fixed by the path start when the first ring is committed
+		XMVECTOR p0 = path.position(0);
+		t0 = path.tangent(0);
+		if (XMVector4Less(t0, g_XMEpsilon.v))
+			t0 = stdAxis;
+		XMVECTOR r0 = XMQuaternionRotationVectorToVector(stdAxis, t0);
+		centralize(bottom, p0, XMQuaternionConjugate(r0), true);
+		assignProfile(m_section, bottom, cols);
+		initialNormal = XMVector3Rotate(g_XMIdentityR0.v, r0);
+	}
+	else
+	{
+		initialNormal = XMLoadFloat4A(&m_rings[(oldRings - 1) * RingStateStride + 1]);
+	}
+
+	// committed rings are never rewritten, the frames continue from the last one
+	// the new batch is [last committed ring, new rings, tail ring]
+	int base = std::max(oldRings - 1, 0);
+	float lastParam = (rings - 1) * ringInterval;
+	bool hasTail = length - lastParam > g_XMEpsilon.f[0];
+	int batch = rings - base + hasTail;
+
+	Curve::AnchorCollection positions(batch), tangents(batch);
+	std::vector<float> params(batch);
+	Curve::Sampler sampler(path);
+	for (int i = 0; i < batch; i++)
+	{
+		int axisIdx = base + i;
+		if (axisIdx < oldRings)
+		{
+			auto* state = &m_rings[axisIdx * RingStateStride];
+			positions[i] = state[0];
+			tangents[i] = state[2];
+			params[i] = state[3].x;
+			continue;
+		}
+		float t = axisIdx < rings ? axisIdx * ringInterval : length;
+		XMStoreFloat4A(&positions[i], sampler.position(t));
+		// tangent(t) lerps the anchor tangents, the frames need unit tangents
+		XMStoreFloat4A(&tangents[i], XMVector3Normalize(axisIdx == 0 ? t0 : path.tangent(t)));
+		params[i] = t;
+	}
+
+	std::vector<SweepFrame, AlignedAllocator<SweepFrame>> frames(batch);
+	compute_rotation_minimizing_frames(positions, tangents, initialNormal, frames);
+
+	// commit the new rings, per ring : position, frame axis 0 and 1, (t,0,0,0)
+	m_rings.resize(rings * RingStateStride);
+	vertices.resize(rings * cols);
+	for (int axisIdx = oldRings; axisIdx < rings; axisIdx++)
+	{
+		const auto& frame = frames[axisIdx - base];
+		auto* state = &m_rings[axisIdx * RingStateStride];
+		state[0] = frame.position;
+		state[1] = frame.axis[0];
+		state[2] = frame.axis[1];
+		state[3] = XMFLOAT4A(params[axisIdx - base], .0f, .0f, .0f);
+	}
+
+	if (oldRings < rings)
+	{
+		size_t count = rings - oldRings;
+		sweep_profile<DefaultVertex>(
+			gsl::span<const SweepFrame>(frames.data() + (oldRings - base), count),
+			gsl::span<const float>(params.data() + (oldRings - base), count),
+			m_section,
+			gsl::span<DefaultVertex>(vertices.data() + oldRings * cols, count * cols));
+	}
+
+	// the quads of ring rows [0, rings - 1), only rows past the old ring count are new
+	size_t indexBegin = indices.size();
+	size_t firstRow = indices.size() / (6 * polarSubdiv);
+	indices.reserve(6 * (rings - 1) * polarSubdiv);
+	for (int axisIdx = (int)firstRow; axisIdx < rings - 1; axisIdx++)
+		pushRingRow(indices, axisIdx * cols, polarSubdiv);
+
+	// the tail is the last committed ring and the ring at the path end, rebuilt on every call
+	m_tail.vertices.clear();
+	m_tail.indices.clear();
+	if (hasTail)
+	{
+		m_tail.vertices.resize(2 * cols);
+		sweep_profile<DefaultVertex>(
+			gsl::span<const SweepFrame>(frames.data() + (rings - 1 - base), 2),
+			gsl::span<const float>(params.data() + (rings - 1 - base), 2),
+			m_section,
+			gsl::span<DefaultVertex>(m_tail.vertices.data(), 2 * cols));
+		pushRingRow(m_tail.indices, 0, polarSubdiv);
+	}
+
+	m_dirtyRange.vertexBegin = oldRings * cols;
+	m_dirtyRange.vertexEnd = rings * cols;
+	m_dirtyRange.indexBegin = indexBegin;
+	m_dirtyRange.indexEnd = indices.size();
+
 	m_dirty = false;
 	return m_mesh;
 }
@@ -293,33 +490,100 @@ void SurfacePatch::closeLoop()
 	m_uvCurve.closeLoop();
 }
 
-XMVECTOR SurfacePatch::unproject(XMVECTOR uv, int& fid)
+const UVFacetGrid & SurfacePatch::uvIndex()
+{
+	if (m_uvIndex.empty() && m_surface)
+		m_uvIndex.build(*m_surface);
+	return m_uvIndex;
+}
+
+XMVECTOR SurfacePatch::walkUnproject(XMVECTOR uv, int& fid) const
 {
 	auto& vertics = m_surface->vertices;
-	auto& tri = m_surface->facet(fid);
-	auto BC = TriangleTests::BarycentricCoordinate(uv, vertics[tri[0]].uv, vertics[tri[1]].uv, vertics[tri[2]].uv);
+	XMVECTOR BC;
 
+	// every step crosses one edge, bound the walk so a uv outside the surface terminates
+	size_t maxSteps = m_surface->facets().size();
+	for (size_t step = 0; ; step++)
+	{
+		auto& tri = m_surface->facet(fid);
+		BC = TriangleTests::BarycentricCoordinate(uv, vertics[tri[0]].uv, vertics[tri[1]].uv, vertics[tri[2]].uv);
 
-	XMVECTOR vali = XMVectorLessOrEqual(BC, XMVectorZero());
-	XMUINT3 out;
-	XMStoreUInt3(&out, vali);
+		XMVECTOR vali = XMVectorLessOrEqual(BC, XMVectorZero());
+		XMUINT3 out;
+		XMStoreUInt3(&out, vali);
 
-	if (out.x)
-		fid = m_surface->adjacentFacet(fid, 0);
-	else if (out.y)
-		fid = m_surface->adjacentFacet(fid, 1);
-	else if (out.z)
-		fid = m_surface->adjacentFacet(fid, 2);
-	else
-		return XMVectorBaryCentricV(vertics[tri[0]].position, vertics[tri[1]].position, vertics[tri[2]].position, BC);
-	return unproject(uv, fid);
+		int edge = out.x ? 0 : out.y ? 1 : out.z ? 2 : -1;
+		if (edge < 0 || step >= maxSteps)
+			break;
 
+		// reached the surface boundary, clamp to this facet
+		auto rev = m_surface->revedges[fid * 3 + edge];
+		if (rev == static_cast<IndexType>(-1))
+		{
+			BC = XMVectorSaturate(BC);
+			BC /= XMVector3Dot(BC, g_XMOne.v);
+			break;
+		}
+		fid = m_surface->adjacentFacet(fid, edge);
+	}
 
+	auto& tri = m_surface->facet(fid);
+	return XMVectorBaryCentricV(vertics[tri[0]].position, vertics[tri[1]].position, vertics[tri[2]].position, BC);
+}
+
+XMVECTOR SurfacePatch::unproject(XMVECTOR uv, int& fid)
+{
+	XMFLOAT3 bc;
+	int hit = uvIndex().locate(uv, bc);
+	if (hit < 0)
+		return walkUnproject(uv, fid);
+
+	fid = hit;
+	auto& vertics = m_surface->vertices;
+	auto& tri = m_surface->facet(fid);
+	return XMVectorBaryCentricV(vertics[tri[0]].position, vertics[tri[1]].position, vertics[tri[2]].position, XMLoadFloat3(&bc));
+}
+
+void SurfacePatch::unproject(gsl::span<const Vector2> uvs, gsl::span<Vector3> positions, gsl::span<int> fids)
+{
+	uvIndex().unproject(*m_surface, uvs, positions, fids);
 }
 
 void SurfacePatch::unprojectBoundry(int startFid)
 {
-	assert(!"Not implemented yet");
+	auto n = m_uvCurve.size();
+	std::vector<Vector2> uvs(n);
+	std::vector<Vector3> positions(n);
+	m_fids.resize(n);
+
+	for (size_t i = 0; i < n; i++)
+	{
+		auto& ach = m_uvCurve.anchor(i);
+		uvs[i] = Vector2(ach.x, ach.y);
+	}
+
+	unproject(uvs, positions, m_fids);
+
+	// uvs missed by the index (outside the surface) walk from the previous facet
+	int fid = startFid;
+	for (size_t i = 0; i < n; i++)
+	{
+		if (m_fids[i] < 0)
+		{
+			m_fids[i] = fid;
+			positions[i] = walkUnproject(uvs[i], m_fids[i]);
+		}
+		fid = m_fids[i];
+	}
+
+	bool close = m_uvCurve.isClose();
+	m_boundry.clear();
+	m_boundry.setClose(false);
+	for (size_t i = 0; i < n; i++)
+		m_boundry.append(positions[i], true);
+	m_boundry.setClose(close);
+
 	m_dirty = 0;
 }
 
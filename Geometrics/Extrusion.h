@@ -3,6 +3,8 @@
 #include <cassert>
 #include "csg.h"
 #include "SpaceCurve.h"
+#include "UVFacetGrid.h"
+#include "SweepKernel.h"
 
 namespace Geometrics
 {
@@ -42,10 +44,20 @@ namespace Geometrics
 		
 		int			m_dirty;
 
+		// uv-space facet index of m_surface, built lazily
+		UVFacetGrid	m_uvIndex;
+
+		// walk facet to facet in uv space from fid, used when the uv is not covered by the index
+		XMVECTOR walkUnproject(XMVECTOR uv, int& fid) const;
+
 	public:
 		MeshType& surface() { return *m_surface; }
 		const MeshType& surface() const { return *m_surface; }
-		void setSurface(MeshType* surface) { m_surface = surface; m_dirty = 1; };
+		void setSurface(MeshType* surface) { m_surface = surface; m_uvIndex.clear(); m_dirty = 1; };
+
+		// the uv-space index of surface, call invalidateSurface if the surface uv or topology changed
+		const UVFacetGrid& uvIndex();
+		void invalidateSurface() { m_uvIndex.clear(); m_dirty = 1; }
 
 		//Curve& boundry();
 		const Curve& boundry() const;
@@ -60,9 +72,12 @@ namespace Geometrics
 		bool append(XMVECTOR position, int fid);
 		void closeLoop();
 
-		// convert uv to positon in world space
+		// convert uv to positon in world space, fid is the hint facet and receives the facet contains uv
 		XMVECTOR unproject(XMVECTOR uv, int& fid);
 
+		// batch convert uvs to positions in world space, fids receive the facet of each uv (-1 if uv is outside the surface)
+		void unproject(gsl::span<const Vector2> uvs, gsl::span<Vector3> positions, gsl::span<int> fids);
+
 		// unproject uv curve to the spatial curve
 		void unprojectBoundry(int startFid);
 
@@ -74,11 +89,35 @@ namespace Geometrics
 	using std::vector;
 	class Extrusion
 	{
+	public:
+		// range of the mesh rewritten by the last triangulate call, [begin, end)
+		struct DirtyRange
+		{
+			size_t vertexBegin, vertexEnd;
+			size_t indexBegin, indexEnd;
+
+			bool empty() const { return vertexBegin >= vertexEnd && indexBegin >= indexEnd; }
+		};
+
+	private:
 		SurfacePatch *m_top, *m_bottom;
 		Curve *m_path;
 		MeshType m_mesh;
 		int		m_dirty;
 
+		// incremental sweep state, per committed ring : position, frame axis 0 and 1, (t,0,0,0)
+		static constexpr int RingStateStride = 4;
+		std::vector<XMFLOAT4A, DirectX::AlignedAllocator<XMFLOAT4A>>
+				m_rings;
+		// resampled bottom profile the rings were built with, and its centralized section
+		std::vector<Vector3>
+				m_profile;
+		SweepProfile	m_section;
+		float	m_ringInterval;
+		// the last committed ring and the ring at the path end
+		MeshType m_tail;
+		DirtyRange m_dirtyRange;
+
 	public:
 		Extrusion();
 
@@ -106,5 +145,16 @@ namespace Geometrics
 		// triangulate top and bottom with path into m_mesh
 		MeshType& triangulate(int axisSubdiv, int polarSubdiv);
 
+		// sweep the bottom profile along path with a ring every ringInterval into mesh(), and the ring at the path end into tail()
+		// rings in mesh() are committed once and kept while the path grows, so appending to the path
+		// only adds the new rings, see dirtyRange(), a changed profile, ring interval or a shorter path rebuilds them all
+		// the top patch is not used in this mode
+		MeshType& triangulateIncremental(float ringInterval, int polarSubdiv);
+
+		// the range of mesh() written by the last triangulate call
+		const DirtyRange& dirtyRange() const { return m_dirtyRange; }
+		// the provisional quads from the last committed ring to the path end, rebuilt by every triangulateIncremental
+		const MeshType& tail() const { return m_tail; }
+
 	};
 }
\ No newline at end of file
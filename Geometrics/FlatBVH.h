@@ -0,0 +1,159 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <vector>
+#include <algorithm>
+#include <DirectXMathExtend.h>
+
+namespace Geometrics
+{
+	/// <summary>
+	/// Flat bounding volume hierarchy node, 32 bytes, nodes are stored in preorder.
+	/// Leaf (count > 0) : primitives [first, first + count) of the primitive table.
+	/// Internal (count == 0) : left child is the next node, right child is node 'first'.
+	/// </summary>
+	struct FlatBVHNode
+	{
+		float		min[3];
+		uint32_t	first;
+		float		max[3];
+		uint32_t	count;
+
+		bool is_leaf() const { return count > 0; }
+		DirectX::XMVECTOR XM_CALLCONV vmin() const { return DirectX::XMLoadFloat3(reinterpret_cast<const DirectX::XMFLOAT3*>(min)); }
+		DirectX::XMVECTOR XM_CALLCONV vmax() const { return DirectX::XMLoadFloat3(reinterpret_cast<const DirectX::XMFLOAT3*>(max)); }
+
+		// squared distance from p to the box, 0 inside
+		float XM_CALLCONV distance_sq(DirectX::FXMVECTOR p) const
+		{
+			using namespace DirectX;
+			XMVECTOR d = XMVectorMax(vmin() - p, XMVectorZero());
+			d = XMVectorMax(d, p - vmax());
+			return XMVectorGetX(XMVector3LengthSq(d));
+		}
+
+		// slab test of ray (origin, 1/direction) against the box inflated by 'inflate', within [0, maxT]
+		bool XM_CALLCONV intersects(DirectX::FXMVECTOR origin, DirectX::FXMVECTOR invDir, float inflate, float maxT) const
+		{
+			using namespace DirectX;
+			XMVECTOR e = XMVectorReplicate(inflate);
+			XMVECTOR t0 = (vmin() - e - origin) * invDir;
+			XMVECTOR t1 = (vmax() + e - origin) * invDir;
+			XMVECTOR tmin = XMVectorMin(t0, t1);
+			XMVECTOR tmax = XMVectorMax(t0, t1);
+			float enter = std::max(std::max(XMVectorGetX(tmin), XMVectorGetY(tmin)), std::max(XMVectorGetZ(tmin), .0f));
+			float exit = std::min(std::min(XMVectorGetX(tmax), XMVectorGetY(tmax)), std::min(XMVectorGetZ(tmax), maxT));
+			return enter <= exit;
+		}
+	};
+
+	// 1/direction for FlatBVHNode::intersects, zero components become a tiny value of the same sign,
+	// so a ray parallel to a slab gives huge but finite distances instead of 0 * inf = NaN
+	inline DirectX::XMVECTOR XM_CALLCONV ray_inverse_direction(DirectX::FXMVECTOR direction)
+	{
+		using namespace DirectX;
+		XMVECTOR tiny = XMVectorReplicate(1e-20f);
+		XMVECTOR sign = XMVectorAndInt(direction, g_XMNegativeZero.v);
+		XMVECTOR zero = XMVectorLess(XMVectorAbs(direction), tiny);
+		return XMVectorReciprocal(XMVectorSelect(direction, XMVectorOrInt(tiny, sign), zero));
+	}
+
+	/// <summary>
+	/// Build a flat BVH over primitive bounding boxes by median split on the longest centroid axis.
+	/// primitives receive the primitive ids in leaf order.
+	/// </summary>
+	inline void build_flat_bvh(size_t n, const DirectX::XMFLOAT3* pmin, const DirectX::XMFLOAT3* pmax,
+		std::vector<FlatBVHNode>& nodes, std::vector<uint32_t>& primitives, uint32_t leafSize = 4)
+	{
+		using namespace DirectX;
+
+		nodes.clear();
+		primitives.resize(n);
+		if (n == 0)
+			return;
+
+		std::vector<XMFLOAT3> centers(n);
+		for (size_t i = 0; i < n; i++)
+		{
+			XMStoreFloat3(&centers[i], (XMLoadFloat3(&pmin[i]) + XMLoadFloat3(&pmax[i])) * 0.5f);
+			primitives[i] = static_cast<uint32_t>(i);
+		}
+
+		nodes.reserve(2 * n / leafSize + 1);
+
+		// preorder build with an explicit stack, right child index is patched when its subtree starts
+		struct Range { uint32_t begin, end, parent; };
+		std::vector<Range> stack;
+		stack.push_back({ 0, static_cast<uint32_t>(n), uint32_t(-1) });
+		while (!stack.empty())
+		{
+			Range r = stack.back();
+			stack.pop_back();
+
+			uint32_t idx = static_cast<uint32_t>(nodes.size());
+			if (r.parent != uint32_t(-1))
+				nodes[r.parent].first = idx;
+
+			nodes.emplace_back();
+			auto& node = nodes.back();
+			uint32_t p = primitives[r.begin];
+			XMVECTOR bmin = XMLoadFloat3(&pmin[p]), bmax = XMLoadFloat3(&pmax[p]);
+			XMVECTOR cmin = XMLoadFloat3(&centers[p]), cmax = cmin;
+			for (uint32_t i = r.begin + 1; i < r.end; i++)
+			{
+				p = primitives[i];
+				bmin = XMVectorMin(bmin, XMLoadFloat3(&pmin[p]));
+				bmax = XMVectorMax(bmax, XMLoadFloat3(&pmax[p]));
+				XMVECTOR c = XMLoadFloat3(&centers[p]);
+				cmin = XMVectorMin(cmin, c);
+				cmax = XMVectorMax(cmax, c);
+			}
+			XMStoreFloat3(reinterpret_cast<XMFLOAT3*>(node.min), bmin);
+			XMStoreFloat3(reinterpret_cast<XMFLOAT3*>(node.max), bmax);
+
+			if (r.end - r.begin <= leafSize)
+			{
+				node.first = r.begin;
+				node.count = r.end - r.begin;
+				continue;
+			}
+
+			XMFLOAT3 ext;
+			XMStoreFloat3(&ext, cmax - cmin);
+			int axis = ext.x > ext.y ? (ext.x > ext.z ? 0 : 2) : (ext.y > ext.z ? 1 : 2);
+			uint32_t mid = r.begin + (r.end - r.begin) / 2;
+			std::nth_element(primitives.begin() + r.begin, primitives.begin() + mid, primitives.begin() + r.end,
+				[&](uint32_t a, uint32_t b) { return (&centers[a].x)[axis] < (&centers[b].x)[axis]; });
+
+			node.first = 0;
+			node.count = 0;
+			// left is popped first so it directly follows its parent
+			stack.push_back({ mid, r.end, idx });
+			stack.push_back({ r.begin, mid, uint32_t(-1) });
+		}
+	}
+
+	/// <summary>
+	/// Depth first traversal, visit(node) returns false to prune the subtree.
+	/// </summary>
+	template <class _Visitor>
+	inline void traverse_flat_bvh(const std::vector<FlatBVHNode>& nodes, _Visitor&& visit)
+	{
+		if (nodes.empty())
+			return;
+
+		uint32_t stack[64];
+		int top = 0;
+		stack[top++] = 0;
+		while (top > 0)
+		{
+			uint32_t idx = stack[--top];
+			const auto& node = nodes[idx];
+			if (!visit(node) || node.is_leaf())
+				continue;
+			stack[top++] = node.first;
+			stack[top++] = idx + 1;
+		}
+	}
+}
@@ -0,0 +1,263 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include <iterator>
+#include <type_traits>
+#include "MeshAdjacency.h"
+
+namespace Geometrics
+{
+	/// <summary>
+	/// Index based half-edge topology in three flat tables with 32-bit indices.
+	/// Every table holds trivially copyable records, so copying a topology (e.g. an undo snapshot) is a plain memcpy of the tables.
+	/// Unpaired half-edges are closed by boundary half-edges (face == InvalidIndex), so vertex rings are complete on the boundary too.
+	/// </summary>
+	class HalfEdgeTopology
+	{
+	public:
+		typedef uint32_t index_type;
+		static constexpr index_type InvalidIndex = static_cast<index_type>(-1);
+
+		struct HalfEdge
+		{
+			// the vertex this half-edge points to
+			index_type vertex;
+			// InvalidIndex for boundary half-edges
+			index_type face;
+			index_type next;
+			index_type prev;
+			index_type twin;
+		};
+
+		struct Vertex
+		{
+			// an outgoing half-edge, the boundary one for boundary vertices, InvalidIndex for isolated vertices
+			index_type halfedge;
+		};
+
+		struct Face
+		{
+			index_type halfedge;
+		};
+
+		static_assert(std::is_trivially_copyable<HalfEdge>::value && std::is_trivially_copyable<Vertex>::value && std::is_trivially_copyable<Face>::value,
+			"topology tables must stay memcpy-able");
+
+		std::vector<HalfEdge>	halfedges;
+		std::vector<Vertex>		vertices;
+		std::vector<Face>		faces;
+
+		void clear()
+		{
+			halfedges.clear();
+			vertices.clear();
+			faces.clear();
+		}
+
+		bool empty() const { return faces.empty(); }
+
+		/// <summary>
+		/// Build from polygon loops in CSR form, face f is faceVertices[faceOffsets[f], faceOffsets[f + 1]).
+		/// The interior half-edge faceOffsets[f] + i goes from the i-th to the (i+1)-th vertex of the loop,
+		/// boundary half-edges are appended after all interior ones.
+		/// Edges shared by more than two half-edges, or by two of the same direction, are non-manifold and treated as boundary.
+		/// </summary>
+		/// <returns>the number of non-manifold half-edges</returns>
+		size_t build(gsl::span<const index_type> faceOffsets, gsl::span<const index_type> faceVertices, size_t vertexCount)
+		{
+			using namespace Internal;
+			clear();
+			assert(vertexCount < InvalidIndex);
+
+			size_t fsize = faceOffsets.size() > 0 ? faceOffsets.size() - 1 : 0;
+			size_t esize = fsize > 0 ? faceOffsets[fsize] : 0;
+			assert(esize <= faceVertices.size());
+
+			halfedges.resize(esize);
+			faces.resize(fsize);
+			vertices.assign(vertexCount, Vertex{ InvalidIndex });
+
+			unsigned vbits = bit_width(vertexCount > 0 ? vertexCount - 1 : 0);
+			std::vector<HalfEdgeKey> keys(esize), temp(esize);
+
+			for_each_chunk(fsize, chunk_count(fsize), [&](size_t, size_t begin, size_t end) {
+				for (size_t f = begin; f < end; f++)
+				{
+					index_type first = faceOffsets[f], n = faceOffsets[f + 1] - first;
+					faces[f].halfedge = n > 0 ? first : InvalidIndex;
+					for (index_type i = 0; i < n; i++)
+					{
+						index_type h = first + i;
+						index_type next = first + (i + 1) % n;
+						uint64_t v0 = faceVertices[h];
+						uint64_t v1 = faceVertices[next];
+						halfedges[h] = HalfEdge{ static_cast<index_type>(v1), static_cast<index_type>(f), next, first + (i + n - 1) % n, InvalidIndex };
+
+						auto& k = keys[h];
+						k.reversed = v0 > v1;
+						k.key = k.reversed ? (v1 << vbits) | v0 : (v0 << vbits) | v1;
+						k.eid = h;
+					}
+				}
+			});
+
+			for (index_type h = 0; h < esize; h++)
+				vertices[faceVertices[h]].halfedge = h;
+
+			const HalfEdgeKey* sorted = parallel_radix_sort(keys.data(), temp.data(), esize, vbits * 2);
+
+			size_t nonManifold = 0;
+			for (size_t i = 0; i < esize;)
+			{
+				size_t j = i + 1;
+				while (j < esize && sorted[j].key == sorted[i].key)
+					++j;
+
+				if (j - i == 2 && sorted[i].reversed != sorted[i + 1].reversed)
+				{
+					halfedges[sorted[i].eid].twin = sorted[i + 1].eid;
+					halfedges[sorted[i + 1].eid].twin = sorted[i].eid;
+				}
+				else if (j - i > 1)
+				{
+					nonManifold += j - i;
+				}
+				i = j;
+			}
+
+			// close every unpaired half-edge with a boundary one, then chain the boundary loops
+			std::vector<index_type> boundaryOut(vertexCount, InvalidIndex);
+			for (index_type h = 0; h < esize; h++)
+			{
+				if (halfedges[h].twin != InvalidIndex)
+					continue;
+				index_type g = static_cast<index_type>(halfedges.size());
+				index_type from = halfedges[h].vertex;
+				halfedges.push_back(HalfEdge{ faceVertices[h], InvalidIndex, InvalidIndex, InvalidIndex, h });
+				halfedges[h].twin = g;
+				boundaryOut[from] = g;
+			}
+
+			for (size_t g = esize; g < halfedges.size(); g++)
+			{
+				index_type next = boundaryOut[halfedges[g].vertex];
+				halfedges[g].next = next;
+				if (next != InvalidIndex)
+					halfedges[next].prev = static_cast<index_type>(g);
+			}
+
+			for (size_t v = 0; v < vertexCount; v++)
+			{
+				if (boundaryOut[v] != InvalidIndex)
+					vertices[v].halfedge = boundaryOut[v];
+			}
+
+			return nonManifold;
+		}
+
+		/// <summary>
+		/// Build from fixed size faces (Triangle, std::array ...).
+		/// For triangles, half-edge 3 * f + i goes from tri[i] to tri[(i + 1) % 3], that is TriangleMesh's edge 3 * f + (i + 2) % 3.
+		/// </summary>
+		template <class _FaceType>
+		size_t build(gsl::span<const _FaceType> facets, size_t vertexCount)
+		{
+			std::vector<index_type> offsets(facets.size() + 1), loops;
+			offsets[0] = 0;
+			for (size_t f = 0; f < facets.size(); f++)
+			{
+				const auto& face = facets[f];
+				for (auto v : face)
+					loops.push_back(static_cast<index_type>(v));
+				offsets[f + 1] = static_cast<index_type>(loops.size());
+			}
+			return build(offsets, loops, vertexCount);
+		}
+
+		// Build from any mesh with facets() and vertices, e.g. TriangleMesh
+		template <class _MeshType>
+		size_t build(const _MeshType& mesh)
+		{
+			return build(mesh.facets(), mesh.vertices.size());
+		}
+
+		inline index_type target(index_type h) const { return halfedges[h].vertex; }
+		inline index_type source(index_type h) const { return halfedges[halfedges[h].twin].vertex; }
+		inline index_type face(index_type h) const { return halfedges[h].face; }
+		inline index_type next(index_type h) const { return halfedges[h].next; }
+		inline index_type prev(index_type h) const { return halfedges[h].prev; }
+		inline index_type twin(index_type h) const { return halfedges[h].twin; }
+		inline bool is_boundary(index_type h) const { return halfedges[h].face == InvalidIndex; }
+		inline bool is_boundary_vertex(index_type v) const { auto h = vertices[v].halfedge; return h != InvalidIndex && is_boundary(h); }
+
+		// the next outgoing half-edge around the source vertex of h
+		inline index_type rotate(index_type h) const
+		{
+			index_type p = halfedges[h].prev;
+			return p != InvalidIndex ? halfedges[p].twin : InvalidIndex;
+		}
+
+		/// <summary>
+		/// Forward iterator over the half-edges reached from a start half-edge by next (face loop) or rotate (vertex ring),
+		/// ends when it comes back to the start or hits an unlinked half-edge.
+		/// </summary>
+		class circulator
+		{
+		public:
+			typedef std::forward_iterator_tag iterator_category;
+			typedef index_type value_type;
+			typedef ptrdiff_t difference_type;
+			typedef const index_type* pointer;
+			typedef const index_type& reference;
+
+			circulator() : m_topology(nullptr), m_start(InvalidIndex), m_current(InvalidIndex), m_steps(0), m_ring(false) {}
+			circulator(const HalfEdgeTopology* topology, index_type start, bool ring)
+				: m_topology(topology), m_start(start), m_current(start), m_steps(0), m_ring(ring) {}
+
+			reference operator*() const { return m_current; }
+
+			circulator& operator++()
+			{
+				m_current = m_ring ? m_topology->rotate(m_current) : m_topology->next(m_current);
+				// the step bound only guards against broken links of non-manifold input
+				if (m_current == m_start || ++m_steps >= m_topology->halfedges.size())
+					m_current = InvalidIndex;
+				return *this;
+			}
+
+			circulator operator++(int) { circulator c = *this; ++(*this); return c; }
+
+			bool operator==(const circulator& rhs) const { return m_current == rhs.m_current; }
+			bool operator!=(const circulator& rhs) const { return m_current != rhs.m_current; }
+
+		private:
+			const HalfEdgeTopology* m_topology;
+			index_type	m_start;
+			index_type	m_current;
+			size_t		m_steps;
+			bool		m_ring;
+		};
+
+		struct circulator_range
+		{
+			circulator first;
+			circulator begin() const { return first; }
+			circulator end() const { return circulator(); }
+		};
+
+		// the half-edges of face f, in loop order
+		circulator_range face_loop(index_type f) const { return circulator_range{ circulator(this, faces[f].halfedge, false) }; }
+
+		// the outgoing half-edges of vertex v, target() of each gives the one ring
+		circulator_range vertex_ring(index_type v) const { return circulator_range{ circulator(this, vertices[v].halfedge, true) }; }
+
+		size_t valence(index_type v) const
+		{
+			size_t n = 0;
+			for (auto h : vertex_ring(v))
+				(void)h, ++n;
+			return n;
+		}
+	};
+}
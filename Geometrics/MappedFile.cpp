@@ -0,0 +1,191 @@
+#define NOMINMAX
+#include "MappedFile.h"
+#include <utility>
+
+#if defined(_WIN32)
+#define WIN32_LEAN_AND_MEAN
+#include <Windows.h>
+#else
+#include <string>
+#include <codecvt>
+#include <locale>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+using namespace Geometrics;
+
+#if !defined(_WIN32)
+namespace
+{
+	// posix file apis take narrow paths, wide paths are encoded as utf-8
+	std::string native_path(const std::wstring& path)
+	{
+		return std::wstring_convert<std::codecvt_utf8<wchar_t>>().to_bytes(path);
+	}
+}
+#endif
+
+bool Geometrics::open_output_file(std::ofstream & file, const std::wstring & path)
+{
+#if defined(_WIN32)
+	file.open(path, std::ios::binary | std::ios::trunc);
+#else
+	file.open(native_path(path), std::ios::binary | std::ios::trunc);
+#endif
+	return file.is_open();
+}
+
+#if defined(_WIN32)
+
+MappedFile::MappedFile()
+	: m_data(nullptr), m_size(0), m_file(INVALID_HANDLE_VALUE), m_mapping(nullptr)
+{}
+
+bool MappedFile::open(const std::wstring & path)
+{
+	close();
+
+	m_file = CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+	if (m_file == INVALID_HANDLE_VALUE)
+		return false;
+
+	LARGE_INTEGER size;
+	if (!GetFileSizeEx(m_file, &size) || size.QuadPart == 0)
+	{
+		close();
+		return false;
+	}
+
+	m_mapping = CreateFileMappingW(m_file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	if (m_mapping == nullptr)
+	{
+		close();
+		return false;
+	}
+
+	m_data = static_cast<const uint8_t*>(MapViewOfFile(m_mapping, FILE_MAP_READ, 0, 0, 0));
+	if (m_data == nullptr)
+	{
+		close();
+		return false;
+	}
+
+	m_size = static_cast<size_t>(size.QuadPart);
+	return true;
+}
+
+void MappedFile::close()
+{
+	if (m_data)
+		UnmapViewOfFile(m_data);
+	if (m_mapping)
+		CloseHandle(m_mapping);
+	if (m_file != INVALID_HANDLE_VALUE)
+		CloseHandle(m_file);
+	m_data = nullptr;
+	m_size = 0;
+	m_mapping = nullptr;
+	m_file = INVALID_HANDLE_VALUE;
+}
+
+MappedFile::MappedFile(MappedFile && rhs)
+	: m_data(rhs.m_data), m_size(rhs.m_size), m_file(rhs.m_file), m_mapping(rhs.m_mapping)
+{
+	rhs.m_data = nullptr;
+	rhs.m_size = 0;
+	rhs.m_file = INVALID_HANDLE_VALUE;
+	rhs.m_mapping = nullptr;
+}
+
+MappedFile & MappedFile::operator=(MappedFile && rhs)
+{
+	if (this != &rhs)
+	{
+		close();
+		std::swap(m_data, rhs.m_data);
+		std::swap(m_size, rhs.m_size);
+		std::swap(m_file, rhs.m_file);
+		std::swap(m_mapping, rhs.m_mapping);
+	}
+	return *this;
+}
+
+#else
+
+MappedFile::MappedFile()
+	: m_data(nullptr), m_size(0), m_file(-1)
+{}
+
+bool MappedFile::open(const std::wstring & path)
+{
+	close();
+
+	m_file = ::open(native_path(path).c_str(), O_RDONLY);
+	if (m_file < 0)
+		return false;
+
+	struct stat st;
+	if (fstat(m_file, &st) != 0 || st.st_size == 0)
+	{
+		close();
+		return false;
+	}
+
+	void* data = mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ, MAP_PRIVATE, m_file, 0);
+	if (data == MAP_FAILED)
+	{
+		close();
+		return false;
+	}
+
+	m_data = static_cast<const uint8_t*>(data);
+	m_size = static_cast<size_t>(st.st_size);
+	return true;
+}
+
+void MappedFile::close()
+{
+	if (m_data)
+		munmap(const_cast<uint8_t*>(m_data), m_size);
+	if (m_file >= 0)
+		::close(m_file);
+	m_data = nullptr;
+	m_size = 0;
+	m_file = -1;
+}
+
+MappedFile::MappedFile(MappedFile && rhs)
+	: m_data(rhs.m_data), m_size(rhs.m_size), m_file(rhs.m_file)
+{
+	rhs.m_data = nullptr;
+	rhs.m_size = 0;
+	rhs.m_file = -1;
+}
+
+MappedFile & MappedFile::operator=(MappedFile && rhs)
+{
+	if (this != &rhs)
+	{
+		close();
+		std::swap(m_data, rhs.m_data);
+		std::swap(m_size, rhs.m_size);
+		std::swap(m_file, rhs.m_file);
+	}
+	return *this;
+}
+
+#endif
+
+MappedFile::MappedFile(const std::wstring & path)
+	: MappedFile()
+{
+	open(path);
+}
+
+MappedFile::~MappedFile()
+{
+	close();
+}
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <string>
+#include <fstream>
+
+namespace Geometrics
+{
+	/// <summary>
+	/// Read-only memory mapping of a whole file.
+	/// The mapped region is page aligned, so blocks aligned inside the file stay aligned in memory.
+	/// </summary>
+	class MappedFile
+	{
+	public:
+		MappedFile();
+		explicit MappedFile(const std::wstring& path);
+		~MappedFile();
+
+		MappedFile(const MappedFile&) = delete;
+		MappedFile& operator=(const MappedFile&) = delete;
+		MappedFile(MappedFile&& rhs);
+		MappedFile& operator=(MappedFile&& rhs);
+
+		// map the file, returns false if the file can not be opened or is empty
+		bool open(const std::wstring& path);
+		void close();
+
+		bool is_open() const { return m_data != nullptr; }
+		const uint8_t* data() const { return m_data; }
+		size_t size() const { return m_size; }
+
+	private:
+		const uint8_t*	m_data;
+		size_t			m_size;
+#if defined(_WIN32)
+		void*			m_file;
+		void*			m_mapping;
+#else
+		int				m_file;
+#endif
+	};
+
+	// open path for binary writing, the counterpart of MappedFile::open for the same wide paths on every platform
+	bool open_output_file(std::ofstream& file, const std::wstring& path);
+}
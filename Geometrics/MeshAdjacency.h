@@ -0,0 +1,215 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include <array>
+#include <thread>
+#include <algorithm>
+#include <cassert>
+#include <limits>
+#include <ppl.h>
+#include <span.h>
+
+namespace Geometrics
+{
+	namespace Internal
+	{
+		// meshes smaller than this are processed in a single chunk
+		static constexpr size_t ParallelGrainSize = 1U << 14;
+
+		inline size_t chunk_count(size_t n, size_t grain = ParallelGrainSize)
+		{
+			size_t workers = std::max(1U, std::thread::hardware_concurrency());
+			size_t chunks = (n + grain - 1) / grain;
+			return std::max<size_t>(1U, std::min(chunks, workers * 4));
+		}
+
+		// run func(chunkIdx, begin, end) over [0,n) split into 'chunks' contiguous ranges
+		template <class _Func>
+		inline void for_each_chunk(size_t n, size_t chunks, _Func&& func)
+		{
+			if (chunks <= 1)
+			{
+				func(size_t(0), size_t(0), n);
+				return;
+			}
+
+			size_t step = (n + chunks - 1) / chunks;
+			concurrency::parallel_for(size_t(0), chunks, [&](size_t c) {
+				size_t begin = std::min(n, c * step);
+				size_t end = std::min(n, begin + step);
+				func(c, begin, end);
+			});
+		}
+
+		// number of bits needed to represent value
+		inline unsigned bit_width(uint64_t value)
+		{
+			unsigned bits = 0;
+			while (value) { ++bits; value >>= 1; }
+			return bits;
+		}
+
+		/// <summary>
+		/// Stable LSD radix sort on the 64-bit 'key' member of _Ty, only the lowest keyBits bits are considered.
+		/// Histogram and scatter of each pass run in parallel over contiguous chunks.
+		/// </summary>
+		/// <returns>the buffer (data or temp) that holds the sorted sequence</returns>
+		template <class _Ty>
+		_Ty* parallel_radix_sort(_Ty* data, _Ty* temp, size_t n, unsigned keyBits)
+		{
+			static constexpr unsigned RadixBits = 8;
+			static constexpr size_t Buckets = 1U << RadixBits;
+			typedef std::array<size_t, Buckets> histogram_type;
+
+			size_t chunks = chunk_count(n);
+			std::vector<histogram_type> histograms(chunks);
+
+			_Ty* src = data;
+			_Ty* dst = temp;
+			for (unsigned shift = 0; shift < keyBits; shift += RadixBits)
+			{
+				for_each_chunk(n, chunks, [&](size_t c, size_t begin, size_t end) {
+					auto& hist = histograms[c];
+					hist.fill(0);
+					for (size_t i = begin; i < end; i++)
+						++hist[(src[i].key >> shift) & (Buckets - 1)];
+				});
+
+				// exclusive prefix sum, bucket-major so the sort stays stable across chunks
+				size_t offset = 0;
+				bool trivial = false;
+				for (size_t d = 0; d < Buckets; d++)
+				{
+					size_t bucketSize = 0;
+					for (auto& hist : histograms)
+					{
+						size_t count = hist[d];
+						hist[d] = offset;
+						offset += count;
+						bucketSize += count;
+					}
+					trivial |= bucketSize == n;
+				}
+
+				// every key shares this digit, nothing to move
+				if (trivial)
+					continue;
+
+				for_each_chunk(n, chunks, [&](size_t c, size_t begin, size_t end) {
+					auto& hist = histograms[c];
+					for (size_t i = begin; i < end; i++)
+						dst[hist[(src[i].key >> shift) & (Buckets - 1)]++] = src[i];
+				});
+
+				std::swap(src, dst);
+			}
+
+			return src;
+		}
+
+		struct HalfEdgeKey
+		{
+			// (min(v0,v1) << vbits) | max(v0,v1), so both half-edges of an edge share the key
+			uint64_t key;
+			uint32_t eid;
+			// 1 if v0 > v1
+			uint32_t reversed;
+		};
+	}
+
+	/// <summary>
+	/// Build the reverse (opposite) half-edge table for a triangle list, revedges[eid] = opposite eid or -1 for boundary.
+	/// The half-edge eid = 3 * fid + i is the edge opposite to the i-th vertex of facet fid.
+	/// Packed undirected edge keys are radix sorted in parallel and opposite half-edges are paired in a linear sweep.
+	/// Edges shared by more than two half-edges, or by two half-edges of the same direction, are non-manifold,
+	/// their half-edges are left unpaired and reported in nonManifoldEdges (if not null).
+	/// </summary>
+	/// <param name="facets">The triangle facets.</param>
+	/// <param name="vertexCount">Number of vertices, up to 2^32.</param>
+	/// <param name="revedges">Output table, must have 3 * facets.size() elements.</param>
+	/// <param name="nonManifoldEdges">Optional output, receives the half-edge ids of all non-manifold edges.</param>
+	/// <returns>the number of non-manifold half-edges</returns>
+	template <typename _IndexType, typename _FaceType>
+	size_t build_adjacency(gsl::span<const _FaceType> facets, size_t vertexCount, gsl::span<_IndexType> revedges, std::vector<uint32_t>* nonManifoldEdges = nullptr)
+	{
+		using namespace Internal;
+		static constexpr _IndexType InvalidIndex = static_cast<_IndexType>(-1);
+
+		size_t fsize = facets.size();
+		size_t esize = fsize * 3;
+		assert(revedges.size() >= esize);
+		assert(vertexCount <= std::numeric_limits<uint32_t>::max());
+		assert(esize <= std::numeric_limits<_IndexType>::max() && "edge index overflows the index type");
+
+		// only the bits the vertex indices can occupy need to be sorted
+		unsigned vbits = bit_width(vertexCount > 0 ? vertexCount - 1 : 0);
+
+		std::vector<HalfEdgeKey> keys(esize), temp(esize);
+
+		for_each_chunk(fsize, chunk_count(fsize), [&](size_t, size_t begin, size_t end) {
+			for (size_t fid = begin; fid < end; fid++)
+			{
+				const auto& tri = facets[fid];
+				for (uint32_t i = 0; i < 3; i++)
+				{
+					uint64_t v0 = static_cast<uint32_t>(tri[(i + 1) % 3]);
+					uint64_t v1 = static_cast<uint32_t>(tri[(i + 2) % 3]);
+					auto& k = keys[fid * 3 + i];
+					k.reversed = v0 > v1;
+					k.key = k.reversed ? (v1 << vbits) | v0 : (v0 << vbits) | v1;
+					k.eid = static_cast<uint32_t>(fid * 3 + i);
+				}
+			}
+		});
+
+		const HalfEdgeKey* sorted = parallel_radix_sort(keys.data(), temp.data(), esize, vbits * 2);
+
+		// each chunk starts sweeping at the first key run beginning inside it
+		size_t chunks = chunk_count(esize);
+		std::vector<std::vector<uint32_t>> nonManifold(chunks);
+
+		for_each_chunk(esize, chunks, [&](size_t c, size_t begin, size_t end) {
+			size_t i = begin;
+			while (i > 0 && i < end && sorted[i].key == sorted[i - 1].key)
+				++i;
+
+			while (i < end)
+			{
+				size_t j = i + 1;
+				while (j < esize && sorted[j].key == sorted[i].key)
+					++j;
+
+				if (j - i == 1)
+				{
+					revedges[sorted[i].eid] = InvalidIndex;
+				}
+				else if (j - i == 2 && sorted[i].reversed != sorted[i + 1].reversed)
+				{
+					revedges[sorted[i].eid] = static_cast<_IndexType>(sorted[i + 1].eid);
+					revedges[sorted[i + 1].eid] = static_cast<_IndexType>(sorted[i].eid);
+				}
+				else
+				{
+					for (size_t k = i; k < j; k++)
+					{
+						revedges[sorted[k].eid] = InvalidIndex;
+						nonManifold[c].push_back(sorted[k].eid);
+					}
+				}
+
+				i = j;
+			}
+		});
+
+		size_t count = 0;
+		for (auto& list : nonManifold)
+		{
+			count += list.size();
+			if (nonManifoldEdges)
+				nonManifoldEdges->insert(nonManifoldEdges->end(), list.begin(), list.end());
+		}
+
+		return count;
+	}
+}
@@ -0,0 +1,339 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <vector>
+#include <string>
+#include <fstream>
+#include <limits>
+#include "TriangleMesh.h"
+#include "MappedFile.h"
+#include "FlatBVH.h"
+
+namespace Geometrics
+{
+	typedef FlatBVHNode MeshBVHNode;
+
+	/// <summary>
+	/// Build a flat BVH over the facets of mesh.
+	/// primitives receive the facet ids in leaf order.
+	/// </summary>
+	template <class _MeshType>
+	void build_mesh_bvh(const _MeshType& mesh, std::vector<MeshBVHNode>& nodes, std::vector<uint32_t>& primitives, uint32_t leafSize = 4)
+	{
+		using namespace DirectX;
+		using namespace DirectX::VertexTraits;
+
+		auto facets = mesh.facets();
+		size_t n = facets.size();
+		std::vector<XMFLOAT3> fmin(n), fmax(n);
+		for (size_t i = 0; i < n; i++)
+		{
+			const auto& tri = facets[i];
+			XMVECTOR v0 = get_position(mesh.vertices[tri[0]]);
+			XMVECTOR v1 = get_position(mesh.vertices[tri[1]]);
+			XMVECTOR v2 = get_position(mesh.vertices[tri[2]]);
+			XMStoreFloat3(&fmin[i], XMVectorMin(v0, XMVectorMin(v1, v2)));
+			XMStoreFloat3(&fmax[i], XMVectorMax(v0, XMVectorMax(v1, v2)));
+		}
+
+		build_flat_bvh(n, fmin.data(), fmax.data(), nodes, primitives, leafSize);
+	}
+
+	namespace MeshFile
+	{
+		// 'GMSH'
+		static constexpr uint32_t Magic = 0x48534D47;
+		static constexpr uint32_t Version = 1;
+		// every block starts at a multiple of this, so SIMD loads from the mapping are aligned
+		static constexpr uint64_t BlockAlignment = 64;
+
+		enum BlockId
+		{
+			Vertices = 0,
+			Indices,
+			ReverseEdges,
+			BVHNodes,
+			BVHPrimitives,
+			BlockCount,
+		};
+
+		struct Block
+		{
+			uint64_t offset;
+			// in bytes, 0 if the block is absent
+			uint64_t size;
+		};
+
+		struct Header
+		{
+			uint32_t	magic;
+			uint32_t	version;
+			uint32_t	vertexStride;
+			uint32_t	indexSize;
+			uint32_t	faceVertexCount;
+			uint32_t	blockCount;
+			uint64_t	vertexCount;
+			uint64_t	indexCount;
+			uint64_t	fileSize;
+			Block		blocks[BlockCount];
+		};
+
+		inline uint64_t align(uint64_t offset) { return (offset + BlockAlignment - 1) & ~(BlockAlignment - 1); }
+
+		// count * elementSize, false if the product does not fit in 64 bits
+		inline bool checked_size(uint64_t count, uint64_t elementSize, uint64_t& size)
+		{
+			if (elementSize != 0 && count > std::numeric_limits<uint64_t>::max() / elementSize)
+				return false;
+			size = count * elementSize;
+			return true;
+		}
+
+		// [offset, offset + size) lies in [0, fileSize) without wrapping around
+		inline bool block_fits(const Block& block, uint64_t fileSize)
+		{
+			return block.offset <= fileSize && block.size <= fileSize - block.offset;
+		}
+
+		/// <summary>
+		/// Write mesh as a binary mesh file, revedges are stored if the mesh is built, bvh is optional.
+		/// </summary>
+		/// <returns>false if the file can not be written</returns>
+		template <class _VertexType, class _IndexType>
+		bool save(const std::wstring& path, const TriangleMesh<_VertexType, _IndexType>& mesh,
+			const std::vector<MeshBVHNode>* bvhNodes = nullptr, const std::vector<uint32_t>* bvhPrimitives = nullptr)
+		{
+			static_assert(std::is_trivially_copyable<_VertexType>::value, "vertex must be trivially copyable");
+
+			Header header = {};
+			header.magic = Magic;
+			header.version = Version;
+			header.vertexStride = sizeof(_VertexType);
+			header.indexSize = sizeof(_IndexType);
+			header.faceVertexCount = TriangleMesh<_VertexType, _IndexType>::VertexCount;
+			header.blockCount = BlockCount;
+			header.vertexCount = mesh.vertices.size();
+			header.indexCount = mesh.indices.size();
+
+			const void* payloads[BlockCount] = {
+				mesh.vertices.data(), mesh.indices.data(), mesh.revedges.data(),
+				bvhNodes ? bvhNodes->data() : nullptr, bvhPrimitives ? bvhPrimitives->data() : nullptr };
+			uint64_t sizes[BlockCount] = {
+				mesh.vertices.size() * sizeof(_VertexType),
+				mesh.indices.size() * sizeof(_IndexType),
+				mesh.revedges.size() == mesh.indices.size() ? mesh.revedges.size() * sizeof(_IndexType) : 0,
+				bvhNodes && bvhPrimitives ? bvhNodes->size() * sizeof(MeshBVHNode) : 0,
+				bvhNodes && bvhPrimitives ? bvhPrimitives->size() * sizeof(uint32_t) : 0 };
+
+			uint64_t offset = align(sizeof(Header));
+			for (int i = 0; i < BlockCount; i++)
+			{
+				header.blocks[i].offset = sizes[i] ? offset : 0;
+				header.blocks[i].size = sizes[i];
+				offset = align(offset + sizes[i]);
+			}
+			header.fileSize = offset;
+
+			std::ofstream file;
+			if (!open_output_file(file, path))
+				return false;
+
+			static const char padding[BlockAlignment] = {};
+			file.write(reinterpret_cast<const char*>(&header), sizeof(Header));
+			uint64_t written = sizeof(Header);
+			for (int i = 0; i < BlockCount; i++)
+			{
+				if (!sizes[i])
+					continue;
+				file.write(padding, header.blocks[i].offset - written);
+				file.write(static_cast<const char*>(payloads[i]), sizes[i]);
+				written = header.blocks[i].offset + sizes[i];
+			}
+			file.write(padding, header.fileSize - written);
+
+			return file.good();
+		}
+	}
+
+	/// <summary>
+	/// Read-only triangle mesh backed by a memory mapped mesh file.
+	/// All accessors are zero-copy views into the mapping, valid as long as this object lives.
+	/// </summary>
+	template <class _VertexType, class _IndexType = uint16_t>
+	class MappedTriangleMesh
+	{
+	public:
+		typedef _VertexType VertexType;
+		typedef _IndexType	IndexType;
+		typedef Triangle<_IndexType> FaceType;
+		static constexpr size_t VertexCount = FaceType::VertexCount;
+
+		MappedTriangleMesh() : m_header(nullptr) {}
+		explicit MappedTriangleMesh(const std::wstring& path) : m_header(nullptr) { open(path); }
+
+		// the header points into the mapping, which keeps its address when moved
+		MappedTriangleMesh(MappedTriangleMesh&& rhs)
+			: m_file(std::move(rhs.m_file)), m_header(rhs.m_header)
+		{
+			rhs.m_header = nullptr;
+		}
+
+		MappedTriangleMesh& operator=(MappedTriangleMesh&& rhs)
+		{
+			if (this != &rhs)
+			{
+				m_file = std::move(rhs.m_file);
+				m_header = rhs.m_header;
+				rhs.m_header = nullptr;
+			}
+			return *this;
+		}
+
+		/// <summary>
+		/// Map the file and validate the header and block table against _VertexType / _IndexType.
+		/// Every index, reverse edge, bvh node and bvh primitive is checked against the counts it refers to,
+		/// so the accessors and a bvh traversal never read out of the mapping.
+		/// </summary>
+		/// <returns>false if the file is missing, truncated, of another version or layout, or refers out of range</returns>
+		bool open(const std::wstring& path)
+		{
+			using namespace MeshFile;
+			m_header = nullptr;
+			if (!m_file.open(path) || m_file.size() < sizeof(Header))
+				return false;
+
+			auto header = reinterpret_cast<const Header*>(m_file.data());
+			uint64_t verticesSize = 0, indicesSize = 0;
+			bool valid = header->magic == Magic
+				&& header->version == Version
+				&& header->vertexStride == sizeof(_VertexType)
+				&& header->indexSize == sizeof(_IndexType)
+				&& header->faceVertexCount == VertexCount
+				&& header->blockCount == BlockCount
+				&& header->fileSize <= m_file.size()
+				&& checked_size(header->vertexCount, sizeof(_VertexType), verticesSize)
+				&& checked_size(header->indexCount, sizeof(_IndexType), indicesSize)
+				&& header->blocks[Vertices].size == verticesSize
+				&& header->blocks[Indices].size == indicesSize
+				&& header->indexCount % VertexCount == 0
+				&& header->blocks[BVHNodes].size % sizeof(MeshBVHNode) == 0
+				&& header->blocks[BVHPrimitives].size % sizeof(uint32_t) == 0;
+
+			for (int i = 0; valid && i < BlockCount; i++)
+			{
+				auto& block = header->blocks[i];
+				valid = block.size == 0 ||
+					(block.offset % BlockAlignment == 0 && block_fits(block, header->fileSize));
+			}
+
+			if (valid && header->blocks[ReverseEdges].size)
+				valid = header->blocks[ReverseEdges].size == header->blocks[Indices].size;
+
+			// save writes the bvh nodes and primitives together
+			if (valid)
+				valid = (header->blocks[BVHNodes].size == 0) == (header->blocks[BVHPrimitives].size == 0);
+
+			if (valid)
+			{
+				m_header = header;
+				valid = validate_indices() && validate_bvh();
+			}
+
+			if (!valid)
+			{
+				close();
+				return false;
+			}
+
+			return true;
+		}
+
+		void close() { m_header = nullptr; m_file.close(); }
+		bool is_open() const { return m_header != nullptr; }
+
+		gsl::span<const VertexType> vertices() const { return block<VertexType>(MeshFile::Vertices); }
+		gsl::span<const IndexType> indices() const { return block<IndexType>(MeshFile::Indices); }
+		gsl::span<const FaceType> facets() const { return block<FaceType>(MeshFile::Indices); }
+
+		// empty if the mesh was saved without adjacency
+		gsl::span<const IndexType> revedges() const { return block<IndexType>(MeshFile::ReverseEdges); }
+		bool has_adjacency() const { return !revedges().empty(); }
+
+		// empty if the mesh was saved without bvh
+		gsl::span<const MeshBVHNode> bvh_nodes() const { return block<MeshBVHNode>(MeshFile::BVHNodes); }
+		gsl::span<const uint32_t> bvh_primitives() const { return block<uint32_t>(MeshFile::BVHPrimitives); }
+		bool has_bvh() const { return !bvh_nodes().empty(); }
+
+		inline const FaceType& facet(int idx) const { return facets()[idx]; }
+		inline int adjacentFacet(int facet, int edge) const { return revedges()[facet * VertexCount + edge] / VertexCount; }
+
+		// copy into an editable mesh, adjacency is copied when present instead of rebuilt
+		void copy_to(TriangleMesh<VertexType, IndexType>& mesh) const
+		{
+			auto v = vertices();
+			auto i = indices();
+			auto r = revedges();
+			mesh.vertices.assign(v.begin(), v.end());
+			mesh.indices.assign(i.begin(), i.end());
+			if (r.empty())
+				mesh.build();
+			else
+				mesh.revedges.assign(r.begin(), r.end());
+		}
+
+	private:
+		// indices must address vertices, reverse edges must address edges or be the boundary marker
+		bool validate_indices() const
+		{
+			uint64_t vertexCount = m_header->vertexCount;
+			for (auto index : indices())
+				if (static_cast<uint64_t>(index) >= vertexCount)
+					return false;
+
+			const IndexType boundary = static_cast<IndexType>(-1);
+			uint64_t edgeCount = m_header->indexCount;
+			for (auto edge : revedges())
+				if (edge != boundary && static_cast<uint64_t>(edge) >= edgeCount)
+					return false;
+			return true;
+		}
+
+		// children must be later nodes in preorder, leaves must address the primitive table, primitives must address facets
+		bool validate_bvh() const
+		{
+			auto nodes = bvh_nodes();
+			auto primitives = bvh_primitives();
+			uint64_t nodeCount = nodes.size(), primitiveCount = primitives.size();
+			for (uint64_t i = 0; i < nodeCount; i++)
+			{
+				auto& node = nodes[i];
+				if (node.is_leaf())
+				{
+					if (static_cast<uint64_t>(node.first) + node.count > primitiveCount)
+						return false;
+				}
+				else if (i + 1 >= nodeCount || node.first <= i + 1 || node.first >= nodeCount)
+					return false;
+			}
+
+			uint64_t facetCount = m_header->indexCount / VertexCount;
+			for (auto primitive : primitives)
+				if (primitive >= facetCount)
+					return false;
+			return true;
+		}
+
+		template <class _Ty>
+		gsl::span<const _Ty> block(MeshFile::BlockId id) const
+		{
+			if (!m_header || !m_header->blocks[id].size)
+				return gsl::span<const _Ty>();
+			auto& b = m_header->blocks[id];
+			return gsl::span<const _Ty>(reinterpret_cast<const _Ty*>(m_file.data() + b.offset), b.size / sizeof(_Ty));
+		}
+
+		MappedFile				m_file;
+		const MeshFile::Header*	m_header;
+	};
+}
@@ -0,0 +1,341 @@
+#pragma once
+
+#include "TriangleMesh.h"
+#include "MeshAdjacency.h"
+
+namespace Geometrics
+{
+	namespace Internal
+	{
+		// normalize 4 vectors stored in SoA form (x,y,z), zero length vectors stay zero
+		inline void XM_CALLCONV normalize_soa(DirectX::XMVECTOR& x, DirectX::XMVECTOR& y, DirectX::XMVECTOR& z)
+		{
+			using namespace DirectX;
+			XMVECTOR lsq = x * x + y * y + z * z;
+			XMVECTOR valid = XMVectorGreater(lsq, XMVectorZero());
+			XMVECTOR rcp = XMVectorSelect(XMVectorZero(), XMVectorReciprocalSqrt(lsq), valid);
+			x *= rcp; y *= rcp; z *= rcp;
+		}
+
+		// area-angle weighted facet normal, same weighting as generate_normal
+		inline DirectX::XMVECTOR XM_CALLCONV facet_normal(DirectX::FXMVECTOR v0, DirectX::FXMVECTOR v1, DirectX::FXMVECTOR v2)
+		{
+			using namespace DirectX;
+			XMVECTOR e1 = XMVector3Normalize(v1 - v0);
+			XMVECTOR e2 = XMVector3Normalize(v2 - v0);
+			return XMVector3Cross(e1, e2);
+		}
+
+		// facet tangent (sdir) and bitangent (tdir) from position and uv deltas
+		inline void XM_CALLCONV facet_tangent(DirectX::FXMVECTOR v0, DirectX::FXMVECTOR v1, DirectX::FXMVECTOR v2, DirectX::GXMVECTOR w0, DirectX::HXMVECTOR w1, DirectX::HXMVECTOR w2, DirectX::XMVECTOR& sdir, DirectX::XMVECTOR& tdir)
+		{
+			using namespace DirectX;
+			XMVECTOR e1 = v1 - v0, e2 = v2 - v0;
+			XMFLOAT4A d1, d2;
+			XMStoreA(d1, w1 - w0);
+			XMStoreA(d2, w2 - w0);
+
+			float det = d1.x * d2.y - d2.x * d1.y;
+			float r = det != .0f ? 1.0f / det : .0f;
+			sdir = (e1 * d2.y - e2 * d1.y) * r;
+			tdir = (e2 * d1.x - e1 * d2.x) * r;
+		}
+	}
+
+	/// <summary>
+	/// Vertex to facet adjacency in compressed sparse row form.
+	/// The facets incident to vertex v are facets[offsets[v]] ... facets[offsets[v+1]-1].
+	/// </summary>
+	struct VertexFacetAdjacency
+	{
+		std::vector<uint32_t> offsets;
+		std::vector<uint32_t> facets;
+
+		size_t vertex_count() const { return offsets.empty() ? 0 : offsets.size() - 1; }
+
+		gsl::span<const uint32_t> operator[](size_t vid) const
+		{
+			return gsl::span<const uint32_t>(facets.data() + offsets[vid], offsets[vid + 1] - offsets[vid]);
+		}
+
+		template <typename _FaceType>
+		void build(gsl::span<const _FaceType> faces, size_t vertexCount)
+		{
+			offsets.assign(vertexCount + 1, 0);
+			for (const auto& face : faces)
+				for (int i = 0; i < _FaceType::VertexCount; i++)
+					++offsets[face[i] + 1];
+
+			for (size_t v = 0; v < vertexCount; v++)
+				offsets[v + 1] += offsets[v];
+
+			facets.resize(offsets[vertexCount]);
+			std::vector<uint32_t> cursor(offsets.begin(), offsets.end() - 1);
+			uint32_t fid = 0;
+			for (const auto& face : faces)
+			{
+				for (int i = 0; i < _FaceType::VertexCount; i++)
+					facets[cursor[face[i]]++] = fid;
+				++fid;
+			}
+		}
+	};
+
+	/// <summary>
+	/// Parallel per-vertex normal & tangent generator for triangle meshes.
+	/// Facet normals / tangents are computed in batches of 4 facets in SoA registers,
+	/// then each vertex gathers from its incident facets through a vertex-facet CSR, so no atomics are needed.
+	/// The facet data is cached, so after an edit only the touched facets and their vertices are recomputed (update).
+	/// The facets are copied by reset, so the source index buffer may be reallocated afterwards,
+	/// but the topology must stay the same until the next reset.
+	/// </summary>
+	template <typename _VertexType, typename _IndexType = uint16_t>
+	class NormalGenerator
+	{
+	public:
+		typedef _VertexType VertexType;
+		typedef _IndexType	IndexType;
+		typedef Triangle<IndexType> FaceType;
+		typedef std::vector<DirectX::XMFLOAT4A, DirectX::AlignedAllocator<DirectX::XMFLOAT4A>> VectorCollection;
+
+		static constexpr bool HasNormal = DirectX::VertexTraits::has_normal<VertexType>::value;
+		static constexpr bool HasTangent = DirectX::VertexTraits::has_tangent<VertexType>::value;
+
+		NormalGenerator() {}
+
+		NormalGenerator(gsl::span<const FaceType> facets, size_t vertexCount)
+		{
+			reset(facets, vertexCount);
+		}
+
+		// rebuild the vertex-facet adjacency, must be called after the topology changed
+		void reset(gsl::span<const FaceType> facets, size_t vertexCount)
+		{
+			m_facets.assign(facets.begin(), facets.end());
+			m_adjacency.build(facets, vertexCount);
+			m_facetNormals.resize(facets.size());
+			if (HasTangent)
+			{
+				m_facetTangents.resize(facets.size());
+				m_facetBitangents.resize(facets.size());
+			}
+			m_facetMarks.assign(facets.size(), 0);
+			m_vertexMarks.assign(vertexCount, 0);
+		}
+
+		const VertexFacetAdjacency& adjacency() const { return m_adjacency; }
+
+		// recompute normals (and tangents if the vertex have it) for all vertices
+		bool generate(gsl::span<VertexType> vertices)
+		{
+			if (!HasNormal)
+				return false;
+			assert(vertices.size() == m_adjacency.vertex_count());
+
+			size_t fsize = m_facets.size();
+			Internal::for_each_chunk(fsize, Internal::chunk_count(fsize), [&](size_t, size_t begin, size_t end) {
+				compute_facets(vertices, begin, end, nullptr);
+			});
+
+			size_t vsize = vertices.size();
+			Internal::for_each_chunk(vsize, Internal::chunk_count(vsize), [&](size_t, size_t begin, size_t end) {
+				for (size_t v = begin; v < end; v++)
+					gather_vertex(vertices, v);
+			});
+			return true;
+		}
+
+		// recompute normals (and tangents) only for vertices affected by moving the edited vertices
+		// i.e. the vertices of all facets incident to any edited vertex
+		bool update(gsl::span<VertexType> vertices, gsl::span<const uint32_t> editedVertices)
+		{
+			if (!HasNormal)
+				return false;
+			assert(vertices.size() == m_adjacency.vertex_count());
+
+			m_dirtyFacets.clear();
+			m_dirtyVertices.clear();
+			for (auto v : editedVertices)
+			{
+				for (auto f : m_adjacency[v])
+				{
+					if (m_facetMarks[f]) continue;
+					m_facetMarks[f] = 1;
+					m_dirtyFacets.push_back(f);
+
+					const auto& face = m_facets[f];
+					for (int i = 0; i < FaceType::VertexCount; i++)
+					{
+						if (m_vertexMarks[face[i]]) continue;
+						m_vertexMarks[face[i]] = 1;
+						m_dirtyVertices.push_back(face[i]);
+					}
+				}
+			}
+
+			size_t fsize = m_dirtyFacets.size();
+			Internal::for_each_chunk(fsize, Internal::chunk_count(fsize), [&](size_t, size_t begin, size_t end) {
+				compute_facets(vertices, begin, end, m_dirtyFacets.data());
+			});
+
+			size_t vsize = m_dirtyVertices.size();
+			Internal::for_each_chunk(vsize, Internal::chunk_count(vsize), [&](size_t, size_t begin, size_t end) {
+				for (size_t i = begin; i < end; i++)
+					gather_vertex(vertices, m_dirtyVertices[i]);
+			});
+
+			for (auto f : m_dirtyFacets) m_facetMarks[f] = 0;
+			for (auto v : m_dirtyVertices) m_vertexMarks[v] = 0;
+			return true;
+		}
+
+		// vertices recomputed by the last update
+		const std::vector<uint32_t>& updated_vertices() const { return m_dirtyVertices; }
+
+	private:
+		// compute facet data for facet ids [begin,end) or for list[begin,end) if list is not null
+		void compute_facets(gsl::span<const VertexType> vertices, size_t begin, size_t end, const uint32_t* list)
+		{
+			using namespace DirectX;
+			using namespace DirectX::VertexTraits;
+
+			auto fid = [=](size_t i) { return list ? list[i] : static_cast<uint32_t>(i); };
+
+			size_t i = begin;
+			for (; i + 4 <= end; i += 4)
+			{
+				uint32_t f[4] = { fid(i), fid(i + 1), fid(i + 2), fid(i + 3) };
+				XMMATRIX P[3], W[3];
+				for (int k = 0; k < 3; k++)
+				{
+					for (int j = 0; j < 4; j++)
+					{
+						const auto& vtx = vertices[m_facets[f[j]][k]];
+						P[k].r[j] = get_position(vtx);
+						if (HasTangent)
+							W[k].r[j] = get_uv(vtx);
+					}
+					// rows become x,y,z(,w) lanes of 4 facets
+					P[k] = XMMatrixTranspose(P[k]);
+					if (HasTangent)
+						W[k] = XMMatrixTranspose(W[k]);
+				}
+
+				XMVECTOR e1x = P[1].r[0] - P[0].r[0], e1y = P[1].r[1] - P[0].r[1], e1z = P[1].r[2] - P[0].r[2];
+				XMVECTOR e2x = P[2].r[0] - P[0].r[0], e2y = P[2].r[1] - P[0].r[1], e2z = P[2].r[2] - P[0].r[2];
+
+				if (HasTangent)
+				{
+					XMVECTOR s1 = W[1].r[0] - W[0].r[0], t1 = W[1].r[1] - W[0].r[1];
+					XMVECTOR s2 = W[2].r[0] - W[0].r[0], t2 = W[2].r[1] - W[0].r[1];
+					XMVECTOR det = s1 * t2 - s2 * t1;
+					XMVECTOR r = XMVectorSelect(XMVectorZero(), XMVectorReciprocal(det), XMVectorNotEqual(det, XMVectorZero()));
+
+					XMMATRIX S, T;
+					S.r[0] = (t2 * e1x - t1 * e2x) * r;
+					S.r[1] = (t2 * e1y - t1 * e2y) * r;
+					S.r[2] = (t2 * e1z - t1 * e2z) * r;
+					S.r[3] = XMVectorZero();
+					T.r[0] = (s1 * e2x - s2 * e1x) * r;
+					T.r[1] = (s1 * e2y - s2 * e1y) * r;
+					T.r[2] = (s1 * e2z - s2 * e1z) * r;
+					T.r[3] = XMVectorZero();
+					S = XMMatrixTranspose(S);
+					T = XMMatrixTranspose(T);
+					for (int j = 0; j < 4; j++)
+					{
+						XMStoreA(m_facetTangents[f[j]], S.r[j]);
+						XMStoreA(m_facetBitangents[f[j]], T.r[j]);
+					}
+				}
+
+				Internal::normalize_soa(e1x, e1y, e1z);
+				Internal::normalize_soa(e2x, e2y, e2z);
+
+				XMMATRIX N;
+				N.r[0] = e1y * e2z - e1z * e2y;
+				N.r[1] = e1z * e2x - e1x * e2z;
+				N.r[2] = e1x * e2y - e1y * e2x;
+				N.r[3] = XMVectorZero();
+				N = XMMatrixTranspose(N);
+				for (int j = 0; j < 4; j++)
+					XMStoreA(m_facetNormals[f[j]], N.r[j]);
+			}
+
+			// remainder
+			for (; i < end; i++)
+			{
+				auto f = fid(i);
+				const auto& face = m_facets[f];
+				XMVECTOR v0 = get_position(vertices[face[0]]);
+				XMVECTOR v1 = get_position(vertices[face[1]]);
+				XMVECTOR v2 = get_position(vertices[face[2]]);
+				XMStoreA(m_facetNormals[f], Internal::facet_normal(v0, v1, v2));
+
+				if (HasTangent)
+				{
+					XMVECTOR sdir, tdir;
+					Internal::facet_tangent(v0, v1, v2,
+						get_uv(vertices[face[0]]), get_uv(vertices[face[1]]), get_uv(vertices[face[2]]),
+						sdir, tdir);
+					XMStoreA(m_facetTangents[f], sdir);
+					XMStoreA(m_facetBitangents[f], tdir);
+				}
+			}
+		}
+
+		void gather_vertex(gsl::span<VertexType> vertices, size_t vid)
+		{
+			using namespace DirectX;
+			using namespace DirectX::VertexTraits;
+
+			XMVECTOR n = XMVectorZero();
+			XMVECTOR t = XMVectorZero();
+			XMVECTOR b = XMVectorZero();
+			for (auto f : m_adjacency[vid])
+			{
+				n += XMLoadA(m_facetNormals[f]);
+				if (HasTangent)
+				{
+					t += XMLoadA(m_facetTangents[f]);
+					b += XMLoadA(m_facetBitangents[f]);
+				}
+			}
+
+			n = XMVector3Normalize(n);
+			set_normal(vertices[vid], n);
+
+			if (HasTangent)
+			{
+				// Gram-Schmidt orthogonalize
+				XMVECTOR nt = XMVector3Normalize(t - n * XMVector3Dot(n, t));
+
+				// handedness in w, the same convention as generate_tangent
+				XMVECTOR w = XMVectorLess(XMVector3Dot(XMVector3Cross(n, t), b), XMVectorZero());
+				w = XMVectorSelect(g_XMNegativeOne.v, g_XMOne.v, w);
+
+				nt = XMVectorSelect(nt, w, g_XMSelect0001.v);
+				set_tangent(vertices[vid], nt);
+			}
+		}
+
+		std::vector<FaceType>		m_facets;
+		VertexFacetAdjacency		m_adjacency;
+		VectorCollection			m_facetNormals;
+		VectorCollection			m_facetTangents;
+		VectorCollection			m_facetBitangents;
+
+		std::vector<uint8_t>		m_facetMarks;
+		std::vector<uint8_t>		m_vertexMarks;
+		std::vector<uint32_t>		m_dirtyFacets;
+		std::vector<uint32_t>		m_dirtyVertices;
+	};
+
+	// parallel version of generate_normal, also generates tangents if the vertex type has it
+	template <typename VertexType, typename IndexType>
+	bool parallel_generate_normal(gsl::span<VertexType> vertices, gsl::span<const Triangle<IndexType>> facets)
+	{
+		NormalGenerator<VertexType, IndexType> generator(facets, vertices.size());
+		return generator.generate(vertices);
+	}
+}
@@ -0,0 +1,130 @@
+#pragma once
+
+#include <DirectXMathExtend.h>
+#include <VertexTraits.h>
+#include <span.h>
+#include "MeshAdjacency.h"
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+namespace Geometrics
+{
+	namespace Internal
+	{
+		// vertices per worker chunk for bulk transforms
+		static constexpr size_t TransformGrainSize = 1U << 14;
+
+#if defined(__AVX2__)
+		/// <summary>
+		/// Transform a strided float3 stream in place with M, 8 elements per iteration.
+		/// The AoS elements are gathered into x/y/z registers, transformed with FMA and scattered back.
+		/// </summary>
+		/// <param name="data">pointer to the first float3.</param>
+		/// <param name="stride">stride in bytes between elements, must be multiple of 4.</param>
+		/// <param name="count">number of elements.</param>
+		/// <param name="M">the transform matrix.</param>
+		/// <param name="coord">true for XMVector3TransformCoord semantic (translate and divide by w), false for XMVector3TransformNormal.</param>
+		inline void XM_CALLCONV transform_float3_stream_avx2(float* data, size_t stride, size_t count, DirectX::FXMMATRIX M, bool coord)
+		{
+			using namespace DirectX;
+			assert(stride % sizeof(float) == 0);
+
+			XMFLOAT4X4A m;
+			XMStoreFloat4x4A(&m, M);
+			const __m256 m11 = _mm256_set1_ps(m._11), m12 = _mm256_set1_ps(m._12), m13 = _mm256_set1_ps(m._13), m14 = _mm256_set1_ps(m._14);
+			const __m256 m21 = _mm256_set1_ps(m._21), m22 = _mm256_set1_ps(m._22), m23 = _mm256_set1_ps(m._23), m24 = _mm256_set1_ps(m._24);
+			const __m256 m31 = _mm256_set1_ps(m._31), m32 = _mm256_set1_ps(m._32), m33 = _mm256_set1_ps(m._33), m34 = _mm256_set1_ps(m._34);
+			const __m256 m41 = _mm256_set1_ps(m._41), m42 = _mm256_set1_ps(m._42), m43 = _mm256_set1_ps(m._43), m44 = _mm256_set1_ps(m._44);
+
+			const int fstride = static_cast<int>(stride / sizeof(float));
+			const __m256i vindex = _mm256_mullo_epi32(_mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7), _mm256_set1_epi32(fstride));
+
+			float sx[8], sy[8], sz[8];
+
+			size_t i = 0;
+			for (; i + 8 <= count; i += 8)
+			{
+				float* p = reinterpret_cast<float*>(reinterpret_cast<char*>(data) + i * stride);
+				__m256 x = _mm256_i32gather_ps(p, vindex, 4);
+				__m256 y = _mm256_i32gather_ps(p + 1, vindex, 4);
+				__m256 z = _mm256_i32gather_ps(p + 2, vindex, 4);
+
+				__m256 ox = _mm256_fmadd_ps(z, m31, _mm256_fmadd_ps(y, m21, _mm256_mul_ps(x, m11)));
+				__m256 oy = _mm256_fmadd_ps(z, m32, _mm256_fmadd_ps(y, m22, _mm256_mul_ps(x, m12)));
+				__m256 oz = _mm256_fmadd_ps(z, m33, _mm256_fmadd_ps(y, m23, _mm256_mul_ps(x, m13)));
+
+				if (coord)
+				{
+					__m256 ow = _mm256_fmadd_ps(z, m34, _mm256_fmadd_ps(y, m24, _mm256_fmadd_ps(x, m14, m44)));
+					__m256 rw = _mm256_div_ps(_mm256_set1_ps(1.0f), ow);
+					ox = _mm256_mul_ps(_mm256_add_ps(ox, m41), rw);
+					oy = _mm256_mul_ps(_mm256_add_ps(oy, m42), rw);
+					oz = _mm256_mul_ps(_mm256_add_ps(oz, m43), rw);
+				}
+
+				_mm256_storeu_ps(sx, ox);
+				_mm256_storeu_ps(sy, oy);
+				_mm256_storeu_ps(sz, oz);
+				for (int j = 0; j < 8; j++, p += fstride)
+				{
+					p[0] = sx[j]; p[1] = sy[j]; p[2] = sz[j];
+				}
+			}
+
+			// remainder
+			for (; i < count; i++)
+			{
+				auto& v = *reinterpret_cast<XMFLOAT3*>(reinterpret_cast<char*>(data) + i * stride);
+				XMVECTOR vec = XMLoadFloat3(&v);
+				vec = coord ? XMVector3TransformCoord(vec, M) : XMVector3TransformNormal(vec, M);
+				XMStoreFloat3(&v, vec);
+			}
+		}
+#endif
+	}
+
+	/// <summary>
+	/// Bulk transform of position, normal and tangent of vertices, split across worker threads.
+	/// Uses the AVX2 stream kernel when available and the vertex members are plain float3/float4.
+	/// </summary>
+	/// <returns>false if the vertex layout (or instruction set) is not supported, vertices are untouched then</returns>
+	template <typename _VertexType>
+	bool XM_CALLCONV bulk_transform(gsl::span<_VertexType> vertices, DirectX::FXMMATRIX M)
+	{
+		using namespace DirectX::VertexTraits;
+		typedef position_stream<_VertexType> position_t;
+		typedef normal_stream<_VertexType> normal_t;
+		typedef tangent_stream<_VertexType> tangent_t;
+
+#if defined(__AVX2__)
+		if (!position_t::value
+			|| (has_normal<_VertexType>::value && !normal_t::value)
+			|| (has_normal<_VertexType>::value && has_tangent<_VertexType>::value && !tangent_t::value))
+			return false;
+
+		// keep the matrix in memory so every worker can load it
+		DirectX::XMFLOAT4X4A matrix;
+		DirectX::XMStoreFloat4x4A(&matrix, M);
+
+		size_t n = vertices.size();
+		Internal::for_each_chunk(n, Internal::chunk_count(n, Internal::TransformGrainSize), [&](size_t, size_t begin, size_t end) {
+			if (begin == end) return;
+			DirectX::XMMATRIX mat = DirectX::XMLoadFloat4x4A(&matrix);
+			_VertexType* first = vertices.data() + begin;
+			size_t count = end - begin;
+			Internal::transform_float3_stream_avx2(position_t::get(first), sizeof(_VertexType), count, mat, true);
+			if (normal_t::value)
+			{
+				Internal::transform_float3_stream_avx2(normal_t::get(first), sizeof(_VertexType), count, mat, false);
+				if (tangent_t::value)
+					Internal::transform_float3_stream_avx2(tangent_t::get(first), sizeof(_VertexType), count, mat, false);
+			}
+		});
+		return true;
+#else
+		return false;
+#endif
+	}
+}
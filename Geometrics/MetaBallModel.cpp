@@ -1,4 +1,5 @@
 #include "MetaBallModel.h"
+#include "BezierClipBatch.h"
 //#include <iostream>
 #include <set>
 #include <map>
@@ -564,9 +565,20 @@ bool MetaBallModel::RayIntersection(DirectX::Vector3 &Output,DirectX::FXMVECTOR
 			return lhs.second < rhs.second;
 	});
 
-	Bezier::BezierClipping<float,6> IntervalClipping;
+	// Walk the sorted intersections once and record every interval with its sole effective metaball or its compound clipping,
+	// the clippings are solved 4 per batch when the second walk reaches them
+	struct RayInterval
+	{
+		float start, end;
+		// >= 0 : single metaball form, -1 : multi metaball form, solved by clippings[clip]
+		int ball;
+		int clip;
+	};
+	std::vector<RayInterval> Intervals;
+	std::vector<Metaball::ClipType> Clippings;
+	std::vector<float> Precisions;
 
-	const float EfficeRatio = this->EffictiveRadiusRatio();
+	Bezier::BezierClipping<float,6> IntervalClipping;
 
 	float start = 0.0f , end = 0.0f;
 	for (auto itr = Intersections.begin(); itr != Intersections.end(); itr++)
@@ -577,27 +589,7 @@ bool MetaBallModel::RayIntersection(DirectX::Vector3 &Output,DirectX::FXMVECTOR
 		{
 			if (EffectiveSet.size() == 1) // Single metaball form
 			{
-				float d1,d2;
-				Metaball isoSphere(Primitives[*EffectiveSet.cbegin()]);
-				isoSphere.Radius *= EfficeRatio;
-				auto count = isoSphere.Intersects(Origin,vDir,&d1,&d2);
-				if (count > 0)
-				{
-					if (d1 >= start && d1 <= end)
-					{
-						Output = d1 * vDir + Origin;
-						float eval = this->eval(Output);
-						assert(eval<0.01f);
-						return true;
-					}
-					if (d2 >= start && d2 <= end)
-					{
-						Output = d2 * vDir + Origin;
-						float eval = this->eval(Output);
-						assert(eval<0.01f);
-						return true;
-					}
-				}
+				Intervals.push_back({ start, end, (int)*EffectiveSet.cbegin(), -1 });
 			} else if (EffectiveSet.size() > 1) // Multi metaball form
 			{
 				IntervalClipping.fill(0.0f);
@@ -613,23 +605,13 @@ bool MetaBallModel::RayIntersection(DirectX::Vector3 &Output,DirectX::FXMVECTOR
 					clipping.crop(s,t);
 					IntervalClipping.compound(clipping);
 				}
+				Intervals.push_back({ start, end, -1, (int)Clippings.size() });
+				Clippings.push_back(IntervalClipping);
 #ifdef _DEBUG
-				float root = Bezier::solove_first_root(IntervalClipping,m_ISO,Precision*0.3333f/(end-start));
+				Precisions.push_back(Precision*0.3333f/(end-start));
 #else
-				float root = Bezier::solove_first_root(IntervalClipping,m_ISO,Precision/(end-start));
+				Precisions.push_back(Precision/(end-start));
 #endif
-				if (root >= 0.0f && root <= 1.0f)
-				{
-					root *= end-start;
-					root += start;
-					Output = root * vDir + Origin;
-
-					float eval = this->eval(Output);
-					assert(eval<0.01f);
-
-					return true;
-				}
-
 			}
 		}
 
@@ -642,6 +624,63 @@ bool MetaBallModel::RayIntersection(DirectX::Vector3 &Output,DirectX::FXMVECTOR
 		start = end;
 	}
 
+	const float EfficeRatio = this->EffictiveRadiusRatio();
+
+	std::vector<float> Roots(Clippings.size());
+	size_t solved = 0;
+	for (const auto& interval : Intervals)
+	{
+		if (interval.ball >= 0)
+		{
+			float d1,d2;
+			Metaball isoSphere(Primitives[interval.ball]);
+			isoSphere.Radius *= EfficeRatio;
+			auto count = isoSphere.Intersects(Origin,vDir,&d1,&d2);
+			if (count > 0)
+			{
+				if (d1 >= interval.start && d1 <= interval.end)
+				{
+					Output = d1 * vDir + Origin;
+					float eval = this->eval(Output);
+					assert(eval<0.01f);
+					return true;
+				}
+				if (d2 >= interval.start && d2 <= interval.end)
+				{
+					Output = d2 * vDir + Origin;
+					float eval = this->eval(Output);
+					assert(eval<0.01f);
+					return true;
+				}
+			}
+		}
+		else
+		{
+			if (interval.clip >= (int)solved)
+			{
+				size_t count = std::min<size_t>(4, Clippings.size() - solved);
+				Bezier::solove_first_roots<6>(
+					gsl::span<const Metaball::ClipType>(Clippings.data() + solved, count), m_ISO,
+					gsl::span<const float>(Precisions.data() + solved, count),
+					gsl::span<float>(Roots.data() + solved, count));
+				solved += count;
+			}
+
+			float root = Roots[interval.clip];
+			if (root >= 0.0f && root <= 1.0f)
+			{
+				root *= interval.end-interval.start;
+				root += interval.start;
+				Output = root * vDir + Origin;
+
+				float eval = this->eval(Output);
+				assert(eval<0.01f);
+
+				return true;
+			}
+		}
+	}
+
 	return false;
 }
 
@@ -5,8 +5,65 @@ using namespace Geometrics;
 using namespace DirectX;
 
 
+void Geometrics::laplacianSmooth(gsl::span<XMFLOAT4A> curve, float alpha, unsigned IterationTimes, bool closeLoop)
+{
+	size_t N = curve.size();
+	if (N == 0 || IterationTimes == 0)
+		return;
+
+	XMVECTOR va = XMVectorReplicate(alpha);
+	XMVECTOR vb = XMVectorReplicate(0.5f * (1.0f - alpha));
+	XMFLOAT4A* x = curve.data();
+
+	if (closeLoop)
+	{
+		for (unsigned k = 0; k < IterationTimes; k++)
+		{
+			// original first element, needed by the last one
+			XMVECTOR first = XMLoadFloat4A(&x[0]);
+			XMVECTOR prev = XMLoadFloat4A(&x[N - 1]);
+			XMVECTOR cur = first;
+			for (size_t i = 0; i < N; i++)
+			{
+				XMVECTOR next = i + 1 < N ? XMLoadFloat4A(&x[i + 1]) : first;
+				XMStoreFloat4A(&x[i], XMVectorMultiplyAdd(va, cur, vb * (prev + next)));
+				prev = cur;
+				cur = next;
+			}
+		}
+		return;
+	}
+
+	if (N < 3)
+		return;
+
+	// wavefront : at step i, iteration k updates element i - k
+	// element i - k + 1 is already at iteration k's input state, i - k - 1 is already updated,
+	// so its input state is kept in saved[k]
+	std::vector<XMFLOAT4A, DirectX::AlignedAllocator<XMFLOAT4A>> saved(IterationTimes);
+	size_t K = IterationTimes;
+	for (size_t i = 0; i < N + K - 1; i++)
+	{
+		size_t kmin = i >= N ? i - N + 1 : 0;
+		size_t kmax = std::min(K - 1, i);
+		for (size_t k = kmin; k <= kmax; k++)
+		{
+			size_t j = i - k;
+			XMVECTOR cur = XMLoadFloat4A(&x[j]);
+			if (j > 0 && j + 1 < N)
+			{
+				XMVECTOR prev = XMLoadFloat4A(&saved[k]);
+				XMVECTOR next = XMLoadFloat4A(&x[j + 1]);
+				XMStoreFloat4A(&x[j], XMVectorMultiplyAdd(va, cur, vb * (prev + next)));
+			}
+			XMStoreFloat4A(&saved[k], cur);
+		}
+	}
+}
+
 SpaceCurve::SpaceCurve() {
 	m_isClose = false;
+	m_tolerance = .0f;
 }
 
 SpaceCurve::~SpaceCurve() {}
@@ -14,6 +71,7 @@ SpaceCurve::~SpaceCurve() {}
 SpaceCurve::SpaceCurve(const gsl::span<Vector3>& trajectory, bool closeLoop/* = false*/)
 {
 	m_isClose = closeLoop;
+	m_tolerance = .0f;
 	for (auto& point : trajectory)
 	{
 		this->push_back(point);
@@ -29,14 +87,7 @@ std::vector<Vector3> SpaceCurve::FixCountSampling(unsigned int SampleSegmentCoun
 	float Interval = length() / SampleSegmentCount;
 	// Allocate C+1 size array for storage the result
 	std::vector<Vector3> sample(SampleSegmentCount + 1);
-	Vector3 ptr;
-	float r = 0.0f;
-	unsigned int k = 1;
-
-	for (unsigned int i = 0; i < SampleSegmentCount + 1; i++, r += Interval)
-	{
-		sample[i] = position(r);
-	}
+	this->sample(.0f, Interval, sample);
 
 	if (Smooth)
 		laplacianSmooth<Vector3>(sample, 0.8f, 4, m_isClose);
@@ -51,6 +102,102 @@ std::vector<Vector3> SpaceCurve::FixCountSampling2(unsigned int SampleSegmentCou
 	return smoothSampler.FixCountSampling(SampleSegmentCount, false);
 }
 
+unsigned SpaceCurve::Sampler::locate(float & t)
+{
+	auto& anchors = m_curve.m_anchors;
+	if (anchors.size() < 2)
+		return m_seg = 0;
+	float l = m_curve.length();
+	if (m_curve.m_isClose)
+	{
+		t = fmodf(t, l);
+		if (t < .0f)
+			t += l;
+	}
+	else
+	{
+		// clamp to [0,l]
+		t = std::max(.0f, std::min(t, l));
+	}
+
+	// same segment as the binary search in extract : anchors[a].w <= t < anchors[a+1].w
+	if (t < anchors[m_seg].w)
+		m_seg = 0;
+	unsigned last = static_cast<unsigned>(anchors.size()) - 2;
+	while (m_seg < last && anchors[m_seg + 1].w <= t)
+		++m_seg;
+	return m_seg;
+}
+
+XMVECTOR XM_CALLCONV SpaceCurve::Sampler::position(float t)
+{
+	auto& anchors = m_curve.m_anchors;
+	if (anchors.size() < 2)
+		return anchors.empty() ? g_XMIdentityR3.v : m_curve.position(0);
+
+	unsigned a = locate(t);
+	XMVECTOR v0 = XMLoadFloat4A(&anchors[a]);
+	XMVECTOR v1 = XMLoadFloat4A(&anchors[a + 1]);
+	float span = anchors[a + 1].w - anchors[a].w;
+	float rt = span > .0f ? (t - anchors[a].w) / span : .0f;
+	XMVECTOR v2 = XMVectorLerp(v0, v1, rt);
+
+	// set w = 1.0
+	return XMVectorSelect(v2, g_XMIdentityR3.v, g_XMIdentityR3.v);
+}
+
+void SpaceCurve::sample(float start, float interval, gsl::span<Vector3> output) const
+{
+	assert(interval >= .0f);
+	size_t n = output.size();
+	Sampler sampler(*this);
+	if (m_anchors.size() < 2)
+	{
+		for (size_t i = 0; i < n; i++)
+			output[i] = sampler.position(start + i * interval);
+		return;
+	}
+
+	size_t i = 0;
+	for (; i + 4 <= n; i += 4)
+	{
+		// locate 4 parameters, then interpolate them in SoA
+		XMFLOAT4A ts;
+		unsigned seg[4];
+		for (int j = 0; j < 4; j++)
+		{
+			float t = start + (i + j) * interval;
+			seg[j] = sampler.locate(t);
+			(&ts.x)[j] = t;
+		}
+
+		XMMATRIX A(XMLoadFloat4A(&m_anchors[seg[0]]), XMLoadFloat4A(&m_anchors[seg[1]]),
+			XMLoadFloat4A(&m_anchors[seg[2]]), XMLoadFloat4A(&m_anchors[seg[3]]));
+		XMMATRIX B(XMLoadFloat4A(&m_anchors[seg[0] + 1]), XMLoadFloat4A(&m_anchors[seg[1] + 1]),
+			XMLoadFloat4A(&m_anchors[seg[2] + 1]), XMLoadFloat4A(&m_anchors[seg[3] + 1]));
+		A = XMMatrixTranspose(A);
+		B = XMMatrixTranspose(B);
+
+		// rt = (t - wa) / (wb - wa), 0 for zero length segments
+		XMVECTOR span = B.r[3] - A.r[3];
+		XMVECTOR rt = (XMLoadFloat4A(&ts) - A.r[3]) / span;
+		rt = XMVectorSelect(rt, XMVectorZero(), XMVectorLessOrEqual(span, XMVectorZero()));
+
+		XMMATRIX P;
+		P.r[0] = XMVectorMultiplyAdd(B.r[0] - A.r[0], rt, A.r[0]);
+		P.r[1] = XMVectorMultiplyAdd(B.r[1] - A.r[1], rt, A.r[1]);
+		P.r[2] = XMVectorMultiplyAdd(B.r[2] - A.r[2], rt, A.r[2]);
+		P.r[3] = g_XMOne.v;
+		P = XMMatrixTranspose(P);
+
+		for (int j = 0; j < 4; j++)
+			XMStoreFloat3(&output[i + j], P.r[j]);
+	}
+
+	for (; i < n; i++)
+		output[i] = sampler.position(start + i * interval);
+}
+
 std::vector<Vector3> Geometrics::SpaceCurve::sample(size_t sampleCount) const
 {
 	return FixCountSampling2(sampleCount);
@@ -59,6 +206,7 @@ std::vector<Vector3> Geometrics::SpaceCurve::sample(size_t sampleCount) const
 void SpaceCurve::resample(size_t anchorCount, bool smooth)
 {
 	auto sample = FixCountSampling2(anchorCount);
+	m_dropped.clear();
 
 	m_anchors.resize(sample.size());
 	for (int i = 0; i < sample.size(); i++)
@@ -72,10 +220,34 @@ void SpaceCurve::resample(size_t anchorCount, bool smooth)
 
 void Geometrics::SpaceCurve::smooth(float alpha, unsigned iteration)
 {
-	laplacianSmooth<Vector4>( gsl::span<Vector4>((Vector4*)data(), size()), alpha, iteration, m_isClose);
+	laplacianSmooth(gsl::span<XMFLOAT4A>(data(), size()), alpha, iteration, m_isClose);
+	m_dropped.clear();
+	// the closing anchor duplicates the (moved) first one
+	if (m_isClose && !empty())
+		m_anchors.back() = m_anchors.front();
 	updateLength();
 }
 
+void SpaceCurve::smooth(float alpha, unsigned iteration, size_t window)
+{
+	size_t n = size();
+	if (window >= n)
+	{
+		smooth(alpha, iteration);
+		return;
+	}
+	if (window < 2)
+		return;
+
+	// include the settled anchor before the window as the fixed start point
+	size_t begin = n - window - 1;
+	laplacianSmooth(gsl::span<XMFLOAT4A>(data() + begin, window + 1), alpha, iteration, false);
+	m_dropped.clear();
+
+	// also fixes the closing anchor of a closed loop
+	updateLength(begin + 1);
+}
+
 std::vector<Vector3> SpaceCurve::FixIntervalSampling(float Interval) const
 {
 	assert(Interval != 0.0f);
@@ -89,6 +261,7 @@ std::vector<Vector3> SpaceCurve::FixIntervalSampling(float Interval) const
 }
 
 void SpaceCurve::setClose(bool close) {
+	m_bvh.clear();
 	if (!m_isClose && close && !empty())
 	{
 		auto btr = XMLoadA(m_anchors.back());
@@ -111,8 +284,59 @@ float SpaceCurve::length() const
 	return m_anchors.back().w;
 }
 
+bool XM_CALLCONV SpaceCurve::simplifyTip(FXMVECTOR vtr)
+{
+	size_t n = size();
+	if (m_dropped.size() >= MaxDroppedAnchors)
+	{
+		m_dropped.clear();
+		return false;
+	}
+
+	XMVECTOR a = XMLoadFloat4A(&m_anchors[n - 2]);
+	XMVECTOR tip = XMLoadFloat4A(&m_anchors[n - 1]);
+	XMVECTOR d = vtr - a;
+	XMVECTOR dd = XMVector3LengthSq(d);
+	bool degenerated = XMVectorGetX(dd) < XM_EPSILON;
+	float tol2 = m_tolerance * m_tolerance;
+
+	// squared distance from q to segment [a, vtr] within tolerance
+	auto within = [&](FXMVECTOR q) {
+		XMVECTOR t = degenerated ? XMVectorZero() : XMVectorSaturate(XMVector3Dot(q - a, d) / dd);
+		return XMVectorGetX(XMVector3LengthSq(q - XMVectorMultiplyAdd(t, d, a))) <= tol2;
+	};
+
+	bool merge = within(tip);
+	for (size_t i = 0; merge && i < m_dropped.size(); i++)
+		merge = within(XMLoadFloat4A(&m_dropped[i]));
+
+	if (!merge)
+	{
+		// the tip becomes a settled anchor, start a new segment from it
+		m_dropped.clear();
+		return false;
+	}
+
+	m_dropped.push_back(m_anchors[n - 1]);
+
+	float len = m_anchors[n - 2].w + XMVectorGetX(XMVector3Length(d));
+	XMStoreA(m_anchors[n - 1], vtr);
+	m_anchors[n - 1].w = len;
+
+	if (m_isClose)
+	{
+		XMVECTOR v = XMLoadA(m_anchors[0]);
+		m_anchors.back().w = len + XMVectorGetX(XMVector3Length(v - vtr));
+	}
+	return true;
+}
+
 bool XM_CALLCONV SpaceCurve::push_back(FXMVECTOR vtr, bool force)
 {
+	m_bvh.clear();
+	if (!force && m_tolerance > .0f && size() >= 2 && simplifyTip(vtr))
+		return true;
+
 	float len = .0f;
 	if (m_anchors.empty()) {
 		m_anchors.emplace_back();
@@ -244,16 +468,189 @@ XMVECTOR SpaceCurve::tangent(float t) const
 	return v2;
 }
 
-void SpaceCurve::updateLength()
+void SpaceCurve::updateLength(size_t from)
 {
-	m_anchors[0].w = 0;
-	XMVECTOR p0 = XMLoadFloat4A(&m_anchors[0]);
+	m_bvh.clear();
+	if (m_anchors.empty())
+		return;
+	if (from == 0)
+	{
+		m_anchors[0].w = 0;
+		from = 1;
+	}
+	XMVECTOR p0 = XMLoadFloat4A(&m_anchors[from - 1]);
 	XMVECTOR p1;
-	for (int i = 1; i < m_anchors.size(); i++)
+	for (size_t i = from; i < m_anchors.size(); i++)
 	{
 		p1 = XMLoadFloat4A(&m_anchors[i]);
 		float dt = XMVectorGetX(XMVector3Length(p1 - p0));
 		m_anchors[i].w = m_anchors[i - 1].w + dt;
 		p0 = p1;
 	}
-}
\ No newline at end of file
+}
+namespace
+{
+	// closest point on segment s0 + s * (s1 - s0), s in [0,1], to p
+	inline float XM_CALLCONV SegmentPointParameter(FXMVECTOR p, FXMVECTOR s0, FXMVECTOR s1)
+	{
+		XMVECTOR u = s1 - s0;
+		float a = XMVectorGetX(XMVector3LengthSq(u));
+		if (a < XM_EPSILON)
+			return .0f;
+		return std::max(.0f, std::min(1.0f, XMVectorGetX(XMVector3Dot(p - s0, u)) / a));
+	}
+
+	// closest points between segment s0 + s * (s1 - s0), s in [0,1] and ray o + r * v, r >= 0
+	// returns the squared distance
+	inline float XM_CALLCONV SegmentRayClosest(FXMVECTOR s0, FXMVECTOR s1, FXMVECTOR o, GXMVECTOR v, float& s)
+	{
+		XMVECTOR u = s1 - s0;
+		XMVECTOR w0 = s0 - o;
+		float a = XMVectorGetX(XMVector3LengthSq(u));
+		float b = XMVectorGetX(XMVector3Dot(u, v));
+		float c = XMVectorGetX(XMVector3LengthSq(v));
+		float d = XMVectorGetX(XMVector3Dot(u, w0));
+		float e = XMVectorGetX(XMVector3Dot(v, w0));
+		float denom = a * c - b * b;
+
+		s = denom > XM_EPSILON * a * c ? std::max(.0f, std::min(1.0f, (b * e - c * d) / denom)) : .0f;
+		float r = (b * s + e) / c;
+		if (r < .0f)
+		{
+			r = .0f;
+			s = a > XM_EPSILON ? std::max(.0f, std::min(1.0f, -d / a)) : .0f;
+		}
+
+		XMVECTOR diff = XMVectorMultiplyAdd(XMVectorReplicate(s), u, s0) - XMVectorMultiplyAdd(XMVectorReplicate(r), v, o);
+		return XMVectorGetX(XMVector3LengthSq(diff));
+	}
+}
+
+const std::vector<FlatBVHNode>& SpaceCurve::bvh() const
+{
+	if (m_bvh.empty() && m_anchors.size() >= 2)
+	{
+		size_t n = m_anchors.size() - 1;
+		std::vector<XMFLOAT3> smin(n), smax(n);
+		for (size_t i = 0; i < n; i++)
+		{
+			XMVECTOR p0 = XMLoadFloat4A(&m_anchors[i]);
+			XMVECTOR p1 = XMLoadFloat4A(&m_anchors[i + 1]);
+			XMStoreFloat3(&smin[i], XMVectorMin(p0, p1));
+			XMStoreFloat3(&smax[i], XMVectorMax(p0, p1));
+		}
+		build_flat_bvh(n, smin.data(), smax.data(), m_bvh, m_bvhSegments);
+	}
+	return m_bvh;
+}
+
+CurveHit XM_CALLCONV SpaceCurve::closestPoint(FXMVECTOR p, float maxDistance) const
+{
+	CurveHit hit;
+	if (m_anchors.size() == 1)
+	{
+		float dis = XMVectorGetX(XMVector3Length(p - XMLoadFloat4A(&m_anchors[0])));
+		if (dis <= maxDistance)
+			hit.distance = dis;
+		return hit;
+	}
+
+	float best = maxDistance < FLT_MAX ? maxDistance * maxDistance : FLT_MAX;
+	traverse_flat_bvh(bvh(), [&](const FlatBVHNode& node) {
+		if (node.distance_sq(p) > best)
+			return false;
+		for (uint32_t i = node.first; node.is_leaf() && i < node.first + node.count; i++)
+		{
+			uint32_t seg = m_bvhSegments[i];
+			XMVECTOR s0 = XMLoadFloat4A(&m_anchors[seg]);
+			XMVECTOR s1 = XMLoadFloat4A(&m_anchors[seg + 1]);
+			float s = SegmentPointParameter(p, s0, s1);
+			float d2 = XMVectorGetX(XMVector3LengthSq(p - XMVectorLerp(s0, s1, s)));
+			if (d2 <= best)
+			{
+				best = d2;
+				hit.segment = seg;
+				// lerp of w gives the arc length
+				hit.t = m_anchors[seg].w + s * (m_anchors[seg + 1].w - m_anchors[seg].w);
+				hit.distance = d2;
+			}
+		}
+		return true;
+	});
+
+	if (hit.valid())
+		hit.distance = sqrtf(hit.distance);
+	return hit;
+}
+
+CurveHit XM_CALLCONV SpaceCurve::rayDistance(FXMVECTOR origin, FXMVECTOR direction, float maxDistance) const
+{
+	CurveHit hit;
+	if (m_anchors.size() < 2)
+		return hit;
+
+	XMVECTOR dir = XMVector3Normalize(direction);
+	XMVECTOR invDir = ray_inverse_direction(dir);
+	float best = maxDistance;
+	traverse_flat_bvh(bvh(), [&](const FlatBVHNode& node) {
+		if (!node.intersects(origin, invDir, best, FLT_MAX))
+			return false;
+		for (uint32_t i = node.first; node.is_leaf() && i < node.first + node.count; i++)
+		{
+			uint32_t seg = m_bvhSegments[i];
+			float s;
+			float d = sqrtf(SegmentRayClosest(XMLoadFloat4A(&m_anchors[seg]), XMLoadFloat4A(&m_anchors[seg + 1]), origin, dir, s));
+			if (d <= best)
+			{
+				best = d;
+				hit.segment = seg;
+				hit.t = m_anchors[seg].w + s * (m_anchors[seg + 1].w - m_anchors[seg].w);
+				hit.distance = d;
+			}
+		}
+		return true;
+	});
+	return hit;
+}
+
+size_t XM_CALLCONV SpaceCurve::querySphere(FXMVECTOR center, float radius, std::vector<uint32_t>* segments) const
+{
+	if (m_anchors.size() < 2)
+		return 0;
+
+	size_t count = 0;
+	float r2 = radius * radius;
+	traverse_flat_bvh(bvh(), [&](const FlatBVHNode& node) {
+		if (node.distance_sq(center) > r2)
+			return false;
+		for (uint32_t i = node.first; node.is_leaf() && i < node.first + node.count; i++)
+		{
+			uint32_t seg = m_bvhSegments[i];
+			XMVECTOR s0 = XMLoadFloat4A(&m_anchors[seg]);
+			XMVECTOR s1 = XMLoadFloat4A(&m_anchors[seg + 1]);
+			float s = SegmentPointParameter(center, s0, s1);
+			if (XMVectorGetX(XMVector3LengthSq(center - XMVectorLerp(s0, s1, s))) <= r2)
+			{
+				++count;
+				if (segments)
+					segments->push_back(seg);
+			}
+		}
+		return true;
+	});
+	return count;
+}
+
+CurveHit XM_CALLCONV SpaceCurve::segmentClosestPoint(uint32_t segment, FXMVECTOR p) const
+{
+	assert(segment + 1 < m_anchors.size());
+	XMVECTOR s0 = XMLoadFloat4A(&m_anchors[segment]);
+	XMVECTOR s1 = XMLoadFloat4A(&m_anchors[segment + 1]);
+	float s = SegmentPointParameter(p, s0, s1);
+
+	CurveHit hit;
+	hit.segment = segment;
+	hit.t = m_anchors[segment].w + s * (m_anchors[segment + 1].w - m_anchors[segment].w);
+	hit.distance = XMVectorGetX(XMVector3Length(p - XMVectorLerp(s0, s1, s)));
+	return hit;
+}
@@ -4,6 +4,8 @@
 #include <memory>
 #include "DirectXMathExtend.h"
 #include <span.h>
+#include <cfloat>
+#include "FlatBVH.h"
 
 namespace Geometrics
 {
@@ -31,7 +33,7 @@ namespace Geometrics
 			else
 			{
 				BUFF[dst][0] = alpha * BUFF[src][0] + invAlpha * (BUFF[src][N - 1] + BUFF[src][1]);
-				BUFF[dst][N - 1] = alpha * BUFF[src][0] + invAlpha * (BUFF[src][N - 2] + BUFF[src][0]);
+				BUFF[dst][N - 1] = alpha * BUFF[src][N - 1] + invAlpha * (BUFF[src][N - 2] + BUFF[src][0]);
 			}
 
 			for (unsigned int i = 1; i < N - 1; i++)
@@ -50,6 +52,27 @@ namespace Geometrics
 		}
 	}
 
+	// In-place laplacian smoothing of XMFLOAT4A points (all 4 components), no full size temporary
+	// Open curves run all iterations in one cache-friendly wavefront sweep, end points are fixed
+	// Closed loops (curve[N-1] neighbors curve[0]) sweep once per iteration with a rolling window
+	void laplacianSmooth(gsl::span<XMFLOAT4A> curve, float alpha/* = 0.8f*/, unsigned IterationTimes /*= 1*/, bool closeLoop /*=false*/);
+
+	// Result of a nearest / picking query against curves
+	struct CurveHit
+	{
+		// index of the curve inside a CurveCollection, 0 for single curve queries
+		uint32_t	curve;
+		// the hit lies on segment [segment, segment + 1] of the anchors
+		uint32_t	segment;
+		// arc length parameter of the hit point on the curve
+		float		t;
+		// distance from the query to the curve
+		float		distance;
+
+		CurveHit() : curve(0), segment(0), t(.0f), distance(FLT_MAX) {}
+		bool valid() const { return distance < FLT_MAX; }
+	};
+
 	// Class to represent a spatial curve with anchor points
 	// Provide method for linear sampling from it
 	class SpaceCurve
@@ -67,14 +90,21 @@ namespace Geometrics
 		size_t size() const;
 		bool empty() const { return m_anchors.empty(); }
 		float length() const;
+		// writable anchors, call updateLength after editing them in place
 		XMFLOAT4A* data() { return m_anchors.data(); }
 		const XMFLOAT4A* data() const { return m_anchors.data(); }
-		void clear() { m_anchors.clear(); }
+		void clear() { m_anchors.clear(); m_dropped.clear(); m_bvh.clear(); }
 		bool push_back(const Vector3& p, bool force = false);
 		bool XM_CALLCONV push_back(FXMVECTOR p, bool force = false);
 		bool XM_CALLCONV append(FXMVECTOR p, bool force = false) { return push_back(p,force); }
 		XMVECTOR back() const;
 
+		// online simplification for streamed input, 0 (default) disables it
+		// when enabled, push_back moves the last anchor to the new point instead of appending,
+		// as long as every point dropped since the previous anchor stays within tolerance of the new segment
+		float simplifyTolerance() const { return m_tolerance; }
+		void setSimplifyTolerance(float tolerance) { m_tolerance = tolerance; m_dropped.clear(); }
+
 		// Retrive the point at parameter position 't' belongs to [0,1]
 		// This O(LogN) level operation
 		// perform a binary search in anchors 
@@ -97,27 +127,75 @@ namespace Geometrics
 		inline XMVECTOR operator()(float t) const { return extract(t); }
 
 
+		// Forward iterating sampler for non-decreasing parameter sequences
+		// Walks the anchors once instead of a binary search per sample, O(N+M) for M samples
+		// A parameter smaller than the previous one (e.g. wrapping a closed loop) rewinds to the first anchor
+		class Sampler
+		{
+		public:
+			explicit Sampler(const SpaceCurve& curve) : m_curve(curve), m_seg(0) {}
+
+			// same as SpaceCurve::extract(t)
+			XMVECTOR XM_CALLCONV position(float t);
+			XMVECTOR XM_CALLCONV operator()(float t) { return position(t); }
+			void reset() { m_seg = 0; }
+
+			// wrap or clamp t into [0,length], find the segment [seg, seg+1] contains it
+			unsigned locate(float& t);
+
+		private:
+			const SpaceCurve&	m_curve;
+			unsigned			m_seg;
+		};
+
+		// sample output.size() points at parameter start + i * interval (interval >= 0)
+		// interpolate 4 points per step in SIMD
+		void sample(float start, float interval, gsl::span<Vector3> output) const;
+
 		std::vector<Vector3> sample(size_t sampleCount) const;
 		void resample(size_t anchorCount, bool smooth = true);
 
 		void smooth(float alpha/* = 0.8f*/, unsigned iteration /*= 1*/);
+		// re-smooth only the last 'window' anchors, for live input where the rest of the curve is settled
+		// the anchor before the window and the last anchor stay fixed, O(window * iteration)
+		void smooth(float alpha, unsigned iteration, size_t window);
 
 		std::vector<Vector3> FixIntervalSampling(float Interval) const;
 		std::vector<Vector3> FixCountSampling(unsigned int SampleSegmentCount, bool Smooth = true) const;
 		std::vector<Vector3> FixCountSampling2(unsigned int SampleSegmentCount) const;
 
-		void updateLength();
+		// recompute the cumulative length (w) of anchors from index 'from' to the end
+		// push_back maintains it incrementally, only edits in place need this
+		// also drops the segment bvh, so it must follow any edit through data() or anchor(idx)
+		void updateLength(size_t from = 0);
 
 		const XMFLOAT4A& anchor(int idx) const
 		{
 			return m_anchors[idx];
 		}
 
+		// writable anchor, call updateLength after editing it in place
 		XMFLOAT4A& anchor(int idx)
 		{
 			return m_anchors[idx];
 		}
 
+		// Spatial queries, backed by a segment BVH built lazily on first query after an edit
+		// Not thread safe for the first query, call bvh() once before querying from multiple threads
+		const std::vector<FlatBVHNode>& bvh() const;
+
+		// closest point on the curve to p, invalid hit if farther than maxDistance
+		CurveHit XM_CALLCONV closestPoint(FXMVECTOR p, float maxDistance = FLT_MAX) const;
+
+		// the curve point closest to the ray (origin, direction), invalid hit if farther than maxDistance
+		CurveHit XM_CALLCONV rayDistance(FXMVECTOR origin, FXMVECTOR direction, float maxDistance) const;
+
+		// segments within radius of center, appended to segments (if not null), returns the count
+		size_t XM_CALLCONV querySphere(FXMVECTOR center, float radius, std::vector<uint32_t>* segments = nullptr) const;
+
+		// closest point to p on segment [segment, segment + 1], t is interpolated between the anchor lengths
+		CurveHit XM_CALLCONV segmentClosestPoint(uint32_t segment, FXMVECTOR p) const;
+
 		const AnchorCollection& anchors() const
 		{
 			return m_anchors;
@@ -127,6 +205,19 @@ namespace Geometrics
 		// The data we stored is actually aligned on 16-byte boundary , so , use it as a XMFLOAT4A
 		AnchorCollection m_anchors;
 		bool m_isClose;
+
+		// upper bound of points merged into one segment, keeps push_back O(1)
+		static constexpr size_t MaxDroppedAnchors = 64;
+
+		float m_tolerance;
+		// points merged into the last segment by the online simplification
+		AnchorCollection m_dropped;
+
+		bool XM_CALLCONV simplifyTip(FXMVECTOR p);
+
+		// segment bvh, empty when outdated
+		mutable std::vector<FlatBVHNode> m_bvh;
+		mutable std::vector<uint32_t> m_bvhSegments;
 	};
 
 }
\ No newline at end of file
@@ -0,0 +1,178 @@
+#pragma once
+
+#include <vector>
+#include <DirectXMathExtend.h>
+#include <VertexTraits.h>
+#include <span.h>
+#include "MeshAdjacency.h"
+
+namespace Geometrics
+{
+	/// <summary>
+	/// Orthonormal frame of a sweep ring, the profile's x/y/z axes are mapped to axis[0..2], axis[1] is the path tangent.
+	/// </summary>
+	struct SweepFrame
+	{
+		DirectX::XMFLOAT4A position;
+		DirectX::XMFLOAT4A axis[3];
+	};
+
+	/// <summary>
+	/// Rotation minimizing frames along a polyline by the double reflection method (Wang et al. 2008), one pass.
+	/// </summary>
+	/// <param name="positions">ring positions.</param>
+	/// <param name="tangents">unit path tangents at the rings, zero tangents keep the previous one.</param>
+	/// <param name="initialNormal">the axis[0] of the first frame, perpendicular to the first tangent.</param>
+	/// <param name="frames">output, same size as positions.</param>
+	inline void XM_CALLCONV compute_rotation_minimizing_frames(
+		gsl::span<const DirectX::XMFLOAT4A> positions,
+		gsl::span<const DirectX::XMFLOAT4A> tangents,
+		DirectX::FXMVECTOR initialNormal,
+		gsl::span<SweepFrame> frames)
+	{
+		using namespace DirectX;
+		assert(tangents.size() == positions.size() && frames.size() >= positions.size());
+		size_t n = positions.size();
+		if (n == 0)
+			return;
+
+		XMVECTOR x0 = XMVectorAndInt(XMLoadFloat4A(&positions[0]), g_XMMask3.v);
+		XMVECTOR t0 = XMLoadFloat4A(&tangents[0]);
+		XMVECTOR r0 = initialNormal;
+		for (size_t i = 0; i < n; i++)
+		{
+			XMVECTOR x1 = XMVectorAndInt(XMLoadFloat4A(&positions[i]), g_XMMask3.v);
+			XMVECTOR t1 = XMLoadFloat4A(&tangents[i]);
+			if (XMVector3Less(XMVector3LengthSq(t1), g_XMEpsilon.v))
+				t1 = t0;
+
+			if (i > 0)
+			{
+				// reflect the previous frame by the bisector plane of x0-x1, then by the plane that maps the tangent onto t1
+				XMVECTOR v1 = x1 - x0;
+				XMVECTOR c1 = XMVector3LengthSq(v1);
+				if (XMVector3Greater(c1, g_XMEpsilon.v))
+				{
+					XMVECTOR k = XMVectorReplicate(2.0f) / c1;
+					r0 -= k * XMVector3Dot(v1, r0) * v1;
+					t0 -= k * XMVector3Dot(v1, t0) * v1;
+				}
+				XMVECTOR v2 = t1 - t0;
+				XMVECTOR c2 = XMVector3LengthSq(v2);
+				if (XMVector3Greater(c2, g_XMEpsilon.v))
+					r0 -= XMVectorReplicate(2.0f) / c2 * XMVector3Dot(v2, r0) * v2;
+
+				// drop the drift from the plane perpendicular to t1
+				r0 = XMVector3Normalize(r0 - XMVector3Dot(r0, t1) * t1);
+			}
+
+			auto& frame = frames[i];
+			XMStoreFloat4A(&frame.position, XMVectorSelect(g_XMIdentityR3.v, x1, g_XMSelect1110.v));
+			XMStoreFloat4A(&frame.axis[0], r0);
+			XMStoreFloat4A(&frame.axis[1], t1);
+			XMStoreFloat4A(&frame.axis[2], XMVector3Cross(r0, t1));
+
+			x0 = x1;
+			t0 = t1;
+		}
+	}
+
+	/// <summary>
+	/// A sweep profile in structure of arrays layout, padded to a multiple of 4 points.
+	/// </summary>
+	struct SweepProfile
+	{
+		std::vector<float, DirectX::AlignedAllocator<float>> px, py, pz, tx, ty, tz;
+		size_t count;
+
+		SweepProfile() : count(0) {}
+
+		// positions and unit tangents of the profile points in the local frame
+		template <class _PointType>
+		void assign(gsl::span<const _PointType> positions, gsl::span<const _PointType> tangents)
+		{
+			assert(positions.size() == tangents.size());
+			count = positions.size();
+			size_t padded = (count + 3) & ~size_t(3);
+			for (auto* a : { &px, &py, &pz, &tx, &ty, &tz })
+				a->assign(padded, .0f);
+			for (size_t i = 0; i < count; i++)
+			{
+				px[i] = positions[i].x; py[i] = positions[i].y; pz[i] = positions[i].z;
+				tx[i] = tangents[i].x; ty[i] = tangents[i].y; tz[i] = tangents[i].z;
+			}
+		}
+	};
+
+	/// <summary>
+	/// Emit the vertices of all rings, ring r occupies vertices [r * profile.count, (r + 1) * profile.count).
+	/// Position = frame.position + rotated profile point, normal = tangent x rotated profile tangent, uv = (i / count, ringParams[r]).
+	/// 4 profile points are transformed per step in SoA, rings are distributed over worker threads.
+	/// </summary>
+	template <class _VertexType>
+	void sweep_profile(gsl::span<const SweepFrame> frames, gsl::span<const float> ringParams, const SweepProfile& profile, gsl::span<_VertexType> vertices)
+	{
+		using namespace DirectX;
+		using namespace DirectX::VertexTraits;
+
+		size_t rings = frames.size();
+		size_t cols = profile.count;
+		assert(ringParams.size() >= rings && vertices.size() >= rings * cols);
+		if (rings == 0 || cols == 0)
+			return;
+
+		size_t grain = std::max<size_t>(1, 4096 / cols);
+		Internal::for_each_chunk(rings, Internal::chunk_count(rings, grain), [&](size_t, size_t begin, size_t end) {
+			for (size_t r = begin; r < end; r++)
+			{
+				const auto& frame = frames[r];
+				XMVECTOR o = XMLoadFloat4A(&frame.position);
+				XMVECTOR ax = XMLoadFloat4A(&frame.axis[0]);
+				XMVECTOR ay = XMLoadFloat4A(&frame.axis[1]);
+				XMVECTOR az = XMLoadFloat4A(&frame.axis[2]);
+
+				XMVECTOR ox = XMVectorSplatX(o), oy = XMVectorSplatY(o), oz = XMVectorSplatZ(o);
+				XMVECTOR axx = XMVectorSplatX(ax), axy = XMVectorSplatY(ax), axz = XMVectorSplatZ(ax);
+				XMVECTOR ayx = XMVectorSplatX(ay), ayy = XMVectorSplatY(ay), ayz = XMVectorSplatZ(ay);
+				XMVECTOR azx = XMVectorSplatX(az), azy = XMVectorSplatY(az), azz = XMVectorSplatZ(az);
+				float v = ringParams[r];
+				_VertexType* ring = vertices.data() + r * cols;
+
+				for (size_t i = 0; i < cols; i += 4)
+				{
+					XMVECTOR x = XMLoadFloat4A(reinterpret_cast<const XMFLOAT4A*>(&profile.px[i]));
+					XMVECTOR y = XMLoadFloat4A(reinterpret_cast<const XMFLOAT4A*>(&profile.py[i]));
+					XMVECTOR z = XMLoadFloat4A(reinterpret_cast<const XMFLOAT4A*>(&profile.pz[i]));
+					XMVECTOR tx = XMLoadFloat4A(reinterpret_cast<const XMFLOAT4A*>(&profile.tx[i]));
+					XMVECTOR tz = XMLoadFloat4A(reinterpret_cast<const XMFLOAT4A*>(&profile.tz[i]));
+
+					// p = o + x * ax + y * ay + z * az
+					XMMATRIX P;
+					P.r[0] = XMVectorMultiplyAdd(z, azx, XMVectorMultiplyAdd(y, ayx, XMVectorMultiplyAdd(x, axx, ox)));
+					P.r[1] = XMVectorMultiplyAdd(z, azy, XMVectorMultiplyAdd(y, ayy, XMVectorMultiplyAdd(x, axy, oy)));
+					P.r[2] = XMVectorMultiplyAdd(z, azz, XMVectorMultiplyAdd(y, ayz, XMVectorMultiplyAdd(x, axz, oz)));
+					P.r[3] = g_XMOne.v;
+
+					// ay x (tx * ax + ty * ay + tz * az) = tz * ax - tx * az
+					XMMATRIX N;
+					N.r[0] = XMVectorNegativeMultiplySubtract(tx, azx, tz * axx);
+					N.r[1] = XMVectorNegativeMultiplySubtract(tx, azy, tz * axy);
+					N.r[2] = XMVectorNegativeMultiplySubtract(tx, azz, tz * axz);
+					N.r[3] = XMVectorZero();
+
+					P = XMMatrixTranspose(P);
+					N = XMMatrixTranspose(N);
+
+					size_t m = std::min<size_t>(4, cols - i);
+					for (size_t j = 0; j < m; j++)
+					{
+						auto& vtx = ring[i + j];
+						set_position(vtx, P.r[j]);
+						set_normal(vtx, N.r[j]);
+						set_uv(vtx, (float)(i + j) / (float)(cols), v);
+					}
+				}
+			}
+		});
+	}
+}
@@ -8,6 +8,8 @@
 #include <gsl.h>
 #include <VertexTraits.h>
 #include <minmax>
+#include "MeshAdjacency.h"
+#include "MeshTransform.h"
 
 namespace Geometrics
 {
@@ -136,17 +138,16 @@ namespace Geometrics
 
 		for (const auto& face : facets)
 		{
-			{
-				XMVECTOR v0, v1, v2, w0, w1, w2;
-				v0 = get_position(vertices[face[0]]);
-				w0 = get_uv(vertices[face[0]]);
+			XMVECTOR v0, v1, v2, w0, w1, w2;
+			v0 = get_position(vertices[face[0]]);
+			w0 = get_uv(vertices[face[0]]);
 
-				v1 = get_position(vertices[face[1]]);
-				w1 = get_uv(vertices[face[1]]);
+			v1 = get_position(vertices[face[1]]);
+			w1 = get_uv(vertices[face[1]]);
+
+			v2 = get_position(vertices[face[2]]);
+			w2 = get_uv(vertices[face[2]]);
 
-				v2 = get_position(vertices[face[2]]);
-				w2 = get_uv(vertices[face[2]]);
-			}
 			XMFLOAT4A v_1, v_2, w_1, w_2;
 
 			XMStoreA(v_1, v1 - v0);
@@ -182,7 +183,7 @@ namespace Geometrics
 
 		for (size_t i = 0; i < vertices.size(); i++)
 		{
-			XMVECTOR n = get_normal(vertices[i], n);
+			XMVECTOR n = get_normal(vertices[i]);
 			XMVECTOR t = tan1[i];
 
 			// Gram-Schmidt orthogonalize
@@ -297,6 +298,10 @@ namespace Geometrics
 		void XM_CALLCONV transform(DirectX::FXMMATRIX M)
 		{
 			using namespace DirectX::VertexTraits;
+			// bulk SIMD path for plain float3 vertex layouts
+			if (bulk_transform<VertexType>(this->vertices, M))
+				return;
+
 			for (auto& v : vertices)
 			{
 				XMVECTOR p = get_position(v);
@@ -432,46 +437,14 @@ namespace Geometrics
 		}
 
 		// build the adjacent map so we can access all the 1 rings
-		void build()
+		// half-edges of non-manifold edges are left unpaired (-1) and reported in nonManifoldEdges
+		// returns the number of non-manifold half-edges
+		size_t build(std::vector<uint32_t>* nonManifoldEdges = nullptr)
 		{
 			// intialize all adjacant edges to -1
-			revedges.resize(this->indices.size(), -1);
-			_IndexType vsize = this->vertices.size();
-			int esize = this->indices.size();
-
-			using hash_type = uint64_t;
-			// make sure int for hash is enough
-			assert(vsize*vsize < std::numeric_limits<hash_type>::max());
-			std::unordered_map<hash_type, _IndexType> edges(esize * 2);
-			// max items inside this table should be less than (esize / 2)
-
-			_IndexType fid = 0;
-			for (const Triangle<_IndexType>& tri : this->facets())
-			{
-				for (_IndexType i = 0; i < VertexCount; i++)
-				{
-					_IndexType eid = i + fid * 3;
-					auto e = edge(fid, i);
+			revedges.assign(this->indices.size(), static_cast<IndexType>(-1));
 
-					hash_type ehash = e.v0 * vsize + e.v1;
-					hash_type revehash = e.v0 + e.v1 * vsize;
-
-					auto revItr = edges.find(revehash);
-					if (revItr == edges.end())
-					{
-						edges[ehash] = fid + 0;
-					}
-					else // find reversed edge, remove from edges map
-					{
-						auto revEid = revItr->second;
-						revedges[eid] = revEid;
-						revedges[revEid] = eid;
-						edges.erase(revItr);
-					}
-				}
-
-				++fid;
-			}
+			return build_adjacency<IndexType, FaceType>(this->facets(), this->vertices.size(), revedges, nonManifoldEdges);
 		}
 
 		int XM_CALLCONV intersect(DirectX::FXMVECTOR Origin, DirectX::FXMVECTOR Direction, std::vector<MeshRayIntersectionInfo>* output) const
@@ -0,0 +1,185 @@
+#pragma once
+
+#include <vector>
+#include <cmath>
+#include <DirectXMathExtend.h>
+#include <VertexTraits.h>
+#include <span.h>
+#include "MeshAdjacency.h"
+
+namespace Geometrics
+{
+	/// <summary>
+	/// Uniform grid over the uv-space triangles of a mesh, answers "which facet contains this uv" queries.
+	/// Each cell stores (CSR) the facets whose uv bounding box overlaps it, so a point query only tests a handful of facets.
+	/// Build once per surface, rebuild if the uv or topology changed.
+	/// </summary>
+	class UVFacetGrid
+	{
+	public:
+		typedef DirectX::XMFLOAT2 uv_type;
+
+		UVFacetGrid() : m_cols(0), m_rows(0) {}
+
+		bool empty() const { return m_facets.empty(); }
+		void clear() { m_cells.clear(); m_facets.clear(); m_offsets.clear(); m_cols = m_rows = 0; }
+
+		template <class _MeshType>
+		void build(const _MeshType& mesh, float cellsPerFacet = 1.0f)
+		{
+			using namespace DirectX;
+			using namespace DirectX::VertexTraits;
+			auto facets = mesh.facets();
+			auto& vertices = mesh.vertices;
+
+			clear();
+			if (facets.size() == 0)
+				return;
+
+			m_facets.resize(facets.size());
+			XMVECTOR vmin = g_XMFltMax.v, vmax = -g_XMFltMax.v;
+			for (size_t i = 0; i < facets.size(); i++)
+			{
+				const auto& tri = facets[i];
+				XMVECTOR w0 = get_uv(vertices[tri[0]]);
+				XMVECTOR w1 = get_uv(vertices[tri[1]]);
+				XMVECTOR w2 = get_uv(vertices[tri[2]]);
+				vmin = XMVectorMin(vmin, XMVectorMin(w0, XMVectorMin(w1, w2)));
+				vmax = XMVectorMax(vmax, XMVectorMax(w0, XMVectorMax(w1, w2)));
+
+				auto& f = m_facets[i];
+				XMStoreFloat2(&f.uv0, w0);
+				XMStoreFloat2(&f.e1, w1 - w0);
+				XMStoreFloat2(&f.e2, w2 - w0);
+				float det = f.e1.x * f.e2.y - f.e2.x * f.e1.y;
+				f.invDet = det != .0f ? 1.0f / det : .0f;
+			}
+
+			XMStoreFloat2(&m_min, vmin);
+			XMFLOAT2 ext;
+			XMStoreFloat2(&ext, vmax - vmin);
+
+			// roughly cellsPerFacet cells per facet, keep cells square-ish
+			float cells = std::max(1.0f, facets.size() * cellsPerFacet);
+			float aspect = ext.y > .0f ? ext.x / ext.y : 1.0f;
+			m_cols = std::max(1, (int)std::sqrt(cells * aspect));
+			m_rows = std::max(1, (int)(cells / m_cols));
+			m_cellSize.x = ext.x > .0f ? ext.x / m_cols : 1.0f;
+			m_cellSize.y = ext.y > .0f ? ext.y / m_rows : 1.0f;
+
+			// two pass bucket fill
+			m_offsets.assign(m_cols * m_rows + 1, 0);
+			for (int pass = 0; pass < 2; pass++)
+			{
+				for (size_t i = 0; i < facets.size(); i++)
+				{
+					const auto& f = m_facets[i];
+					float minu = f.uv0.x + std::min(.0f, std::min(f.e1.x, f.e2.x));
+					float maxu = f.uv0.x + std::max(.0f, std::max(f.e1.x, f.e2.x));
+					float minv = f.uv0.y + std::min(.0f, std::min(f.e1.y, f.e2.y));
+					float maxv = f.uv0.y + std::max(.0f, std::max(f.e1.y, f.e2.y));
+					int c0 = col(minu), c1 = col(maxu), r0 = row(minv), r1 = row(maxv);
+					for (int r = r0; r <= r1; r++)
+						for (int c = c0; c <= c1; c++)
+						{
+							if (pass == 0)
+								++m_offsets[r * m_cols + c + 1];
+							else
+								m_cells[m_cursor[r * m_cols + c]++] = static_cast<uint32_t>(i);
+						}
+				}
+
+				if (pass == 0)
+				{
+					for (size_t c = 1; c < m_offsets.size(); c++)
+						m_offsets[c] += m_offsets[c - 1];
+					m_cells.resize(m_offsets.back());
+					m_cursor.assign(m_offsets.begin(), m_offsets.end() - 1);
+				}
+			}
+			m_cursor.clear();
+			m_cursor.shrink_to_fit();
+		}
+
+		/// <summary>
+		/// Find the facet containing uv.
+		/// </summary>
+		/// <param name="uv">The uv point.</param>
+		/// <param name="barycentric">Output barycentric coordinate inside the facet.</param>
+		/// <returns>facet id, or -1 if uv is not covered by any facet</returns>
+		int XM_CALLCONV locate(DirectX::FXMVECTOR uv, DirectX::XMFLOAT3& barycentric, float epsilon = 1e-5f) const
+		{
+			using namespace DirectX;
+			if (empty())
+				return -1;
+
+			XMFLOAT2 p;
+			XMStoreFloat2(&p, uv);
+			// points outside the grid are clamped to the border cells and rejected by the barycentric test
+			size_t cell = row(p.y) * m_cols + col(p.x);
+			for (uint32_t i = m_offsets[cell]; i < m_offsets[cell + 1]; i++)
+			{
+				uint32_t fid = m_cells[i];
+				const auto& f = m_facets[fid];
+				float dx = p.x - f.uv0.x, dy = p.y - f.uv0.y;
+				float b1 = (dx * f.e2.y - f.e2.x * dy) * f.invDet;
+				float b2 = (f.e1.x * dy - dx * f.e1.y) * f.invDet;
+				float b0 = 1.0f - b1 - b2;
+				if (b0 >= -epsilon && b1 >= -epsilon && b2 >= -epsilon && f.invDet != .0f)
+				{
+					barycentric = XMFLOAT3(b0, b1, b2);
+					return static_cast<int>(fid);
+				}
+			}
+			return -1;
+		}
+
+		/// <summary>
+		/// Batch unproject uv points to positions on the mesh, runs in parallel for large batches.
+		/// Points outside the uv domain get fid = -1 and position unchanged.
+		/// _UVType / _PositionType may be any type derived from XMFLOAT2 / XMFLOAT3.
+		/// </summary>
+		template <class _MeshType, class _UVType, class _PositionType>
+		void unproject(const _MeshType& mesh, gsl::span<const _UVType> uvs, gsl::span<_PositionType> positions, gsl::span<int> fids) const
+		{
+			using namespace DirectX;
+			using namespace DirectX::VertexTraits;
+			assert(positions.size() >= uvs.size() && fids.size() >= uvs.size());
+
+			size_t n = uvs.size();
+			Internal::for_each_chunk(n, Internal::chunk_count(n, 1U << 10), [&](size_t, size_t begin, size_t end) {
+				XMFLOAT3 bc;
+				for (size_t i = begin; i < end; i++)
+				{
+					int fid = locate(XMLoadFloat2(&uvs[i]), bc);
+					fids[i] = fid;
+					if (fid < 0)
+						continue;
+					const auto& tri = mesh.facet(fid);
+					XMVECTOR p = get_position(mesh.vertices[tri[0]]) * bc.x;
+					p += get_position(mesh.vertices[tri[1]]) * bc.y;
+					p += get_position(mesh.vertices[tri[2]]) * bc.z;
+					XMStoreFloat3(&positions[i], p);
+				}
+			});
+		}
+
+	private:
+		int col(float u) const { return std::min(m_cols - 1, std::max(0, (int)std::floor((u - m_min.x) / m_cellSize.x))); }
+		int row(float v) const { return std::min(m_rows - 1, std::max(0, (int)std::floor((v - m_min.y) / m_cellSize.y))); }
+
+		struct FacetUV
+		{
+			uv_type uv0, e1, e2;
+			float	invDet;
+		};
+
+		int							m_cols, m_rows;
+		uv_type						m_min;
+		uv_type						m_cellSize;
+		std::vector<FacetUV>		m_facets;
+		std::vector<uint32_t>		m_offsets;
+		std::vector<uint32_t>		m_cells;
+		std::vector<uint32_t>		m_cursor;
+	};
+}